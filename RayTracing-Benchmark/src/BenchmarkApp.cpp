@@ -0,0 +1,521 @@
+#include "BVH.h"
+#include "Camera.h"
+#include "Denoiser.h"
+#include "Framebuffer.h"
+#include "Renderer.h"
+#include "ResolveKernels.h"
+#include "Sampler.h"
+#include "Scenes.h"
+#include "SphereKernels.h"
+#include "Upscaler.h"
+#include "Utils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <limits>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace RayTracing {
+
+    struct BenchmarkOptions
+    {
+        std::string Filter; // Only run benchmarks whose name contains this
+        double MinTimeMs = 500.0;
+        std::string OutputPath = "benchmark.json";
+    };
+
+    struct BenchmarkResult
+    {
+        std::string Name;
+        uint64_t Iterations = 0;
+        uint64_t Items = 0; // What an item is depends on the benchmark: a random number, a ray, a pixel...
+        double TotalMs = 0.0;
+    };
+
+    // A benchmark body runs one iteration and returns how many items it processed
+    using BenchmarkFunc = std::function<uint64_t()>;
+
+    // Results are folded into this so the compiler can't drop the work that produced them
+    static volatile uint32_t s_Sink = 0;
+
+    namespace Utils {
+
+        static void PrintUsage(const char* executable)
+        {
+            printf("Usage: %s [options]\n", executable);
+            printf("  --filter <text>    Only run benchmarks whose name contains <text>\n");
+            printf("  --min-time <ms>    Keep repeating each benchmark for at least this long (default 500)\n");
+            printf("  --output <path>    Results as JSON (default benchmark.json)\n");
+        }
+
+        static bool ParseArguments(int argc, char** argv, BenchmarkOptions& options)
+        {
+            for (int i = 1; i < argc; i++)
+            {
+                const char* arg = argv[i];
+                if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+                    return false;
+
+                if (i + 1 >= argc)
+                {
+                    fprintf(stderr, "Missing value for '%s'\n", arg);
+                    return false;
+                }
+
+                const char* value = argv[++i];
+                if (strcmp(arg, "--filter") == 0)
+                    options.Filter = value;
+                else if (strcmp(arg, "--min-time") == 0)
+                    options.MinTimeMs = strtod(value, nullptr);
+                else if (strcmp(arg, "--output") == 0)
+                    options.OutputPath = value;
+                else
+                {
+                    fprintf(stderr, "Unknown option '%s'\n", arg);
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        // Rays from the default camera position into the -z half space, roughly what the camera sees
+        static std::vector<Ray> CreateRays(uint32_t count, uint32_t seed)
+        {
+            std::vector<Ray> rays(count);
+            for (Ray& ray : rays)
+            {
+                ray.Origin = glm::vec3(0.0f, 0.0f, 6.0f);
+                ray.Direction = glm::normalize(glm::vec3(FastRandom(seed) - 0.5f, (FastRandom(seed) - 0.5f) * 0.6f, -1.0f));
+            }
+            return rays;
+        }
+
+        static bool WriteJSON(const std::string& path, const std::vector<BenchmarkResult>& results)
+        {
+            FILE* file = fopen(path.c_str(), "w");
+            if (!file)
+                return false;
+
+            char date[32];
+            time_t now = time(nullptr);
+            strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+            fprintf(file, "{\n");
+            fprintf(file, "  \"context\": {\n");
+            fprintf(file, "    \"date\": \"%s\",\n", date);
+            fprintf(file, "    \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+            fprintf(file, "    \"sphere_kernel\": \"%s\",\n", SphereKernels::GetName(SphereKernels::GetBest()));
+            fprintf(file, "    \"resolve_kernel\": \"%s\",\n", ResolveKernels::GetName(ResolveKernels::GetBest()));
+            fprintf(file, "    \"denoise_kernel\": \"%s\",\n", DenoiseKernels::GetName(DenoiseKernels::GetBest()));
+#ifdef NDEBUG
+            fprintf(file, "    \"optimized\": true\n");
+#else
+            fprintf(file, "    \"optimized\": false\n");
+#endif
+            fprintf(file, "  },\n");
+            fprintf(file, "  \"benchmarks\": [\n");
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                const BenchmarkResult& result = results[i];
+                fprintf(file, "    { \"name\": \"%s\", \"iterations\": %llu, \"items\": %llu, \"total_ms\": %.4f, \"ms_per_iteration\": %.6f, \"ns_per_item\": %.4f }%s\n",
+                    result.Name.c_str(), (unsigned long long)result.Iterations, (unsigned long long)result.Items, result.TotalMs,
+                    result.TotalMs / (double)result.Iterations, result.TotalMs * 1e6 / (double)result.Items,
+                    i + 1 < results.size() ? "," : "");
+            }
+            fprintf(file, "  ]\n");
+            fprintf(file, "}\n");
+
+            fclose(file);
+            return true;
+        }
+
+    }
+
+    class BenchmarkRunner
+    {
+    public:
+        BenchmarkRunner(const BenchmarkOptions& options)
+            : m_Options(options) {}
+
+        bool IsEnabled(const std::string& name) const
+        {
+            return m_Options.Filter.empty() || name.find(m_Options.Filter) != std::string::npos;
+        }
+
+        void Run(const std::string& name, const BenchmarkFunc& body)
+        {
+            if (!IsEnabled(name))
+                return;
+
+            // One untimed iteration pays for first touch of memory, BVH builds and thread start-up
+            body();
+
+            BenchmarkResult result;
+            result.Name = name;
+
+            auto start = std::chrono::steady_clock::now();
+            do
+            {
+                result.Items += body();
+                result.Iterations++;
+                result.TotalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            } while (result.TotalMs < m_Options.MinTimeMs);
+
+            printf("%-48s %10llu it  %12.3f ms/it  %10.3f ns/item\n", name.c_str(), (unsigned long long)result.Iterations,
+                result.TotalMs / (double)result.Iterations, result.TotalMs * 1e6 / (double)result.Items);
+            fflush(stdout);
+
+            m_Results.push_back(result);
+        }
+
+        const std::vector<BenchmarkResult>& GetResults() const { return m_Results; }
+    private:
+        BenchmarkOptions m_Options;
+        std::vector<BenchmarkResult> m_Results;
+    };
+
+    static void RunUtilsBenchmarks(BenchmarkRunner& runner)
+    {
+        constexpr uint32_t count = 1 << 20;
+
+        runner.Run("Utils/FastRandom", [&]()
+        {
+            uint32_t state = 1;
+            float sum = 0.0f;
+            for (uint32_t i = 0; i < count; i++)
+                sum += Utils::FastRandom(state);
+            s_Sink = s_Sink + (uint32_t)sum;
+            return (uint64_t)count;
+        });
+
+        runner.Run("Utils/CosineHemisphereDirection", [&]()
+        {
+            uint32_t state = 1;
+            glm::vec3 sum(0.0f);
+            const glm::vec3 normal = glm::normalize(glm::vec3(0.3f, 0.8f, -0.5f));
+            for (uint32_t i = 0; i < count; i++)
+                sum += Utils::CosineHemisphereDirection(normal, glm::vec2(Utils::FastRandom(state), Utils::FastRandom(state)));
+            s_Sink = s_Sink + (uint32_t)(sum.x + sum.y + sum.z);
+            return (uint64_t)count;
+        });
+
+        // One 2D sample of a new pixel sample per call, as a bounce draws it
+        const std::pair<const char*, SamplerType> samplers[] = { { "Independent", SamplerType::Independent }, { "Sobol", SamplerType::Sobol } };
+        for (const auto& [name, type] : samplers)
+        {
+            runner.Run(std::string("Sampler/") + name, [&, type = type]()
+            {
+                glm::vec2 sum(0.0f);
+                for (uint32_t i = 0; i < count; i++)
+                    sum += Sampler(type, i & 1023, i >> 10).Get2D(Sampler::GetDirectionDimension(i & 3));
+                s_Sink = s_Sink + (uint32_t)(sum.x + sum.y);
+                return (uint64_t)count;
+            });
+        }
+    }
+
+    static void RunResolveBenchmarks(BenchmarkRunner& runner)
+    {
+        std::vector<ResolveKernels::ResolveFunc> kernels = { ResolveKernels::ResolveScalar };
+        if (ResolveKernels::GetBest() != ResolveKernels::ResolveScalar)
+            kernels.push_back(ResolveKernels::GetBest());
+
+        struct Resolution
+        {
+            const char* Name;
+            uint32_t Width, Height;
+        };
+        const Resolution resolutions[] = { { "720p", 1280, 720 }, { "1080p", 1920, 1080 } };
+
+        for (const Resolution& resolution : resolutions)
+        {
+            // Random radiance with a few samples per pixel, the resolve cost doesn't depend on the values
+            Framebuffer framebuffer;
+            framebuffer.Resize(resolution.Width, resolution.Height);
+            uint32_t seed = 7;
+            for (uint32_t y = 0; y < resolution.Height; y++)
+            {
+                for (uint32_t x = 0; x < resolution.Width; x++)
+                {
+                    glm::vec3 radiance(Utils::FastRandom(seed), Utils::FastRandom(seed), Utils::FastRandom(seed));
+                    framebuffer.Accumulate(x, y, radiance * 8.0f, 4, 0.0f);
+                }
+            }
+
+            const ResolveSettings settings;
+            for (ResolveKernels::ResolveFunc kernel : kernels)
+            {
+                runner.Run(std::string("Resolve/") + ResolveKernels::GetName(kernel) + "/" + resolution.Name, [&]()
+                {
+                    kernel(framebuffer, 0, 0, resolution.Width, resolution.Height, settings);
+                    s_Sink = s_Sink + framebuffer.GetImageData()[0];
+                    return (uint64_t)resolution.Width * resolution.Height;
+                });
+            }
+        }
+    }
+
+    static void RunUpscaleBenchmarks(BenchmarkRunner& runner)
+    {
+        struct Scale
+        {
+            const char* Name;
+            uint32_t SourceWidth, SourceHeight;
+        };
+        const Scale scales[] = { { "50%", 960, 540 }, { "25%", 480, 270 } };
+
+        for (const Scale& scale : scales)
+        {
+            std::vector<uint32_t> source((size_t)scale.SourceWidth * scale.SourceHeight);
+            uint32_t seed = 7;
+            for (uint32_t& pixel : source)
+                pixel = Utils::Hash(seed++);
+
+            std::vector<uint32_t> destination((size_t)1920 * 1080);
+            runner.Run(std::string("Upscale/Bilinear/") + scale.Name + "/1080p", [&]()
+            {
+                Upscaler::Bilinear(source.data(), scale.SourceWidth, scale.SourceHeight, destination.data(), 1920, 1080);
+                s_Sink = s_Sink + destination[0];
+                return (uint64_t)destination.size();
+            });
+        }
+    }
+
+    static void RunDenoiseBenchmarks(BenchmarkRunner& runner)
+    {
+        struct Resolution
+        {
+            const char* Name;
+            uint32_t Width, Height;
+        };
+        const Resolution resolutions[] = { { "720p", 1280, 720 }, { "1080p", 1920, 1080 } };
+
+        for (const Resolution& resolution : resolutions)
+        {
+            // Noisy radiance on a ground plane below the camera and sky above the horizon, on one thread
+            Camera camera(45.0f, 0.1f, 100.0f);
+            camera.OnResize(resolution.Width, resolution.Height);
+
+            Framebuffer framebuffer;
+            framebuffer.Resize(resolution.Width, resolution.Height);
+            framebuffer.SetFeaturesEnabled(true);
+            framebuffer.ClearAccumulation();
+            uint32_t seed = 11;
+            for (uint32_t y = 0; y < resolution.Height; y++)
+            {
+                for (uint32_t x = 0; x < resolution.Width; x++)
+                {
+                    glm::vec3 radiance(Utils::FastRandom(seed), Utils::FastRandom(seed), Utils::FastRandom(seed));
+                    float luminance = Utils::Luminance(radiance);
+                    framebuffer.Accumulate(x, y, radiance, 1, luminance * luminance);
+
+                    glm::vec3 direction = camera.GetRayDirection((float)x + 0.5f, (float)y + 0.5f);
+                    if (direction.y < 0.0f)
+                        framebuffer.AccumulateFeatures(x, y, glm::vec3(0.8f), glm::vec3(0.0f, 1.0f, 0.0f), -1.0f / direction.y);
+                    else
+                        framebuffer.AccumulateFeatures(x, y, glm::vec3(1.0f), glm::vec3(0.0f), 0.0f);
+                }
+            }
+
+            Denoiser denoiser;
+            for (bool useSIMD : { false, true })
+            {
+                const DenoiseKernels::KernelSet& kernels = useSIMD ? DenoiseKernels::GetBest() : DenoiseKernels::Scalar;
+                if (useSIMD && &kernels == &DenoiseKernels::Scalar)
+                    continue;
+
+                runner.Run(std::string("Denoise/") + DenoiseKernels::GetName(kernels) + "/" + resolution.Name, [&]()
+                {
+                    denoiser.Denoise(framebuffer, camera, 0.5f, Denoiser::MaxIterations, useSIMD, nullptr);
+                    s_Sink = s_Sink + framebuffer.GetDenoisedBlock(0, 0).SampleCount[0];
+                    return (uint64_t)resolution.Width * resolution.Height;
+                });
+            }
+        }
+    }
+
+    static void RunIntersectionBenchmarks(BenchmarkRunner& runner)
+    {
+        const std::vector<Ray> rays = Utils::CreateRays(4096, 3);
+
+        std::vector<SphereKernels::IntersectFunc> kernels = { SphereKernels::IntersectScalar };
+        if (SphereKernels::GetBest() != SphereKernels::IntersectScalar)
+            kernels.push_back(SphereKernels::GetBest());
+
+        for (uint32_t sphereCount : { 1u, 10u, 100u, 1000u, 10000u, 100000u })
+        {
+            std::vector<std::string> linearNames, bvhNames, occludedNames;
+            bool anyEnabled = false;
+            for (SphereKernels::IntersectFunc kernel : kernels)
+            {
+                linearNames.push_back(std::string("Intersect/Linear/") + SphereKernels::GetName(kernel) + "/" + std::to_string(sphereCount));
+                bvhNames.push_back(std::string("Intersect/BVH/") + SphereKernels::GetName(kernel) + "/" + std::to_string(sphereCount));
+                occludedNames.push_back(std::string("Occluded/BVH/") + SphereKernels::GetName(kernel) + "/" + std::to_string(sphereCount));
+                anyEnabled |= runner.IsEnabled(linearNames.back()) || runner.IsEnabled(bvhNames.back()) || runner.IsEnabled(occludedNames.back());
+            }
+
+            // Building the big scenes takes a while, skip them when filtered out
+            if (!anyEnabled)
+                continue;
+
+            // The random scene adds a ground sphere, leave it out so the count is exact
+            Scene scene = Scenes::CreateRandomSpheres(sphereCount);
+            scene.Spheres.erase(scene.Spheres.begin());
+
+            // Testing every sphere is quadratic in the scene size, fewer rays keep the big scenes bearable
+            const uint32_t linearRayCount = glm::clamp(4096u * 100u / sphereCount, 16u, 4096u);
+
+            SphereSoA linearData;
+            linearData.Build(scene.Spheres);
+            for (size_t k = 0; k < kernels.size(); k++)
+            {
+                SphereKernels::IntersectFunc kernel = kernels[k];
+                runner.Run(linearNames[k], [&]()
+                {
+                    uint32_t hits = 0;
+                    for (uint32_t i = 0; i < linearRayCount; i++)
+                    {
+                        float hitDistance = std::numeric_limits<float>::max();
+                        hits += kernel(linearData, rays[i], 0, linearData.Count, hitDistance) >= 0;
+                    }
+                    s_Sink = s_Sink + hits;
+                    return (uint64_t)linearRayCount;
+                });
+            }
+
+            BVH bvh;
+            bvh.Build(scene.Spheres);
+            SphereSoA bvhData;
+            bvhData.Build(scene.Spheres, bvh.GetPrimitiveIndices());
+            for (size_t k = 0; k < kernels.size(); k++)
+            {
+                SphereKernels::IntersectFunc kernel = kernels[k];
+                runner.Run(bvhNames[k], [&]()
+                {
+                    uint32_t hits = 0;
+                    for (const Ray& ray : rays)
+                    {
+                        float hitDistance = std::numeric_limits<float>::max();
+                        hits += bvh.Intersect<false>(ray, bvhData, kernel, hitDistance) >= 0;
+                    }
+                    s_Sink = s_Sink + hits;
+                    return (uint64_t)rays.size();
+                });
+            }
+
+            // Shadow rays, the same rays only asking whether anything is hit
+            for (size_t k = 0; k < kernels.size(); k++)
+            {
+                SphereKernels::IntersectFunc kernel = kernels[k];
+                runner.Run(occludedNames[k], [&]()
+                {
+                    uint32_t hits = 0;
+                    for (const Ray& ray : rays)
+                        hits += bvh.Occluded<false>(ray, bvhData, kernel, std::numeric_limits<float>::max());
+                    s_Sink = s_Sink + hits;
+                    return (uint64_t)rays.size();
+                });
+            }
+        }
+    }
+
+    static void RunRenderBenchmarks(BenchmarkRunner& runner)
+    {
+        struct SceneConfig
+        {
+            const char* Name;
+            uint32_t SphereCount; // 0 = default scene
+        };
+
+        struct Resolution
+        {
+            uint32_t Width, Height;
+        };
+
+        const SceneConfig sceneConfigs[] = { { "Default", 0 }, { "Spheres1k", 1000 }, { "Spheres100k", 100000 } };
+        const Resolution resolutions[] = { { 640, 360 }, { 1920, 1080 } };
+        const uint32_t threadCounts[] = { 1, 0 };
+
+        for (const SceneConfig& sceneConfig : sceneConfigs)
+        {
+            Scene scene;
+            bool sceneCreated = false;
+
+            for (const Resolution& resolution : resolutions)
+            {
+                for (uint32_t threadCount : threadCounts)
+                {
+                    for (bool wavefront : { false, true })
+                    {
+                        // Items are rays, so ns/item compares across scenes and resolutions
+                        std::string name = std::string("Render/") + sceneConfig.Name + "/" + std::to_string(resolution.Width) + "x"
+                            + std::to_string(resolution.Height) + "/" + (threadCount ? std::to_string(threadCount) + "t" : "all") + (wavefront ? "/Wavefront" : "");
+                        if (!runner.IsEnabled(name))
+                            continue;
+
+                        if (!sceneCreated)
+                        {
+                            scene = sceneConfig.SphereCount ? Scenes::CreateRandomSpheres(sceneConfig.SphereCount) : Scenes::CreateDefault();
+                            sceneCreated = true;
+                        }
+
+                        Camera camera(45.0f, 0.1f, 1000.0f);
+                        camera.OnResize(resolution.Width, resolution.Height);
+
+                        Renderer renderer;
+                        renderer.GetSettings().ThreadCount = threadCount;
+                        renderer.GetSettings().Wavefront = wavefront;
+                        renderer.OnResize(resolution.Width, resolution.Height);
+
+                        runner.Run(name, [&]()
+                        {
+                            renderer.Render(scene, camera);
+                            return renderer.GetLastRayCount();
+                        });
+                    }
+                }
+            }
+        }
+    }
+
+    static int RunBenchmarks(const BenchmarkOptions& options)
+    {
+        BenchmarkRunner runner(options);
+        RunUtilsBenchmarks(runner);
+        RunResolveBenchmarks(runner);
+        RunUpscaleBenchmarks(runner);
+        RunDenoiseBenchmarks(runner);
+        RunIntersectionBenchmarks(runner);
+        RunRenderBenchmarks(runner);
+
+        if (!Utils::WriteJSON(options.OutputPath, runner.GetResults()))
+        {
+            fprintf(stderr, "Failed to write '%s'\n", options.OutputPath.c_str());
+            return 1;
+        }
+
+        printf("Wrote %zu results to %s\n", runner.GetResults().size(), options.OutputPath.c_str());
+        return 0;
+    }
+
+}
+
+int main(int argc, char** argv)
+{
+    RayTracing::BenchmarkOptions options;
+    if (!RayTracing::Utils::ParseArguments(argc, argv, options))
+    {
+        RayTracing::Utils::PrintUsage(argv[0]);
+        return 1;
+    }
+
+    return RayTracing::RunBenchmarks(options);
+}
\ No newline at end of file
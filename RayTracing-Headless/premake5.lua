@@ -0,0 +1,57 @@
+project "RayTracing-Headless"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++20"
+   targetdir "bin/%{cfg.buildcfg}"
+   staticruntime "off"
+
+   -- Core renderer only, no Walnut/Vulkan so it can run on machines without a GPU or display
+   files
+   {
+      "src/**.h",
+      "src/**.cpp",
+
+      "../RayTracing/src/**.h",
+      "../RayTracing/src/**.cpp"
+   }
+
+   removefiles { "../RayTracing/src/WalnutApp.cpp" }
+
+   includedirs
+   {
+      "../RayTracing/src",
+
+      "../Walnut/vendor/glm"
+   }
+
+   defines { "RT_HEADLESS" }
+
+   targetdir ("../bin/" .. outputdir .. "/%{prj.name}")
+   objdir ("../bin-int/" .. outputdir .. "/%{prj.name}")
+
+   filter "system:windows"
+      systemversion "latest"
+      buildoptions { "/utf-8" }
+      links { "Ws2_32" } -- Sockets for distributed rendering
+
+   filter "system:linux"
+      links { "pthread" }
+
+   -- The SIMD sphere kernels match the scalar one bit for bit only if the compiler doesn't fuse multiply-adds
+   filter "toolset:gcc or clang"
+      buildoptions { "-ffp-contract=off" }
+
+   filter "configurations:Debug"
+      runtime "Debug"
+      symbols "On"
+
+   filter "configurations:Release"
+      runtime "Release"
+      optimize "On"
+      symbols "On"
+
+   filter "configurations:Dist"
+      runtime "Release"
+      optimize "On"
+      symbols "Off"
+      defines { "RT_ENABLE_STATS=0" }
\ No newline at end of file
@@ -0,0 +1,563 @@
+#include "Camera.h"
+#include "Distributed.h"
+#include "MeshLoader.h"
+#include "SceneFile.h"
+#include "Renderer.h"
+#include "RenderThread.h"
+#include "Scenes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <string>
+
+namespace RayTracing {
+
+    struct HeadlessOptions
+    {
+        uint32_t Width = 1280;
+        uint32_t Height = 720;
+        uint32_t SamplesPerPixel = 1;
+        uint32_t ThreadCount = 0;
+        bool PinThreads = false;
+        bool Serial = false;
+        uint32_t FrameCount = 16;
+        uint32_t SphereCount = 0; // 0 = default scene
+        uint32_t InstanceCount = 0; // Instanced scene instead of random spheres when > 0
+        uint32_t PrototypeSphereCount = 1000;
+        std::string ScenePath; // Replaces the generated scene
+        std::string SaveScenePath; // Written after the mesh is added
+        std::string MeshPath; // Added to the scene
+        std::string SaveMeshPath; // Binary copy of the loaded mesh
+        bool UseBVH = true;
+        bool UseSIMD = true;
+        bool UsePackets = true;
+        bool Jitter = false;
+        SamplerType Sampler = SamplerType::Sobol;
+        uint32_t MaxDepth = 5;
+        bool RussianRoulette = true;
+        bool NextEventEstimation = true;
+        bool Wavefront = false;
+        PathSorting WavefrontSorting = PathSorting::None;
+        float AdaptiveThreshold = 0.0f; // 0 = adaptive sampling off
+        float FrameBudgetMs = 0.0f; // 0 = whole frame per Render call
+        ToneMapping ToneMap = ToneMapping::ACES;
+        float Exposure = 1.0f;
+        bool SRGB = true;
+        uint32_t DenoiseIterations = 0; // 0 = no denoising
+        std::string OutputPath = "output.ppm";
+        std::string StatsPath; // Empty = no counters
+        std::string ListenAddress; // Render on worker processes connecting here instead of locally
+        uint32_t MinWorkers = 1;
+        float TileTimeoutMs = 0.0f; // 0 = automatic
+        std::string WorkerAddress; // Run as a worker of the coordinator at this address
+    };
+
+    namespace Utils {
+
+        static void PrintUsage(const char* executable)
+        {
+            printf("Usage: %s [options]\n", executable);
+            printf("  --width <n>        Image width (default 1280)\n");
+            printf("  --height <n>       Image height (default 720)\n");
+            printf("  --spp <n>          Samples per pixel per frame (default 1)\n");
+            printf("  --threads <n>      Worker threads, 0 = one per hardware thread (default 0)\n");
+            printf("  --pin <0|1>        Pin worker threads to cores (default 0)\n");
+            printf("  --serial <0|1>     Render on the main thread without workers, ignores --threads (default 0)\n");
+            printf("  --frames <n>       Accumulated frames to render (default 16)\n");
+            printf("  --spheres <n>      Render <n> random spheres instead of the default scene\n");
+            printf("  --instances <n>    Render <n> instances of sphere clusters instead of the default scene\n");
+            printf("  --prototype-spheres <n> Spheres per instanced cluster (default 1000)\n");
+            printf("  --scene <path>     Load a .rtscene file instead of generating the scene\n");
+            printf("  --save-scene <path> Save the scene, with its BVH, as .rtscene\n");
+            printf("  --mesh <path>      Add an OBJ or .rtmesh triangle mesh to the scene\n");
+            printf("  --save-mesh <path> Save the loaded mesh as .rtmesh, which loads much faster than OBJ\n");
+            printf("  --bvh <0|1>        Use the BVH or test every sphere (default 1)\n");
+            printf("  --simd <0|1>       Use the widest SIMD sphere kernel or the scalar one (default 1)\n");
+            printf("  --packets <0|1>    Trace camera rays in packets of eight (default 1)\n");
+            printf("  --jitter <0|1>     Jitter camera rays inside the pixel for anti-aliasing (default 0)\n");
+            printf("  --sampler <name>   Random numbers: independent or sobol (default sobol)\n");
+            printf("  --depth <n>        Maximum bounces per path (default 5)\n");
+            printf("  --roulette <0|1>   End low-throughput paths early with Russian roulette (default 1)\n");
+            printf("  --nee <0|1>        Sample emissive spheres directly with shadow rays (default 1)\n");
+            printf("  --wavefront <0|1>  Trace tiles stage by stage over queues of paths (default 0)\n");
+            printf("  --path-sort <name> Wavefront path order: none, material or direction (default none)\n");
+            printf("  --adaptive <err>   Stop sampling pixels below this relative error, 0 = off (default 0)\n");
+            printf("  --budget <ms>      Time budget per Render call, frames then span several calls, 0 = off (default 0)\n");
+            printf("  --tonemap <name>   Tone mapping: clamp, reinhard or aces (default aces)\n");
+            printf("  --exposure <x>     Radiance scale before tone mapping (default 1)\n");
+            printf("  --srgb <0|1>       Encode the image for an sRGB display (default 1)\n");
+            printf("  --denoise <n>      Denoise with <n> filter iterations, at most 5, 0 = off (default 0)\n");
+            printf("  --output <path>    Output image, binary PPM (default output.ppm)\n");
+            printf("  --stats <path>     Write the render counters of every Render call as JSON\n");
+            printf("  --listen <address> Render on worker processes connecting to unix:<path> or <host>:<port>\n");
+            printf("  --workers <n>      Workers to wait for before rendering with --listen, more can join later (default 1)\n");
+            printf("  --tile-timeout <ms> Give units a worker sat on this long to others, 0 = automatic (default 0)\n");
+            printf("  --worker <address> Run as a worker of the coordinator at <address>, with --threads and --pin\n");
+        }
+
+        static bool ParseArguments(int argc, char** argv, HeadlessOptions& options)
+        {
+            for (int i = 1; i < argc; i++)
+            {
+                const char* arg = argv[i];
+                if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+                    return false;
+
+                if (i + 1 >= argc)
+                {
+                    fprintf(stderr, "Missing value for '%s'\n", arg);
+                    return false;
+                }
+
+                const char* value = argv[++i];
+                if (strcmp(arg, "--width") == 0)
+                    options.Width = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--height") == 0)
+                    options.Height = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--spp") == 0)
+                    options.SamplesPerPixel = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--threads") == 0)
+                    options.ThreadCount = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--pin") == 0)
+                    options.PinThreads = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--serial") == 0)
+                    options.Serial = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--frames") == 0)
+                    options.FrameCount = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--spheres") == 0)
+                    options.SphereCount = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--instances") == 0)
+                    options.InstanceCount = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--prototype-spheres") == 0)
+                    options.PrototypeSphereCount = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--scene") == 0)
+                    options.ScenePath = value;
+                else if (strcmp(arg, "--save-scene") == 0)
+                    options.SaveScenePath = value;
+                else if (strcmp(arg, "--mesh") == 0)
+                    options.MeshPath = value;
+                else if (strcmp(arg, "--save-mesh") == 0)
+                    options.SaveMeshPath = value;
+                else if (strcmp(arg, "--bvh") == 0)
+                    options.UseBVH = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--simd") == 0)
+                    options.UseSIMD = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--packets") == 0)
+                    options.UsePackets = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--adaptive") == 0)
+                    options.AdaptiveThreshold = strtof(value, nullptr);
+                else if (strcmp(arg, "--jitter") == 0)
+                    options.Jitter = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--sampler") == 0)
+                {
+                    if (strcmp(value, "independent") == 0)
+                        options.Sampler = SamplerType::Independent;
+                    else if (strcmp(value, "sobol") == 0)
+                        options.Sampler = SamplerType::Sobol;
+                    else
+                    {
+                        fprintf(stderr, "Unknown sampler '%s'\n", value);
+                        return false;
+                    }
+                }
+                else if (strcmp(arg, "--depth") == 0)
+                    options.MaxDepth = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--roulette") == 0)
+                    options.RussianRoulette = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--nee") == 0)
+                    options.NextEventEstimation = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--wavefront") == 0)
+                    options.Wavefront = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--path-sort") == 0)
+                {
+                    if (strcmp(value, "none") == 0)
+                        options.WavefrontSorting = PathSorting::None;
+                    else if (strcmp(value, "material") == 0)
+                        options.WavefrontSorting = PathSorting::Material;
+                    else if (strcmp(value, "direction") == 0)
+                        options.WavefrontSorting = PathSorting::Direction;
+                    else
+                    {
+                        fprintf(stderr, "Unknown path sorting '%s'\n", value);
+                        return false;
+                    }
+                }
+                else if (strcmp(arg, "--budget") == 0)
+                    options.FrameBudgetMs = strtof(value, nullptr);
+                else if (strcmp(arg, "--tonemap") == 0)
+                {
+                    if (strcmp(value, "clamp") == 0)
+                        options.ToneMap = ToneMapping::Clamp;
+                    else if (strcmp(value, "reinhard") == 0)
+                        options.ToneMap = ToneMapping::Reinhard;
+                    else if (strcmp(value, "aces") == 0)
+                        options.ToneMap = ToneMapping::ACES;
+                    else
+                    {
+                        fprintf(stderr, "Unknown tone mapping '%s'\n", value);
+                        return false;
+                    }
+                }
+                else if (strcmp(arg, "--exposure") == 0)
+                    options.Exposure = strtof(value, nullptr);
+                else if (strcmp(arg, "--srgb") == 0)
+                    options.SRGB = strtoul(value, nullptr, 10) != 0;
+                else if (strcmp(arg, "--denoise") == 0)
+                    options.DenoiseIterations = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--output") == 0)
+                    options.OutputPath = value;
+                else if (strcmp(arg, "--stats") == 0)
+                    options.StatsPath = value;
+                else if (strcmp(arg, "--listen") == 0)
+                    options.ListenAddress = value;
+                else if (strcmp(arg, "--workers") == 0)
+                    options.MinWorkers = (uint32_t)strtoul(value, nullptr, 10);
+                else if (strcmp(arg, "--tile-timeout") == 0)
+                    options.TileTimeoutMs = strtof(value, nullptr);
+                else if (strcmp(arg, "--worker") == 0)
+                    options.WorkerAddress = value;
+                else
+                {
+                    fprintf(stderr, "Unknown option '%s'\n", arg);
+                    return false;
+                }
+            }
+
+            if (!options.Width || !options.Height || !options.SamplesPerPixel || !options.FrameCount || !options.MaxDepth)
+            {
+                fprintf(stderr, "Width, height, spp, frames and depth must be greater than zero\n");
+                return false;
+            }
+
+            // Workers don't gather the features the denoiser needs
+            if (!options.ListenAddress.empty() && options.DenoiseIterations > 0)
+            {
+                fprintf(stderr, "--denoise can't be combined with --listen\n");
+                return false;
+            }
+
+            return true;
+        }
+
+        static void WriteStatsJSON(FILE* file, uint32_t frame, const RenderStats& stats)
+        {
+            fprintf(file, "    { \"frame\": %u, \"primary_rays\": %llu, \"secondary_rays\": %llu, \"shadow_rays\": %llu, \"sphere_tests\": %llu, \"triangle_tests\": %llu, \"hits\": %llu, \"misses\": %llu,\n",
+                frame, (unsigned long long)stats.PrimaryRays, (unsigned long long)stats.SecondaryRays, (unsigned long long)stats.ShadowRays, (unsigned long long)stats.SphereTests, (unsigned long long)stats.TriangleTests,
+                (unsigned long long)stats.Hits, (unsigned long long)stats.Misses);
+
+            fprintf(file, "      \"path_lengths\": [");
+            for (uint32_t i = 0; i < RenderStats::PathLengthBins; i++)
+                fprintf(file, i ? ", %llu" : "%llu", (unsigned long long)stats.PathLengths[i]);
+            fprintf(file, "],\n");
+
+            fprintf(file, "      \"stage_ms\": {");
+            for (uint32_t stage = 0; stage < RenderStats::StageCount; stage++)
+                fprintf(file, "%s\"%s\": %.4f", stage ? ", " : " ", RenderStats::GetStageName(stage), stats.StageMs[stage]);
+            fprintf(file, " } }");
+        }
+
+        // Row major RGBA8 as the framebuffer stores it
+        static bool WritePPM(const std::string& path, const uint32_t* imageData, uint32_t width, uint32_t height)
+        {
+            FILE* file = fopen(path.c_str(), "wb");
+            if (!file)
+                return false;
+
+            fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+            // Row 0 is the bottom of the image (the viewport flips it on display), PPM starts at the top
+            std::string row(width * 3, '\0');
+            for (uint32_t y = height; y-- > 0;)
+            {
+                const uint32_t* pixels = imageData + y * width;
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    row[x * 3 + 0] = (char)(pixels[x] & 0xff);
+                    row[x * 3 + 1] = (char)((pixels[x] >> 8) & 0xff);
+                    row[x * 3 + 2] = (char)((pixels[x] >> 16) & 0xff);
+                }
+                fwrite(row.data(), 1, row.size(), file);
+            }
+
+            return fclose(file) == 0;
+        }
+
+    }
+
+    // Renders all frames on the workers that connect and writes the merged image
+    static int RunCoordinator(const HeadlessOptions& options, const Scene& scene, const Camera& camera, const Renderer::Settings& settings)
+    {
+        Distributed::Coordinator coordinator;
+        coordinator.GetSettings().MinWorkers = std::max(options.MinWorkers, 1u);
+        coordinator.GetSettings().TimeoutMs = options.TileTimeoutMs;
+
+        std::string error;
+        if (!coordinator.Listen(options.ListenAddress, &error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        printf("Listening on %s, waiting for %u workers\n", options.ListenAddress.c_str(), coordinator.GetSettings().MinWorkers);
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        Framebuffer framebuffer;
+        if (!coordinator.Render(scene, camera, settings, options.Width, options.Height, options.FrameCount, framebuffer, &error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        // Ray rates per worker are over its own render time, the total over the wall time from the first worker on
+        uint64_t totalRays = 0;
+        std::vector<Distributed::Coordinator::WorkerStats> workers = coordinator.GetWorkerStats();
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            const Distributed::Coordinator::WorkerStats& worker = workers[i];
+            printf("Worker %2zu: %3u threads  %5u units  %9.3fms  %8.2f Mrays/s  %u timeouts%s\n", i, worker.ThreadCount, worker.UnitCount,
+                worker.RenderMs, worker.RenderMs > 0.0 ? (double)worker.RayCount / (worker.RenderMs * 1000.0) : 0.0, worker.TimeoutCount,
+                worker.Connected ? "" : "  disconnected");
+            totalRays += worker.RayCount;
+        }
+
+        printf("Total: %.3fms, average %.3fms/frame, %.2f Mrays/s, %u units reissued\n",
+            millis, millis / options.FrameCount, (double)totalRays / (millis * 1000.0), coordinator.GetReissuedUnitCount());
+
+        const ResolveSettings resolveSettings = { settings.ToneMap, settings.Exposure, settings.SRGB };
+        const ResolveKernels::ResolveFunc resolve = settings.UseSIMD ? ResolveKernels::GetBest() : ResolveKernels::ResolveScalar;
+        resolve(framebuffer, 0, 0, options.Width, options.Height, resolveSettings);
+
+        if (!Utils::WritePPM(options.OutputPath, framebuffer.GetImageData(), options.Width, options.Height))
+        {
+            fprintf(stderr, "Failed to write '%s'\n", options.OutputPath.c_str());
+            return 1;
+        }
+
+        printf("Wrote %s\n", options.OutputPath.c_str());
+        return 0;
+    }
+
+    static int RunHeadless(const HeadlessOptions& options)
+    {
+        // A worker gets everything else from its coordinator
+        if (!options.WorkerAddress.empty())
+        {
+            std::string error;
+            if (!Distributed::RunWorker(options.WorkerAddress, options.ThreadCount, options.PinThreads, &error))
+            {
+                fprintf(stderr, "Worker failed: %s\n", error.c_str());
+                return 1;
+            }
+            return 0;
+        }
+
+        Scene scene;
+        BVH sphereBVH;
+        if (!options.ScenePath.empty())
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+
+            std::string error;
+            if (!SceneFile::Load(options.ScenePath, scene, &sphereBVH, &error))
+            {
+                fprintf(stderr, "Failed to load '%s': %s\n", options.ScenePath.c_str(), error.c_str());
+                return 1;
+            }
+
+            double millis = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            printf("Loaded %s: %zu spheres, %zu meshes, %zu BVH nodes in %.3fms\n", options.ScenePath.c_str(), scene.Spheres.size(), scene.Meshes.size(), sphereBVH.GetNodes().size(), millis);
+        }
+        else
+        {
+            if (options.InstanceCount)
+                scene = Scenes::CreateInstancedSpheres(options.InstanceCount, options.PrototypeSphereCount);
+            else
+                scene = options.SphereCount ? Scenes::CreateRandomSpheres(options.SphereCount) : Scenes::CreateDefault();
+        }
+
+        if (!options.MeshPath.empty())
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+
+            Mesh mesh;
+            std::string error;
+            if (!MeshLoader::Load(options.MeshPath, mesh, &error))
+            {
+                fprintf(stderr, "Failed to load '%s': %s\n", options.MeshPath.c_str(), error.c_str());
+                return 1;
+            }
+
+            double millis = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            printf("Loaded %s: %zu vertices, %u triangles in %.3fms\n", options.MeshPath.c_str(), mesh.Positions.size(), mesh.GetTriangleCount(), millis);
+
+            if (!options.SaveMeshPath.empty())
+            {
+                if (!MeshLoader::SaveBinary(options.SaveMeshPath, mesh))
+                {
+                    fprintf(stderr, "Failed to write '%s'\n", options.SaveMeshPath.c_str());
+                    return 1;
+                }
+                printf("Wrote %s\n", options.SaveMeshPath.c_str());
+            }
+
+            Scenes::AddMesh(scene, std::move(mesh));
+        }
+
+        if (!options.SaveScenePath.empty())
+        {
+            if (!SceneFile::Save(options.SaveScenePath, scene))
+            {
+                fprintf(stderr, "Failed to write '%s'\n", options.SaveScenePath.c_str());
+                return 1;
+            }
+            printf("Wrote %s\n", options.SaveScenePath.c_str());
+        }
+
+        Camera camera(45.0f, 0.1f, 1000.0f);
+        camera.OnResize(options.Width, options.Height);
+
+        Renderer::Settings settings;
+        settings.SamplesPerPixel = options.SamplesPerPixel;
+        settings.ThreadCount = options.ThreadCount;
+        settings.PinThreads = options.PinThreads;
+        settings.Serial = options.Serial;
+        settings.CollectStats = !options.StatsPath.empty();
+        settings.UseBVH = options.UseBVH;
+        settings.UseSIMD = options.UseSIMD;
+        settings.PrimaryRayPackets = options.UsePackets;
+        settings.AdaptiveSampling = options.AdaptiveThreshold > 0.0f;
+        settings.AdaptiveThreshold = options.AdaptiveThreshold;
+        settings.JitterPrimaryRays = options.Jitter;
+        settings.Sampler = options.Sampler;
+        settings.MaxDepth = options.MaxDepth;
+        settings.RussianRoulette = options.RussianRoulette;
+        settings.NextEventEstimation = options.NextEventEstimation;
+        settings.Wavefront = options.Wavefront;
+        settings.WavefrontSorting = options.WavefrontSorting;
+        settings.FrameBudgetMs = options.FrameBudgetMs;
+        settings.ToneMap = options.ToneMap;
+        settings.Exposure = options.Exposure;
+        settings.SRGB = options.SRGB;
+        settings.Denoise = options.DenoiseIterations > 0;
+        settings.DenoiseIterations = options.DenoiseIterations;
+
+        if (!scene.Instances.empty())
+        {
+            uint64_t prototypeSpheres = 0, instancedSpheres = 0;
+            for (const Prototype& prototype : scene.Prototypes)
+                prototypeSpheres += prototype.Spheres.size();
+            for (const Instance& instance : scene.Instances)
+                instancedSpheres += instance.PrototypeIndex < scene.Prototypes.size() ? scene.Prototypes[instance.PrototypeIndex].Spheres.size() : 0;
+            printf("Instancing %llu prototype spheres %zu times, %llu effective spheres\n",
+                (unsigned long long)prototypeSpheres, scene.Instances.size(), (unsigned long long)instancedSpheres);
+        }
+
+        printf("Rendering %ux%u, %u spp, %u frames, %zu spheres, %s, %s sphere kernel, %s resolve kernel\n",
+            options.Width, options.Height, options.SamplesPerPixel, options.FrameCount, scene.Spheres.size(),
+            options.UseBVH ? "BVH" : "no BVH", SphereKernels::GetName(options.UseSIMD ? SphereKernels::GetBest() : SphereKernels::IntersectScalar),
+            ResolveKernels::GetName(options.UseSIMD ? ResolveKernels::GetBest() : ResolveKernels::ResolveScalar));
+
+        if (!options.ListenAddress.empty())
+            return RunCoordinator(options, scene, camera, settings);
+
+        FILE* statsFile = nullptr;
+        if (!options.StatsPath.empty())
+        {
+#if RT_ENABLE_STATS
+            statsFile = fopen(options.StatsPath.c_str(), "w");
+            if (!statsFile)
+            {
+                fprintf(stderr, "Failed to write '%s'\n", options.StatsPath.c_str());
+                return 1;
+            }
+            fprintf(statsFile, "{\n  \"frames\": [\n");
+#else
+            fprintf(stderr, "Built with RT_ENABLE_STATS=0, ignoring --stats\n");
+#endif
+        }
+
+        // The same pipeline as the app, minus the window. Every Render call's frame is taken, none are dropped,
+        // and the render thread idles once the last frame is accumulated
+        RenderThread renderThread(false);
+        renderThread.SetFrameLimit(options.FrameCount);
+        renderThread.SubmitSettings(settings);
+        renderThread.SubmitCamera(camera, options.Width, options.Height);
+        renderThread.SubmitScene(std::move(scene), std::move(sphereBVH));
+
+        double totalMillis = 0.0;
+        uint64_t totalRays = 0;
+        uint32_t callCount = 0;
+        // With a frame budget one frame can take several calls, the frame index only advances once all tiles are done
+        uint32_t frameIndex = 1;
+        const RenderThread::Frame* frame = nullptr;
+        while (frameIndex <= options.FrameCount)
+        {
+            frame = renderThread.WaitForFrame();
+
+            double millis = frame->RenderMs;
+            uint64_t rays = frame->RayCount;
+            totalMillis += millis;
+            totalRays += rays;
+            callCount++;
+
+            // Slowest tile against the average one, 1.0 means perfectly even work
+            const std::vector<float>& tileTimes = frame->TileTimes;
+            float maxTileTime = *std::max_element(tileTimes.begin(), tileTimes.end());
+            float averageTileTime = std::accumulate(tileTimes.begin(), tileTimes.end(), 0.0f) / (float)tileTimes.size();
+
+            float activePixels = 100.0f * frame->ActivePixelCount / (float)(options.Width * options.Height);
+
+            printf("Frame %3u: %9.3fms  %8.2f Mrays/s  tiles max/avg %.3f/%.3fms  active %5.1f%%",
+                frameIndex, millis, (double)rays / (millis * 1000.0), maxTileTime, averageTileTime, activePixels);
+            if (options.FrameBudgetMs > 0.0f)
+                printf("  done %5.1f%%", 100.0f * frame->PassProgress);
+            printf("\n");
+
+            if (statsFile)
+            {
+                fprintf(statsFile, callCount > 1 ? ",\n" : "");
+                Utils::WriteStatsJSON(statsFile, frameIndex, frame->Stats);
+            }
+
+            frameIndex = frame->FrameIndex;
+        }
+
+        if (statsFile)
+        {
+            fprintf(statsFile, "\n  ]\n}\n");
+            fclose(statsFile);
+            printf("Wrote %s\n", options.StatsPath.c_str());
+        }
+
+        printf("Total: %.3fms, average %.3fms/frame, %.2f Mrays/s, %u Render calls\n",
+            totalMillis, totalMillis / options.FrameCount, (double)totalRays / (totalMillis * 1000.0), callCount);
+
+        if (!Utils::WritePPM(options.OutputPath, frame->ImageData.data(), frame->Width, frame->Height))
+        {
+            fprintf(stderr, "Failed to write '%s'\n", options.OutputPath.c_str());
+            return 1;
+        }
+
+        printf("Wrote %s\n", options.OutputPath.c_str());
+        return 0;
+    }
+
+}
+
+int main(int argc, char** argv)
+{
+    RayTracing::HeadlessOptions options;
+    if (!RayTracing::Utils::ParseArguments(argc, argv, options))
+    {
+        RayTracing::Utils::PrintUsage(argv[0]);
+        return 1;
+    }
+
+    return RayTracing::RunHeadless(options);
+}
\ No newline at end of file
@@ -31,6 +31,11 @@ project "RayTracing"
       systemversion "latest"
       defines { "WL_PLATFORM_WINDOWS" }
       buildoptions { "/utf-8" }
+      links { "Ws2_32" } -- Sockets for distributed rendering
+
+   -- The SIMD sphere kernels match the scalar one bit for bit only if the compiler doesn't fuse multiply-adds
+   filter "toolset:gcc or clang"
+      buildoptions { "-ffp-contract=off" }
 
    filter "configurations:Debug"
       defines { "WL_DEBUG" }
@@ -45,7 +50,7 @@ project "RayTracing"
 
    filter "configurations:Dist"
       kind "WindowedApp"
-      defines { "WL_DIST" }
+      defines { "WL_DIST", "RT_ENABLE_STATS=0" }
       runtime "Release"
       optimize "On"
       symbols "Off"
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace RayTracing {
+
+    // Cache line aligned storage for trivially copyable T that reallocates only to grow, so resizing a window back
+    // and forth doesn't churn the allocator. Growing discards the contents
+    template<typename T>
+    class AlignedBuffer
+    {
+    public:
+        static constexpr size_t Alignment = 64;
+
+        AlignedBuffer() = default;
+        ~AlignedBuffer() { Free(); }
+
+        AlignedBuffer(const AlignedBuffer&) = delete;
+        AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+        // Returns true if the buffer was reallocated
+        bool Reserve(size_t count)
+        {
+            if (count <= m_Capacity)
+                return false;
+
+            // Some headroom, a window dragged larger grows a little every frame
+            count = count > m_Capacity + m_Capacity / 2 ? count : m_Capacity + m_Capacity / 2;
+
+            Free();
+            m_Data = (T*)::operator new(count * sizeof(T), std::align_val_t(Alignment));
+            m_Capacity = count;
+            return true;
+        }
+
+        void Swap(AlignedBuffer& other)
+        {
+            std::swap(m_Data, other.m_Data);
+            std::swap(m_Capacity, other.m_Capacity);
+        }
+
+        T* GetData() { return m_Data; }
+        const T* GetData() const { return m_Data; }
+        size_t GetCapacity() const { return m_Capacity; }
+    private:
+        void Free()
+        {
+            if (m_Data)
+                ::operator delete(m_Data, std::align_val_t(Alignment));
+            m_Data = nullptr;
+            m_Capacity = 0;
+        }
+    private:
+        T* m_Data = nullptr;
+        size_t m_Capacity = 0;
+    };
+
+}
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include "BVH.h"
+
+#include "RenderStats.h"
+
+#include <algorithm>
+
+namespace RayTracing {
+
+    namespace Utils {
+
+        static constexpr int BinCount = 16;
+
+        static AABB SphereBounds(const Sphere& sphere)
+        {
+            float radius = glm::abs(sphere.Radius);
+            return { sphere.Position - radius, sphere.Position + radius };
+        }
+
+    }
+
+    void BVH::Build(const std::vector<Sphere>& spheres)
+    {
+        std::vector<AABB> bounds(spheres.size());
+        std::vector<glm::vec3> centroids(spheres.size());
+        for (size_t i = 0; i < spheres.size(); i++)
+        {
+            bounds[i] = Utils::SphereBounds(spheres[i]);
+            centroids[i] = spheres[i].Position;
+        }
+
+        Build(bounds, centroids);
+    }
+
+    void BVH::Build(const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centroids)
+    {
+        Clear();
+        if (bounds.empty())
+            return;
+
+        const uint32_t count = (uint32_t)bounds.size();
+        m_PrimitiveIndices.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+            m_PrimitiveIndices[i] = i;
+
+        // A binary tree with N leaves never has more than 2N - 1 nodes
+        m_Nodes.reserve(count * 2 - 1);
+
+        BVHNode& root = m_Nodes.emplace_back();
+        root.LeftFirst = 0;
+        root.PrimitiveCount = count;
+
+        UpdateBounds(0, bounds);
+        Subdivide(0, 0, bounds, centroids);
+
+        m_Nodes.shrink_to_fit();
+    }
+
+    void BVH::Clear()
+    {
+        m_Nodes.clear();
+        m_PrimitiveIndices.clear();
+        m_Parents.clear();
+        m_SlotLeaves.clear();
+    }
+
+    void BVH::PrepareRefit()
+    {
+        if (m_Parents.size() == m_Nodes.size())
+            return;
+
+        m_Parents.assign(m_Nodes.size(), 0);
+        m_SlotLeaves.assign(m_PrimitiveIndices.size(), 0);
+        for (uint32_t i = 0; i < (uint32_t)m_Nodes.size(); i++)
+        {
+            const BVHNode& node = m_Nodes[i];
+            if (node.IsLeaf())
+            {
+                for (uint32_t slot = node.LeftFirst; slot < node.LeftFirst + node.PrimitiveCount; slot++)
+                    m_SlotLeaves[slot] = i;
+            }
+            else
+            {
+                m_Parents[node.LeftFirst] = i;
+                m_Parents[node.LeftFirst + 1] = i;
+            }
+        }
+    }
+
+    bool BVH::Assign(std::vector<BVHNode> nodes, uint32_t primitiveCount)
+    {
+        Clear();
+        if (nodes.empty())
+            return primitiveCount == 0;
+
+        // Children are always stored after their parent, so one forward pass sees every parent first. That
+        // rules out cycles and bounds the depth, which the traversal stack relies on
+        std::vector<uint32_t> depths(nodes.size(), 0);
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            const BVHNode& node = nodes[i];
+            if (node.IsLeaf())
+            {
+                if ((uint64_t)node.LeftFirst + node.PrimitiveCount > primitiveCount)
+                    return false;
+                continue;
+            }
+
+            if (node.LeftFirst <= i || (uint64_t)node.LeftFirst + 1 >= nodes.size() || depths[i] + 1 >= MaxDepth)
+                return false;
+            for (uint32_t child = node.LeftFirst; child <= node.LeftFirst + 1; child++)
+                depths[child] = std::max(depths[child], depths[i] + 1);
+        }
+
+        m_Nodes = std::move(nodes);
+        m_PrimitiveIndices.resize(primitiveCount);
+        for (uint32_t i = 0; i < primitiveCount; i++)
+            m_PrimitiveIndices[i] = i;
+        return true;
+    }
+
+    void BVH::UpdateBounds(uint32_t nodeIndex, const std::vector<AABB>& bounds)
+    {
+        BVHNode& node = m_Nodes[nodeIndex];
+
+        AABB nodeBounds;
+        for (uint32_t i = 0; i < node.PrimitiveCount; i++)
+            nodeBounds.Grow(bounds[m_PrimitiveIndices[node.LeftFirst + i]]);
+
+        node.Min = nodeBounds.Min;
+        node.Max = nodeBounds.Max;
+    }
+
+    float BVH::FindBestSplit(const BVHNode& node, const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centroids, int& axis, float& splitPosition) const
+    {
+        struct Bin
+        {
+            AABB Bounds;
+            uint32_t Count = 0;
+        };
+
+        AABB centroidBounds;
+        for (uint32_t i = 0; i < node.PrimitiveCount; i++)
+            centroidBounds.Grow(centroids[m_PrimitiveIndices[node.LeftFirst + i]]);
+
+        float bestCost = std::numeric_limits<float>::max();
+        for (int a = 0; a < 3; a++)
+        {
+            float boundsMin = centroidBounds.Min[a];
+            float boundsMax = centroidBounds.Max[a];
+            if (boundsMin == boundsMax)
+                continue;
+
+            Bin bins[Utils::BinCount];
+            float scale = Utils::BinCount / (boundsMax - boundsMin);
+            for (uint32_t i = 0; i < node.PrimitiveCount; i++)
+            {
+                uint32_t primitiveIndex = m_PrimitiveIndices[node.LeftFirst + i];
+                int binIndex = glm::min(Utils::BinCount - 1, (int)((centroids[primitiveIndex][a] - boundsMin) * scale));
+                bins[binIndex].Count++;
+                bins[binIndex].Bounds.Grow(bounds[primitiveIndex]);
+            }
+
+            // Sweep from both sides to get the area and count on either side of every bin plane
+            float leftArea[Utils::BinCount - 1], rightArea[Utils::BinCount - 1];
+            uint32_t leftCount[Utils::BinCount - 1], rightCount[Utils::BinCount - 1];
+            AABB leftBounds, rightBounds;
+            uint32_t leftSum = 0, rightSum = 0;
+            for (int i = 0; i < Utils::BinCount - 1; i++)
+            {
+                leftSum += bins[i].Count;
+                leftCount[i] = leftSum;
+                leftBounds.Grow(bins[i].Bounds);
+                leftArea[i] = leftBounds.SurfaceArea();
+
+                rightSum += bins[Utils::BinCount - 1 - i].Count;
+                rightCount[Utils::BinCount - 2 - i] = rightSum;
+                rightBounds.Grow(bins[Utils::BinCount - 1 - i].Bounds);
+                rightArea[Utils::BinCount - 2 - i] = rightBounds.SurfaceArea();
+            }
+
+            for (int i = 0; i < Utils::BinCount - 1; i++)
+            {
+                if (!leftCount[i] || !rightCount[i])
+                    continue;
+
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    axis = a;
+                    splitPosition = boundsMin + (i + 1) / scale;
+                }
+            }
+        }
+
+        return bestCost;
+    }
+
+    void BVH::Subdivide(uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centroids)
+    {
+        BVHNode& node = m_Nodes[nodeIndex];
+        if (node.PrimitiveCount <= 1 || depth + 1 >= MaxDepth)
+            return;
+
+        int axis = 0;
+        float splitPosition = 0.0f;
+        float splitCost = FindBestSplit(node, bounds, centroids, axis, splitPosition);
+        if (splitCost == std::numeric_limits<float>::max())
+            return; // All centroids coincide, nothing to split on
+
+        float leafCost = node.PrimitiveCount * AABB{ node.Min, node.Max }.SurfaceArea();
+        if (splitCost >= leafCost && node.PrimitiveCount <= MaxLeafSize)
+            return;
+
+        uint32_t* first = m_PrimitiveIndices.data() + node.LeftFirst;
+        uint32_t* last = first + node.PrimitiveCount;
+        uint32_t* middle = std::partition(first, last, [&](uint32_t index)
+        {
+            return centroids[index][axis] < splitPosition;
+        });
+
+        uint32_t leftCount = (uint32_t)(middle - first);
+        if (leftCount == 0 || leftCount == node.PrimitiveCount)
+            return;
+
+        uint32_t leftChildIndex = (uint32_t)m_Nodes.size();
+        BVHNode& leftChild = m_Nodes.emplace_back();
+        leftChild.LeftFirst = node.LeftFirst;
+        leftChild.PrimitiveCount = leftCount;
+
+        BVHNode& rightChild = m_Nodes.emplace_back();
+        rightChild.LeftFirst = node.LeftFirst + leftCount;
+        rightChild.PrimitiveCount = node.PrimitiveCount - leftCount;
+
+        node.LeftFirst = leftChildIndex;
+        node.PrimitiveCount = 0;
+
+        UpdateBounds(leftChildIndex, bounds);
+        UpdateBounds(leftChildIndex + 1, bounds);
+        Subdivide(leftChildIndex, depth + 1, bounds, centroids);
+        Subdivide(leftChildIndex + 1, depth + 1, bounds, centroids);
+    }
+
+    template<bool Stats>
+    int BVH::Intersect(const Ray& ray, const SphereSoA& spheres, SphereKernels::IntersectFunc intersect, float& hitDistance) const
+    {
+        int closestSlot = -1;
+        Traverse(ray, hitDistance, [&](uint32_t first, uint32_t count)
+        {
+            int slot = intersect(spheres, ray, first, count, hitDistance);
+            RT_STATS_ADD_IF(Stats, SphereTests, count);
+            if (slot >= 0)
+                closestSlot = slot;
+        });
+        return closestSlot;
+    }
+
+    template<bool Stats>
+    bool BVH::Occluded(const Ray& ray, const SphereSoA& spheres, SphereKernels::IntersectFunc intersect, float maxDistance) const
+    {
+        return TraverseAny(ray, maxDistance, [&](uint32_t first, uint32_t count)
+        {
+            float hitDistance = maxDistance;
+            RT_STATS_ADD_IF(Stats, SphereTests, count);
+            return intersect(spheres, ray, first, count, hitDistance) >= 0;
+        });
+    }
+
+    template int BVH::Intersect<false>(const Ray&, const SphereSoA&, SphereKernels::IntersectFunc, float&) const;
+    template int BVH::Intersect<true>(const Ray&, const SphereSoA&, SphereKernels::IntersectFunc, float&) const;
+    template bool BVH::Occluded<false>(const Ray&, const SphereSoA&, SphereKernels::IntersectFunc, float) const;
+    template bool BVH::Occluded<true>(const Ray&, const SphereSoA&, SphereKernels::IntersectFunc, float) const;
+
+}
\ No newline at end of file
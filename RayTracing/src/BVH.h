@@ -0,0 +1,243 @@
+#pragma once
+
+#include "Intersection.h"
+#include "Ray.h"
+#include "Scene.h"
+#include "SphereKernels.h"
+
+#include <glm/glm.hpp>
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace RayTracing {
+
+    struct AABB
+    {
+        glm::vec3 Min{ std::numeric_limits<float>::max() };
+        glm::vec3 Max{ -std::numeric_limits<float>::max() };
+
+        void Grow(const glm::vec3& point) { Min = glm::min(Min, point); Max = glm::max(Max, point); }
+        void Grow(const AABB& other) { Min = glm::min(Min, other.Min); Max = glm::max(Max, other.Max); }
+
+        float SurfaceArea() const
+        {
+            glm::vec3 extent = Max - Min;
+            return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+        }
+    };
+
+    // 32 bytes so two nodes share a cache line. The children of an interior node are
+    // stored next to each other, so only the left index is kept.
+    struct BVHNode
+    {
+        glm::vec3 Min;
+        uint32_t LeftFirst; // Left child for interior nodes, first primitive for leaves
+        glm::vec3 Max;
+        uint32_t PrimitiveCount; // 0 for interior nodes
+
+        bool IsLeaf() const { return PrimitiveCount > 0; }
+    };
+
+    // Bounding volume hierarchy over spheres or triangles, built with the binned surface area heuristic
+    class BVH
+    {
+    public:
+        static constexpr uint32_t MaxDepth = 64;
+        static constexpr uint32_t MaxLeafSize = 8;
+
+        void Build(const std::vector<Sphere>& spheres);
+        // Any primitive type, splits are chosen on the centroids
+        void Build(const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centroids);
+        void Clear();
+        // Takes over nodes built earlier, e.g. loaded from a scene file, over primitives that are stored in leaf
+        // order so the primitive indices are the identity. Returns false and stays empty if the tree is malformed
+        bool Assign(std::vector<BVHNode> nodes, uint32_t primitiveCount);
+
+        // Visits the leaves the ray reaches before hitDistance, nearest first. intersectLeaf(first, count) tests
+        // the primitives [first, first + count) in GetPrimitiveIndices() order and shrinks hitDistance on a hit
+        template<typename LeafFunc>
+        void Traverse(const Ray& ray, float& hitDistance, LeafFunc&& intersectLeaf) const;
+
+        // Visits the leaves the ray reaches before maxDistance, nearest first, until intersectLeaf(first, count)
+        // returns true for a leaf that holds a hit. Returns whether one did
+        template<typename LeafFunc>
+        bool TraverseAny(const Ray& ray, float maxDistance, LeafFunc&& intersectLeaf) const;
+
+        // Recomputes the bounds of the leaves holding the given slots and of their ancestors after those primitives
+        // changed, getBounds(slot) returns a slot's current AABB. The tree keeps its shape, so it gets slower to
+        // traverse the further primitives move from where it was built
+        template<typename BoundsFunc>
+        void Refit(const std::vector<uint32_t>& slots, BoundsFunc&& getBounds);
+
+        // Closest hit closer than hitDistance. Leaves are tested with the given kernel against a SphereSoA
+        // built in GetPrimitiveIndices() order. Returns the SoA slot and shrinks hitDistance, or -1 on miss.
+        // Stats = count the sphere tests into t_RenderStats
+        template<bool Stats>
+        int Intersect(const Ray& ray, const SphereSoA& spheres, SphereKernels::IntersectFunc intersect, float& hitDistance) const;
+
+        // Whether any sphere is hit closer than maxDistance, stops at the first one found
+        template<bool Stats>
+        bool Occluded(const Ray& ray, const SphereSoA& spheres, SphereKernels::IntersectFunc intersect, float maxDistance) const;
+
+        bool IsEmpty() const { return m_Nodes.empty(); }
+        const std::vector<BVHNode>& GetNodes() const { return m_Nodes; }
+        const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+    private:
+        void PrepareRefit();
+        void UpdateBounds(uint32_t nodeIndex, const std::vector<AABB>& bounds);
+        void Subdivide(uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centroids);
+        float FindBestSplit(const BVHNode& node, const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centroids, int& axis, float& splitPosition) const;
+    private:
+        std::vector<BVHNode> m_Nodes;
+        std::vector<uint32_t> m_PrimitiveIndices;
+
+        // Only filled once something is refitted
+        std::vector<uint32_t> m_Parents;
+        std::vector<uint32_t> m_SlotLeaves;
+    };
+
+    template<typename BoundsFunc>
+    void BVH::Refit(const std::vector<uint32_t>& slots, BoundsFunc&& getBounds)
+    {
+        if (m_Nodes.empty())
+            return;
+
+        PrepareRefit();
+        for (uint32_t slot : slots)
+        {
+            uint32_t nodeIndex = m_SlotLeaves[slot];
+            BVHNode& leaf = m_Nodes[nodeIndex];
+
+            AABB bounds;
+            for (uint32_t i = leaf.LeftFirst; i < leaf.LeftFirst + leaf.PrimitiveCount; i++)
+                bounds.Grow(getBounds(i));
+            leaf.Min = bounds.Min;
+            leaf.Max = bounds.Max;
+
+            // Stop early once a node's bounds come out unchanged, nothing above it changes either
+            while (nodeIndex != 0)
+            {
+                nodeIndex = m_Parents[nodeIndex];
+                BVHNode& node = m_Nodes[nodeIndex];
+                const BVHNode& left = m_Nodes[node.LeftFirst];
+                const BVHNode& right = m_Nodes[node.LeftFirst + 1];
+
+                glm::vec3 min = glm::min(left.Min, right.Min);
+                glm::vec3 max = glm::max(left.Max, right.Max);
+                if (min == node.Min && max == node.Max)
+                    break;
+
+                node.Min = min;
+                node.Max = max;
+            }
+        }
+    }
+
+    template<typename LeafFunc>
+    void BVH::Traverse(const Ray& ray, float& hitDistance, LeafFunc&& intersectLeaf) const
+    {
+        if (m_Nodes.empty())
+            return;
+
+        struct StackEntry
+        {
+            uint32_t NodeIndex;
+            float Distance;
+        };
+
+        const glm::vec3 inverseDirection = 1.0f / ray.Direction;
+
+        StackEntry stack[MaxDepth];
+        uint32_t stackSize = 0;
+
+        float rootDistance = Intersection::RayAABB(ray, inverseDirection, m_Nodes[0].Min, m_Nodes[0].Max, hitDistance);
+        if (rootDistance == std::numeric_limits<float>::max())
+            return;
+
+        stack[stackSize++] = { 0, rootDistance };
+        while (stackSize > 0)
+        {
+            StackEntry entry = stack[--stackSize];
+            if (entry.Distance >= hitDistance)
+                continue; // A closer hit was found after this node was pushed
+
+            const BVHNode* node = &m_Nodes[entry.NodeIndex];
+            while (!node->IsLeaf())
+            {
+                // Visit the nearer child first so hitDistance shrinks as early as possible
+                uint32_t nearIndex = node->LeftFirst;
+                uint32_t farIndex = node->LeftFirst + 1;
+                float nearDistance = Intersection::RayAABB(ray, inverseDirection, m_Nodes[nearIndex].Min, m_Nodes[nearIndex].Max, hitDistance);
+                float farDistance = Intersection::RayAABB(ray, inverseDirection, m_Nodes[farIndex].Min, m_Nodes[farIndex].Max, hitDistance);
+                if (farDistance < nearDistance)
+                {
+                    std::swap(nearIndex, farIndex);
+                    std::swap(nearDistance, farDistance);
+                }
+
+                if (nearDistance == std::numeric_limits<float>::max())
+                {
+                    node = nullptr;
+                    break;
+                }
+
+                if (farDistance != std::numeric_limits<float>::max())
+                    stack[stackSize++] = { farIndex, farDistance };
+
+                node = &m_Nodes[nearIndex];
+            }
+
+            if (node)
+                intersectLeaf(node->LeftFirst, node->PrimitiveCount);
+        }
+    }
+
+    template<typename LeafFunc>
+    bool BVH::TraverseAny(const Ray& ray, float maxDistance, LeafFunc&& intersectLeaf) const
+    {
+        if (m_Nodes.empty())
+            return false;
+
+        const glm::vec3 inverseDirection = 1.0f / ray.Direction;
+        if (Intersection::RayAABB(ray, inverseDirection, m_Nodes[0].Min, m_Nodes[0].Max, maxDistance) == std::numeric_limits<float>::max())
+            return false;
+
+        uint32_t stack[MaxDepth];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const BVHNode* node = &m_Nodes[stack[--stackSize]];
+            while (!node->IsLeaf())
+            {
+                // Occluders near the origin are found first by going to the nearer child, like Traverse does
+                uint32_t nearIndex = node->LeftFirst;
+                uint32_t farIndex = node->LeftFirst + 1;
+                float nearDistance = Intersection::RayAABB(ray, inverseDirection, m_Nodes[nearIndex].Min, m_Nodes[nearIndex].Max, maxDistance);
+                float farDistance = Intersection::RayAABB(ray, inverseDirection, m_Nodes[farIndex].Min, m_Nodes[farIndex].Max, maxDistance);
+                if (farDistance < nearDistance)
+                {
+                    std::swap(nearIndex, farIndex);
+                    std::swap(nearDistance, farDistance);
+                }
+
+                if (nearDistance == std::numeric_limits<float>::max())
+                {
+                    node = nullptr;
+                    break;
+                }
+
+                if (farDistance != std::numeric_limits<float>::max())
+                    stack[stackSize++] = farIndex;
+
+                node = &m_Nodes[nearIndex];
+            }
+
+            if (node && intersectLeaf(node->LeftFirst, node->PrimitiveCount))
+                return true;
+        }
+        return false;
+    }
+}
\ No newline at end of file
@@ -4,9 +4,11 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#ifndef RT_HEADLESS
 #include "Walnut/Input/Input.h"
 
 using namespace Walnut;
+#endif
 
 namespace RayTracing {
 
@@ -15,8 +17,10 @@ namespace RayTracing {
     {
         m_ForwardDirection = glm::vec3(0, 0, -1);
         m_Position = glm::vec3(0, 0, 6);
+        RecalculateView();
     }
 
+#ifndef RT_HEADLESS
     bool Camera::OnUpdate(float ts)
     {
         glm::vec2 mousePos = Input::GetMousePosition();
@@ -83,11 +87,12 @@ namespace RayTracing {
         if (moved)
         {
             RecalculateView();
-            RecalculateRayDirections();
+            RecalculateRayBasis();
         }
 
         return moved;
     }
+#endif
 
     void Camera::OnResize(uint32_t width, uint32_t height)
     {
@@ -99,7 +104,7 @@ namespace RayTracing {
         m_ViewportHeight = height;
 
         RecalculateProjection();
-        RecalculateRayDirections();
+        RecalculateRayBasis();
     }
 
     float Camera::GetRotationSpeed()
@@ -119,22 +124,20 @@ namespace RayTracing {
         m_InverseView = glm::inverse(m_View);
     }
 
-    void Camera::RecalculateRayDirections()
+    void Camera::RecalculateRayBasis()
     {
-        m_RayDirections.resize(m_ViewportWidth * m_ViewportHeight);
-
-        for (uint32_t y = 0; y < m_ViewportHeight; y++)
+        // The inverse projection's w does not depend on the screen position, so the view space point on the far
+        // plane is affine in it. The view rotation keeps that true in world space and normalizing commutes with it
+        auto worldSpaceTarget = [this](float u, float v)
         {
-            for (uint32_t x = 0; x < m_ViewportWidth; x++)
-            {
-                glm::vec2 coord = { (float)x / (float)m_ViewportWidth, (float)y / (float)m_ViewportHeight };
-                coord = coord * 2.0f - 1.0f; // -1 -> 1
-
-                glm::vec4 target = m_InverseProjection * glm::vec4(coord.x, coord.y, 1, 1);
-                glm::vec3 rayDirection = glm::vec3(m_InverseView * glm::vec4(glm::normalize(glm::vec3(target) / target.w), 0)); // World space
-                m_RayDirections[x + y * m_ViewportWidth] = rayDirection;
-            }
-        }
+            glm::vec4 target = m_InverseProjection * glm::vec4(u, v, 1, 1);
+            return glm::vec3(m_InverseView * glm::vec4(glm::vec3(target) / target.w, 0)); // World space
+        };
+
+        glm::vec3 origin = worldSpaceTarget(-1.0f, -1.0f);
+        m_RayDirectionOrigin = origin;
+        m_RayDirectionDeltaX = (worldSpaceTarget(1.0f, -1.0f) - origin) / (float)m_ViewportWidth;
+        m_RayDirectionDeltaY = (worldSpaceTarget(-1.0f, 1.0f) - origin) / (float)m_ViewportHeight;
     }
 
 }
\ No newline at end of file
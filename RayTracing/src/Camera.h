@@ -1,7 +1,6 @@
 #pragma once
 
 #include <glm/glm.hpp>
-#include <vector>
 
 namespace RayTracing {
 
@@ -10,7 +9,9 @@ namespace RayTracing {
     public:
         Camera(float verticalFOV, float nearClip, float farClip);
 
+#ifndef RT_HEADLESS
         bool OnUpdate(float ts);
+#endif
         void OnResize(uint32_t width, uint32_t height);
 
         const glm::mat4& GetProjection() const { return m_Projection; }
@@ -21,7 +22,15 @@ namespace RayTracing {
         const glm::vec3& GetPosition() const { return m_Position; }
         const glm::vec3& GetDirection() const { return m_ForwardDirection; }
 
-        const std::vector<glm::vec3>& GetRayDirections() const { return m_RayDirections; }
+        // World space direction through viewport position (x, y) in pixels, integer coordinates are pixel corners
+        glm::vec3 GetRayDirection(float x, float y) const
+        {
+            return glm::normalize(m_RayDirectionOrigin + m_RayDirectionDeltaX * x + m_RayDirectionDeltaY * y);
+        }
+        // The same before normalizing, which is linear in x and y
+        glm::vec3 GetUnnormalizedRayDirection(float x, float y) const { return m_RayDirectionOrigin + m_RayDirectionDeltaX * x + m_RayDirectionDeltaY * y; }
+        const glm::vec3& GetRayDirectionDeltaX() const { return m_RayDirectionDeltaX; }
+        const glm::vec3& GetRayDirectionDeltaY() const { return m_RayDirectionDeltaY; }
 
         float GetSpeed() const { return m_Speed; }
         void SetSpeed(float speed) { m_Speed = speed; }
@@ -30,7 +39,7 @@ namespace RayTracing {
     private:
         void RecalculateProjection();
         void RecalculateView();
-        void RecalculateRayDirections();
+        void RecalculateRayBasis();
     private:
         glm::mat4 m_Projection{ 1.0f };
         glm::mat4 m_View{ 1.0f };
@@ -44,8 +53,10 @@ namespace RayTracing {
         glm::vec3 m_Position{ 0.0f, 0.0f, 0.0f };
         glm::vec3 m_ForwardDirection{ 0.0f, 0.0f, 0.0f };
 
-        // Cached ray directions
-        std::vector<glm::vec3> m_RayDirections;
+        // Unnormalized direction through pixel (0, 0) and its change per pixel along each axis
+        glm::vec3 m_RayDirectionOrigin{ 0.0f, 0.0f, -1.0f };
+        glm::vec3 m_RayDirectionDeltaX{ 0.0f };
+        glm::vec3 m_RayDirectionDeltaY{ 0.0f };
 
         float m_Speed = 2.5f;
         glm::vec2 m_LastMousePosition{ 0.0f, 0.0f };
@@ -0,0 +1,635 @@
+#include "Denoiser.h"
+
+#include "ResolveKernels.h"
+#include "SIMD.h"
+#include "Utils.h"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+namespace RayTracing {
+
+    namespace Utils {
+
+        // Depth plane values besides distances: pixels without samples, and the padding around the image
+        static constexpr float EmptyDepth = -1.0f;
+        static constexpr float PaddingDepth = -2.0f;
+
+        static constexpr float MinAlbedo = 0.01f; // Keeps black surfaces from dividing by zero
+        static constexpr uint32_t MinTemporalSamples = 4; // Fewer and the variance comes from the neighbourhood
+
+        // Edge stopping, the normal weight is the cosine to the power of 2^NormalSquarings
+        static constexpr uint32_t NormalSquarings = 6;
+        static constexpr float PlaneSigma = 0.01f; // Distance from the center's plane, relative to its distance from the camera
+        static constexpr float LuminanceSigma = 4.0f; // In standard deviations of the center's illumination
+        static constexpr float Kernel[3] = { 0.25f, 0.5f, 0.25f };
+
+        // e^-x for x >= 0 within about 6%, plenty for filter weights. Scaling x into the exponent bits of a float
+        // (Schraudolph 1999) interpolates linearly between powers of two
+        static constexpr float ExpScale = 12102203.0f; // 2^23 / ln 2
+        static constexpr float ExpBias = 1065353216.0f; // 127 << 23
+        static constexpr float ExpLimit = 87.0f; // Beyond this the result would leave the normal floats
+
+        static float ExpNegative(float x)
+        {
+            x = x < ExpLimit ? x : ExpLimit;
+            return std::bit_cast<float>((int32_t)(ExpBias - x * ExpScale));
+        }
+
+        // Weights of mismatched taps underflow, and arithmetic on denormals costs a hundred cycles or more.
+        // Flushes them to zero while alive
+        class FlushDenormals
+        {
+        public:
+#if RT_SIMD_X86
+            FlushDenormals() : m_State(_mm_getcsr()) { _mm_setcsr(m_State | 0x8040); }
+            ~FlushDenormals() { _mm_setcsr(m_State); }
+        private:
+            uint32_t m_State;
+#endif
+        };
+
+#if RT_SIMD_X86
+        RT_TARGET("avx2")
+        static __m256 ExpNegativeAVX2(__m256 x)
+        {
+            x = _mm256_min_ps(x, _mm256_set1_ps(Utils::ExpLimit));
+            return _mm256_castsi256_ps(_mm256_cvttps_epi32(_mm256_sub_ps(_mm256_set1_ps(Utils::ExpBias), _mm256_mul_ps(x, _mm256_set1_ps(Utils::ExpScale)))));
+        }
+
+        RT_TARGET("avx2")
+        static __m256 LuminanceAVX2(__m256 r, __m256 g, __m256 b)
+        {
+            return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, _mm256_set1_ps(0.2126f)), _mm256_mul_ps(g, _mm256_set1_ps(0.7152f))), _mm256_mul_ps(b, _mm256_set1_ps(0.0722f)));
+        }
+
+        RT_TARGET("avx2")
+        static __m256 DotAVX2(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz)
+        {
+            return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+        }
+
+        // Unnormalized ray directions through pixels x to x + 7 of row y
+        RT_TARGET("avx2")
+        static void RayDirectionsAVX2(const DenoiseKernels::RowPass& pass, uint32_t x, uint32_t y, __m256& directionX, __m256& directionY, __m256& directionZ)
+        {
+            const glm::vec3 rowOrigin = pass.RayOrigin + pass.RayDeltaY * (float)y;
+            const __m256 pixelX = _mm256_add_ps(_mm256_set1_ps((float)x), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+            directionX = _mm256_add_ps(_mm256_set1_ps(rowOrigin.x), _mm256_mul_ps(pixelX, _mm256_set1_ps(pass.RayDeltaX.x)));
+            directionY = _mm256_add_ps(_mm256_set1_ps(rowOrigin.y), _mm256_mul_ps(pixelX, _mm256_set1_ps(pass.RayDeltaX.y)));
+            directionZ = _mm256_add_ps(_mm256_set1_ps(rowOrigin.z), _mm256_mul_ps(pixelX, _mm256_set1_ps(pass.RayDeltaX.z)));
+        }
+#endif
+
+    }
+
+    namespace DenoiseKernels {
+
+        static void PrepareScalar(const RowPass& pass, uint32_t y)
+        {
+            const Framebuffer& framebuffer = *pass.Target;
+            for (uint32_t x = 0; x < pass.Width; x++)
+            {
+                const Framebuffer::AccumulationBlock& block = framebuffer.GetBlock(x, y);
+                const Framebuffer::SurfaceBlock& features = framebuffer.GetFeatureBlock(x, y);
+                const uint32_t pixel = Framebuffer::GetBlockPixel(x, y);
+                const size_t index = (size_t)y * pass.Stride + x;
+
+                const uint32_t sampleCount = block.SampleCount[pixel];
+                const float inverseCount = 1.0f / (float)glm::max(sampleCount, 1u);
+                const glm::vec3 albedo = glm::max(glm::vec3(features.AlbedoR[pixel], features.AlbedoG[pixel], features.AlbedoB[pixel]) * inverseCount, Utils::MinAlbedo);
+
+                // Every sample that hit something added a unit normal, nearly the same ones within a pixel, so the
+                // length of the sum counts them. Pixels that mostly show sky count as sky
+                const glm::vec3 normalSum = { features.NormalX[pixel], features.NormalY[pixel], features.NormalZ[pixel] };
+                const float normalLength = glm::length(normalSum);
+                glm::vec3 normal(0.0f);
+                float depth = sampleCount ? 0.0f : Utils::EmptyDepth;
+                if (normalLength > 0.5f * (float)sampleCount)
+                {
+                    normal = normalSum / normalLength;
+                    const glm::vec3 direction = pass.RayOrigin + pass.RayDeltaX * (float)x + pass.RayDeltaY * (float)y;
+                    depth = features.Depth[pixel] / normalLength / glm::length(direction);
+                }
+                pass.Depth[index] = depth;
+                pass.Normal[0][index] = normal.x;
+                pass.Normal[1][index] = normal.y;
+                pass.Normal[2][index] = normal.z;
+
+                const glm::vec3 radiance = glm::vec3(block.Red[pixel], block.Green[pixel], block.Blue[pixel]) * inverseCount;
+                const glm::vec3 illumination = radiance / albedo;
+                pass.Output[0][index] = illumination.r;
+                pass.Output[1][index] = illumination.g;
+                pass.Output[2][index] = illumination.b;
+
+                float variance = -1.0f;
+                if (sampleCount >= Utils::MinTemporalSamples)
+                {
+                    const float mean = Utils::Luminance(radiance);
+                    const float albedoLuminance = Utils::Luminance(albedo);
+                    variance = glm::max(block.LuminanceMoment[pixel] * inverseCount - mean * mean, 0.0f) * inverseCount / (albedoLuminance * albedoLuminance);
+                }
+                pass.Output[3][index] = variance;
+            }
+        }
+
+        static void EstimateVarianceScalar(const RowPass& pass, uint32_t y)
+        {
+            for (uint32_t x = 0; x < pass.Width; x++)
+            {
+                const size_t index = (size_t)y * pass.Stride + x;
+                float variance = pass.Input[3][index];
+                if (variance < 0.0f)
+                {
+                    float sum = 0.0f, sumSquared = 0.0f, count = 0.0f;
+                    for (int dy = -1; dy <= 1; dy++)
+                    {
+                        if ((int)y + dy < 0 || (int)y + dy >= (int)pass.Height)
+                            continue;
+
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            const size_t tap = index + (ptrdiff_t)dy * pass.Stride + dx;
+                            if (pass.Depth[tap] == Utils::PaddingDepth)
+                                continue;
+
+                            const float luminance = Utils::Luminance({ pass.Input[0][tap], pass.Input[1][tap], pass.Input[2][tap] });
+                            sum += luminance;
+                            sumSquared += luminance * luminance;
+                            count += 1.0f;
+                        }
+                    }
+                    const float mean = sum / count;
+                    variance = glm::max(sumSquared / count - mean * mean, 0.0f);
+                }
+                pass.Output[3][index] = variance;
+            }
+        }
+
+        static void FilterScalar(const RowPass& pass, uint32_t y)
+        {
+            Utils::FlushDenormals flush;
+
+            const int step = (int)pass.Step;
+            for (uint32_t x = 0; x < pass.Width; x++)
+            {
+                const size_t center = (size_t)y * pass.Stride + x;
+                const float depth = pass.Depth[center];
+                const glm::vec3 normal = { pass.Normal[0][center], pass.Normal[1][center], pass.Normal[2][center] };
+                const glm::vec3 illumination = { pass.Input[0][center], pass.Input[1][center], pass.Input[2][center] };
+                const float luminance = Utils::Luminance(illumination);
+
+                // Variance blurred over the direct neighbours steadies the edge stopping
+                float variance = 0.0f, varianceWeight = 0.0f;
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    if ((int)y + dy < 0 || (int)y + dy >= (int)pass.Height)
+                        continue;
+
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        const size_t tap = center + (ptrdiff_t)dy * pass.Stride + dx;
+                        const float weight = pass.Depth[tap] != Utils::PaddingDepth ? Utils::Kernel[dx + 1] * Utils::Kernel[dy + 1] : 0.0f;
+                        variance += weight * pass.Input[3][tap];
+                        varianceWeight += weight;
+                    }
+                }
+                variance /= varianceWeight;
+
+                // A tap's distance from the center's plane. With positions along the unnormalized rays it is linear
+                // in the tap's depth
+                const glm::vec3 direction = pass.RayOrigin + pass.RayDeltaX * (float)x + pass.RayDeltaY * (float)y;
+                const float planeCenter = glm::dot(direction, normal);
+                const float planeDeltaX = glm::dot(pass.RayDeltaX, normal) * (float)step;
+                const float planeDeltaY = glm::dot(pass.RayDeltaY, normal) * (float)step;
+                const float planeBase = depth * planeCenter;
+                const float planeScale = depth > 0.0f ? 1.0f / (Utils::PlaneSigma * depth * glm::length(direction)) : 0.0f;
+                const float luminanceScale = 1.0f / (Utils::LuminanceSigma * std::sqrt(variance) + 1e-4f);
+
+                // The center matches itself
+                const float centerWeight = Utils::Kernel[1] * Utils::Kernel[1];
+                glm::vec3 sum = centerWeight * illumination;
+                float weightSum = centerWeight;
+                float varianceSum = centerWeight * centerWeight * pass.Input[3][center];
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    if ((int)y + dy * step < 0 || (int)y + dy * step >= (int)pass.Height)
+                        continue;
+
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        if (dx == 0 && dy == 0)
+                            continue;
+
+                        const size_t tap = center + (ptrdiff_t)(dy * step) * pass.Stride + dx * step;
+                        const float tapDepth = pass.Depth[tap];
+                        const glm::vec3 tapIllumination = { pass.Input[0][tap], pass.Input[1][tap], pass.Input[2][tap] };
+
+                        // Sky, pixels without samples and the padding only mix with their own kind
+                        float geometry;
+                        if (depth > 0.0f)
+                        {
+                            geometry = glm::max(glm::dot(normal, glm::vec3(pass.Normal[0][tap], pass.Normal[1][tap], pass.Normal[2][tap])), 0.0f);
+                            for (uint32_t i = 0; i < Utils::NormalSquarings; i++)
+                                geometry *= geometry;
+                        }
+                        else
+                        {
+                            geometry = tapDepth == depth ? 1.0f : 0.0f;
+                        }
+
+                        const float planeDistance = std::abs(tapDepth * (planeCenter + planeDeltaX * (float)dx + planeDeltaY * (float)dy) - planeBase);
+                        const float luminanceDistance = std::abs(luminance - Utils::Luminance(tapIllumination));
+                        const float weight = Utils::Kernel[dx + 1] * Utils::Kernel[dy + 1] * geometry * Utils::ExpNegative(planeDistance * planeScale + luminanceDistance * luminanceScale);
+
+                        sum += weight * tapIllumination;
+                        weightSum += weight;
+                        varianceSum += weight * weight * pass.Input[3][tap];
+                    }
+                }
+
+                pass.Output[0][center] = sum.r / weightSum;
+                pass.Output[1][center] = sum.g / weightSum;
+                pass.Output[2][center] = sum.b / weightSum;
+                pass.Output[3][center] = varianceSum / (weightSum * weightSum);
+            }
+        }
+
+        static void RemodulateScalar(const RowPass& pass, uint32_t y)
+        {
+            Framebuffer& framebuffer = *pass.Target;
+            for (uint32_t x = 0; x < pass.Width; x++)
+            {
+                const Framebuffer::AccumulationBlock& block = framebuffer.GetBlock(x, y);
+                const Framebuffer::SurfaceBlock& features = framebuffer.GetFeatureBlock(x, y);
+                Framebuffer::AccumulationBlock& denoised = framebuffer.GetDenoisedBlock(x, y);
+                const uint32_t pixel = Framebuffer::GetBlockPixel(x, y);
+                const size_t index = (size_t)y * pass.Stride + x;
+
+                const float inverseCount = 1.0f / (float)glm::max(block.SampleCount[pixel], 1u);
+                const glm::vec3 albedo = glm::max(glm::vec3(features.AlbedoR[pixel], features.AlbedoG[pixel], features.AlbedoB[pixel]) * inverseCount, Utils::MinAlbedo);
+                denoised.Red[pixel] = pass.Input[0][index] * albedo.r;
+                denoised.Green[pixel] = pass.Input[1][index] * albedo.g;
+                denoised.Blue[pixel] = pass.Input[2][index] * albedo.b;
+                denoised.LuminanceMoment[pixel] = 0.0f;
+                denoised.SampleCount[pixel] = 1;
+            }
+        }
+
+        const KernelSet Scalar = { PrepareScalar, EstimateVarianceScalar, FilterScalar, RemodulateScalar };
+
+#if RT_SIMD_X86
+        // A block row is one aligned vector per plane. The planes' padding has to keep its values, so the last
+        // vector of a row is stored masked
+        RT_TARGET("avx2")
+        static void PrepareAVX2(const RowPass& pass, uint32_t y)
+        {
+            const Framebuffer& framebuffer = *pass.Target;
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 minAlbedo = _mm256_set1_ps(Utils::MinAlbedo);
+            const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+            for (uint32_t x = 0; x < pass.Width; x += Framebuffer::BlockSize)
+            {
+                const Framebuffer::AccumulationBlock& block = framebuffer.GetBlock(x, y);
+                const Framebuffer::SurfaceBlock& features = framebuffer.GetFeatureBlock(x, y);
+                const uint32_t row = Framebuffer::GetBlockPixel(x, y);
+                const size_t index = (size_t)y * pass.Stride + x;
+
+                const __m256 sampleCount = _mm256_cvtepi32_ps(_mm256_load_si256((const __m256i*)&block.SampleCount[row]));
+                const __m256 inverseCount = _mm256_div_ps(one, _mm256_max_ps(sampleCount, one));
+                const __m256 albedoR = _mm256_max_ps(_mm256_mul_ps(_mm256_load_ps(&features.AlbedoR[row]), inverseCount), minAlbedo);
+                const __m256 albedoG = _mm256_max_ps(_mm256_mul_ps(_mm256_load_ps(&features.AlbedoG[row]), inverseCount), minAlbedo);
+                const __m256 albedoB = _mm256_max_ps(_mm256_mul_ps(_mm256_load_ps(&features.AlbedoB[row]), inverseCount), minAlbedo);
+
+                const __m256 normalX = _mm256_load_ps(&features.NormalX[row]);
+                const __m256 normalY = _mm256_load_ps(&features.NormalY[row]);
+                const __m256 normalZ = _mm256_load_ps(&features.NormalZ[row]);
+                const __m256 normalLength = _mm256_sqrt_ps(Utils::DotAVX2(normalX, normalY, normalZ, normalX, normalY, normalZ));
+                const __m256 hit = _mm256_cmp_ps(normalLength, _mm256_mul_ps(sampleCount, _mm256_set1_ps(0.5f)), _CMP_GT_OQ);
+                const __m256 inverseLength = _mm256_and_ps(hit, _mm256_div_ps(one, _mm256_max_ps(normalLength, _mm256_set1_ps(1e-6f))));
+
+                __m256 directionX, directionY, directionZ;
+                Utils::RayDirectionsAVX2(pass, x, y, directionX, directionY, directionZ);
+                const __m256 directionLength = _mm256_sqrt_ps(Utils::DotAVX2(directionX, directionY, directionZ, directionX, directionY, directionZ));
+                const __m256 distance = _mm256_div_ps(_mm256_mul_ps(_mm256_load_ps(&features.Depth[row]), inverseLength), directionLength);
+                const __m256 empty = _mm256_cmp_ps(sampleCount, zero, _CMP_EQ_OQ);
+                const __m256 depth = _mm256_blendv_ps(_mm256_and_ps(hit, distance), _mm256_set1_ps(Utils::EmptyDepth), empty);
+
+                const __m256 radianceR = _mm256_mul_ps(_mm256_load_ps(&block.Red[row]), inverseCount);
+                const __m256 radianceG = _mm256_mul_ps(_mm256_load_ps(&block.Green[row]), inverseCount);
+                const __m256 radianceB = _mm256_mul_ps(_mm256_load_ps(&block.Blue[row]), inverseCount);
+
+                const __m256 mean = Utils::LuminanceAVX2(radianceR, radianceG, radianceB);
+                const __m256 albedoLuminance = Utils::LuminanceAVX2(albedoR, albedoG, albedoB);
+                __m256 variance = _mm256_max_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_load_ps(&block.LuminanceMoment[row]), inverseCount), _mm256_mul_ps(mean, mean)), zero);
+                variance = _mm256_div_ps(_mm256_mul_ps(variance, inverseCount), _mm256_mul_ps(albedoLuminance, albedoLuminance));
+                const __m256 enoughSamples = _mm256_cmp_ps(sampleCount, _mm256_set1_ps((float)Utils::MinTemporalSamples), _CMP_GE_OQ);
+                variance = _mm256_blendv_ps(_mm256_set1_ps(-1.0f), variance, enoughSamples);
+
+                const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)glm::min(pass.Width - x, Framebuffer::BlockSize)), laneIndex);
+                _mm256_maskstore_ps(pass.Depth + index, mask, depth);
+                _mm256_maskstore_ps(pass.Normal[0] + index, mask, _mm256_mul_ps(normalX, inverseLength));
+                _mm256_maskstore_ps(pass.Normal[1] + index, mask, _mm256_mul_ps(normalY, inverseLength));
+                _mm256_maskstore_ps(pass.Normal[2] + index, mask, _mm256_mul_ps(normalZ, inverseLength));
+                _mm256_maskstore_ps(pass.Output[0] + index, mask, _mm256_div_ps(radianceR, albedoR));
+                _mm256_maskstore_ps(pass.Output[1] + index, mask, _mm256_div_ps(radianceG, albedoG));
+                _mm256_maskstore_ps(pass.Output[2] + index, mask, _mm256_div_ps(radianceB, albedoB));
+                _mm256_maskstore_ps(pass.Output[3] + index, mask, variance);
+            }
+        }
+
+        RT_TARGET("avx2")
+        static void EstimateVarianceAVX2(const RowPass& pass, uint32_t y)
+        {
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 paddingDepth = _mm256_set1_ps(Utils::PaddingDepth);
+
+            for (uint32_t x = 0; x < pass.Width; x += 8)
+            {
+                const size_t index = (size_t)y * pass.Stride + x;
+                __m256 variance = _mm256_loadu_ps(pass.Input[3] + index);
+                const __m256 estimate = _mm256_cmp_ps(variance, zero, _CMP_LT_OQ);
+                if (_mm256_movemask_ps(estimate))
+                {
+                    __m256 sum = zero, sumSquared = zero, count = zero;
+                    for (int dy = -1; dy <= 1; dy++)
+                    {
+                        if ((int)y + dy < 0 || (int)y + dy >= (int)pass.Height)
+                            continue;
+
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            const size_t tap = index + (ptrdiff_t)dy * pass.Stride + dx;
+                            const __m256 valid = _mm256_cmp_ps(_mm256_loadu_ps(pass.Depth + tap), paddingDepth, _CMP_NEQ_OQ);
+                            const __m256 luminance = _mm256_and_ps(valid, Utils::LuminanceAVX2(_mm256_loadu_ps(pass.Input[0] + tap), _mm256_loadu_ps(pass.Input[1] + tap), _mm256_loadu_ps(pass.Input[2] + tap)));
+                            sum = _mm256_add_ps(sum, luminance);
+                            sumSquared = _mm256_add_ps(sumSquared, _mm256_mul_ps(luminance, luminance));
+                            count = _mm256_add_ps(count, _mm256_and_ps(valid, one));
+                        }
+                    }
+
+                    // Lanes in the padding may have no valid neighbour at all, they must stay finite
+                    const __m256 inverseCount = _mm256_div_ps(one, _mm256_max_ps(count, one));
+                    const __m256 mean = _mm256_mul_ps(sum, inverseCount);
+                    const __m256 spatial = _mm256_max_ps(_mm256_sub_ps(_mm256_mul_ps(sumSquared, inverseCount), _mm256_mul_ps(mean, mean)), zero);
+                    variance = _mm256_blendv_ps(variance, spatial, estimate);
+                }
+                _mm256_storeu_ps(pass.Output[3] + index, variance);
+            }
+        }
+
+        // Eight centers at a time, the same weights as the scalar filter. The last vector of a row runs into the
+        // illumination's padding, which may be overwritten
+        RT_TARGET("avx2")
+        static void FilterAVX2(const RowPass& pass, uint32_t y)
+        {
+            Utils::FlushDenormals flush;
+
+            const int step = (int)pass.Step;
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+            const __m256 paddingDepth = _mm256_set1_ps(Utils::PaddingDepth);
+            const float* kernel = Utils::Kernel;
+
+            for (uint32_t x = 0; x < pass.Width; x += 8)
+            {
+                const size_t center = (size_t)y * pass.Stride + x;
+                const __m256 depth = _mm256_loadu_ps(pass.Depth + center);
+                const __m256 normalX = _mm256_loadu_ps(pass.Normal[0] + center);
+                const __m256 normalY = _mm256_loadu_ps(pass.Normal[1] + center);
+                const __m256 normalZ = _mm256_loadu_ps(pass.Normal[2] + center);
+                const __m256 centerR = _mm256_loadu_ps(pass.Input[0] + center);
+                const __m256 centerG = _mm256_loadu_ps(pass.Input[1] + center);
+                const __m256 centerB = _mm256_loadu_ps(pass.Input[2] + center);
+                const __m256 luminance = Utils::LuminanceAVX2(centerR, centerG, centerB);
+
+                __m256 variance = zero, varianceWeight = zero;
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    if ((int)y + dy < 0 || (int)y + dy >= (int)pass.Height)
+                        continue;
+
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        const size_t tap = center + (ptrdiff_t)dy * pass.Stride + dx;
+                        const __m256 valid = _mm256_cmp_ps(_mm256_loadu_ps(pass.Depth + tap), paddingDepth, _CMP_NEQ_OQ);
+                        const __m256 weight = _mm256_and_ps(valid, _mm256_set1_ps(kernel[dx + 1] * kernel[dy + 1]));
+                        variance = _mm256_add_ps(variance, _mm256_mul_ps(weight, _mm256_loadu_ps(pass.Input[3] + tap)));
+                        varianceWeight = _mm256_add_ps(varianceWeight, weight);
+                    }
+                }
+                variance = _mm256_div_ps(variance, _mm256_max_ps(varianceWeight, _mm256_set1_ps(1e-6f)));
+
+                __m256 directionX, directionY, directionZ;
+                Utils::RayDirectionsAVX2(pass, x, y, directionX, directionY, directionZ);
+                const __m256 planeCenter = Utils::DotAVX2(directionX, directionY, directionZ, normalX, normalY, normalZ);
+                const __m256 planeDeltaX = _mm256_mul_ps(Utils::DotAVX2(_mm256_set1_ps(pass.RayDeltaX.x), _mm256_set1_ps(pass.RayDeltaX.y), _mm256_set1_ps(pass.RayDeltaX.z), normalX, normalY, normalZ), _mm256_set1_ps((float)step));
+                const __m256 planeDeltaY = _mm256_mul_ps(Utils::DotAVX2(_mm256_set1_ps(pass.RayDeltaY.x), _mm256_set1_ps(pass.RayDeltaY.y), _mm256_set1_ps(pass.RayDeltaY.z), normalX, normalY, normalZ), _mm256_set1_ps((float)step));
+                const __m256 planeBase = _mm256_mul_ps(depth, planeCenter);
+
+                const __m256 hit = _mm256_cmp_ps(depth, zero, _CMP_GT_OQ);
+                const __m256 directionLength = _mm256_sqrt_ps(Utils::DotAVX2(directionX, directionY, directionZ, directionX, directionY, directionZ));
+                const __m256 planeScale = _mm256_and_ps(hit, _mm256_div_ps(one, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(Utils::PlaneSigma), depth), directionLength)));
+                const __m256 luminanceScale = _mm256_div_ps(one, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(Utils::LuminanceSigma), _mm256_sqrt_ps(variance)), _mm256_set1_ps(1e-4f)));
+
+                const __m256 centerWeight = _mm256_set1_ps(kernel[1] * kernel[1]);
+                __m256 sumR = _mm256_mul_ps(centerWeight, centerR);
+                __m256 sumG = _mm256_mul_ps(centerWeight, centerG);
+                __m256 sumB = _mm256_mul_ps(centerWeight, centerB);
+                __m256 weightSum = centerWeight;
+                __m256 varianceSum = _mm256_mul_ps(_mm256_mul_ps(centerWeight, centerWeight), _mm256_loadu_ps(pass.Input[3] + center));
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    if ((int)y + dy * step < 0 || (int)y + dy * step >= (int)pass.Height)
+                        continue;
+
+                    const __m256 planeRow = _mm256_add_ps(planeCenter, _mm256_mul_ps(planeDeltaY, _mm256_set1_ps((float)dy)));
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        if (dx == 0 && dy == 0)
+                            continue;
+
+                        const size_t tap = center + (ptrdiff_t)(dy * step) * pass.Stride + dx * step;
+                        const __m256 tapDepth = _mm256_loadu_ps(pass.Depth + tap);
+                        const __m256 tapR = _mm256_loadu_ps(pass.Input[0] + tap);
+                        const __m256 tapG = _mm256_loadu_ps(pass.Input[1] + tap);
+                        const __m256 tapB = _mm256_loadu_ps(pass.Input[2] + tap);
+
+                        __m256 geometry = _mm256_max_ps(Utils::DotAVX2(normalX, normalY, normalZ, _mm256_loadu_ps(pass.Normal[0] + tap), _mm256_loadu_ps(pass.Normal[1] + tap), _mm256_loadu_ps(pass.Normal[2] + tap)), zero);
+                        for (uint32_t i = 0; i < Utils::NormalSquarings; i++)
+                            geometry = _mm256_mul_ps(geometry, geometry);
+                        geometry = _mm256_blendv_ps(_mm256_and_ps(_mm256_cmp_ps(tapDepth, depth, _CMP_EQ_OQ), one), geometry, hit);
+
+                        const __m256 plane = _mm256_add_ps(planeRow, _mm256_mul_ps(planeDeltaX, _mm256_set1_ps((float)dx)));
+                        const __m256 planeDistance = _mm256_and_ps(_mm256_sub_ps(_mm256_mul_ps(tapDepth, plane), planeBase), absMask);
+                        const __m256 luminanceDistance = _mm256_and_ps(_mm256_sub_ps(luminance, Utils::LuminanceAVX2(tapR, tapG, tapB)), absMask);
+                        const __m256 exponent = _mm256_add_ps(_mm256_mul_ps(planeDistance, planeScale), _mm256_mul_ps(luminanceDistance, luminanceScale));
+                        const __m256 weight = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(kernel[dx + 1] * kernel[dy + 1]), geometry), Utils::ExpNegativeAVX2(exponent));
+
+                        sumR = _mm256_add_ps(sumR, _mm256_mul_ps(weight, tapR));
+                        sumG = _mm256_add_ps(sumG, _mm256_mul_ps(weight, tapG));
+                        sumB = _mm256_add_ps(sumB, _mm256_mul_ps(weight, tapB));
+                        weightSum = _mm256_add_ps(weightSum, weight);
+                        varianceSum = _mm256_add_ps(varianceSum, _mm256_mul_ps(_mm256_mul_ps(weight, weight), _mm256_loadu_ps(pass.Input[3] + tap)));
+                    }
+                }
+
+                const __m256 inverseWeight = _mm256_div_ps(one, weightSum);
+                _mm256_storeu_ps(pass.Output[0] + center, _mm256_mul_ps(sumR, inverseWeight));
+                _mm256_storeu_ps(pass.Output[1] + center, _mm256_mul_ps(sumG, inverseWeight));
+                _mm256_storeu_ps(pass.Output[2] + center, _mm256_mul_ps(sumB, inverseWeight));
+                _mm256_storeu_ps(pass.Output[3] + center, _mm256_mul_ps(varianceSum, _mm256_mul_ps(inverseWeight, inverseWeight)));
+            }
+        }
+
+        // Pixels past the right edge of the image land in the unused part of their block
+        RT_TARGET("avx2")
+        static void RemodulateAVX2(const RowPass& pass, uint32_t y)
+        {
+            Framebuffer& framebuffer = *pass.Target;
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 minAlbedo = _mm256_set1_ps(Utils::MinAlbedo);
+
+            for (uint32_t x = 0; x < pass.Width; x += Framebuffer::BlockSize)
+            {
+                const Framebuffer::AccumulationBlock& block = framebuffer.GetBlock(x, y);
+                const Framebuffer::SurfaceBlock& features = framebuffer.GetFeatureBlock(x, y);
+                Framebuffer::AccumulationBlock& denoised = framebuffer.GetDenoisedBlock(x, y);
+                const uint32_t row = Framebuffer::GetBlockPixel(x, y);
+                const size_t index = (size_t)y * pass.Stride + x;
+
+                const __m256 sampleCount = _mm256_cvtepi32_ps(_mm256_load_si256((const __m256i*)&block.SampleCount[row]));
+                const __m256 inverseCount = _mm256_div_ps(one, _mm256_max_ps(sampleCount, one));
+                const __m256 albedoR = _mm256_max_ps(_mm256_mul_ps(_mm256_load_ps(&features.AlbedoR[row]), inverseCount), minAlbedo);
+                const __m256 albedoG = _mm256_max_ps(_mm256_mul_ps(_mm256_load_ps(&features.AlbedoG[row]), inverseCount), minAlbedo);
+                const __m256 albedoB = _mm256_max_ps(_mm256_mul_ps(_mm256_load_ps(&features.AlbedoB[row]), inverseCount), minAlbedo);
+
+                _mm256_store_ps(&denoised.Red[row], _mm256_mul_ps(_mm256_loadu_ps(pass.Input[0] + index), albedoR));
+                _mm256_store_ps(&denoised.Green[row], _mm256_mul_ps(_mm256_loadu_ps(pass.Input[1] + index), albedoG));
+                _mm256_store_ps(&denoised.Blue[row], _mm256_mul_ps(_mm256_loadu_ps(pass.Input[2] + index), albedoB));
+                _mm256_store_ps(&denoised.LuminanceMoment[row], _mm256_setzero_ps());
+                _mm256_store_si256((__m256i*)&denoised.SampleCount[row], _mm256_set1_epi32(1));
+            }
+        }
+
+        const KernelSet AVX2 = { PrepareAVX2, EstimateVarianceAVX2, FilterAVX2, RemodulateAVX2 };
+#else
+        const KernelSet AVX2 = Scalar;
+#endif
+
+        const KernelSet& GetBest()
+        {
+            // Same CPU requirements as the AVX2 resolve kernel
+            return ResolveKernels::GetBest() == ResolveKernels::ResolveAVX2 ? AVX2 : Scalar;
+        }
+
+        const char* GetName(const KernelSet& kernels)
+        {
+            return &kernels == &AVX2 ? "AVX2" : "Scalar";
+        }
+
+    }
+
+    void Denoiser::Denoise(Framebuffer& framebuffer, const Camera& camera, float pixelOffset, uint32_t iterations, bool useSIMD, ThreadPool* threadPool)
+    {
+        const uint32_t width = framebuffer.GetWidth();
+        const uint32_t height = framebuffer.GetHeight();
+        if (!width || !height || !framebuffer.HasFeatures())
+            return;
+
+        Layout(width, height);
+        iterations = glm::min(iterations, MaxIterations);
+        const DenoiseKernels::KernelSet& kernels = useSIMD ? DenoiseKernels::GetBest() : DenoiseKernels::Scalar;
+
+        DenoiseKernels::RowPass pass = {};
+        pass.Target = &framebuffer;
+        pass.Depth = GetPlane(Plane_Depth);
+        pass.Normal[0] = GetPlane(Plane_NormalX);
+        pass.Normal[1] = GetPlane(Plane_NormalY);
+        pass.Normal[2] = GetPlane(Plane_NormalZ);
+        pass.Width = width;
+        pass.Height = height;
+        pass.Stride = m_Stride;
+        pass.RayOrigin = camera.GetUnnormalizedRayDirection(pixelOffset, pixelOffset);
+        pass.RayDeltaX = camera.GetRayDirectionDeltaX();
+        pass.RayDeltaY = camera.GetRayDirectionDeltaY();
+
+        // The temporal variance waits in the second set until the spatial estimates fill in for it
+        for (uint32_t channel = 0; channel < 3; channel++)
+            pass.Output[channel] = GetIllumination(0, channel);
+        pass.Output[3] = GetIllumination(1, 3);
+        RunRows(threadPool, kernels.Prepare, pass);
+
+        for (uint32_t channel = 0; channel < 3; channel++)
+            pass.Input[channel] = GetIllumination(0, channel);
+        pass.Input[3] = GetIllumination(1, 3);
+        pass.Output[3] = GetIllumination(0, 3);
+        RunRows(threadPool, kernels.EstimateVariance, pass);
+
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            for (uint32_t channel = 0; channel < 4; channel++)
+            {
+                pass.Input[channel] = GetIllumination(i % 2, channel);
+                pass.Output[channel] = GetIllumination((i + 1) % 2, channel);
+            }
+            pass.Step = 1u << i;
+            RunRows(threadPool, kernels.Filter, pass);
+        }
+
+        for (uint32_t channel = 0; channel < 4; channel++)
+            pass.Input[channel] = GetIllumination(iterations % 2, channel);
+        RunRows(threadPool, kernels.Remodulate, pass);
+    }
+
+    void Denoiser::Layout(uint32_t width, uint32_t height)
+    {
+        if (width == m_Width && height == m_Height)
+            return;
+
+        m_Width = width;
+        m_Height = height;
+        m_Stride = (width + 2 * Padding + 15) / 16 * 16;
+        m_PlaneSize = (size_t)m_Stride * height;
+        m_Planes.Reserve(m_PlaneSize * PlaneCount);
+
+        // Only pixels are written from here on, the padding keeps zero normals and its depth marker
+        memset(m_Planes.GetData(), 0, m_PlaneSize * PlaneCount * sizeof(float));
+        float* depth = GetPlane(Plane_Depth);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            float* row = depth + (size_t)y * m_Stride;
+            for (int x = -(int)Padding; x < 0; x++)
+                row[x] = Utils::PaddingDepth;
+            for (uint32_t x = width; x < m_Stride - Padding; x++)
+                row[x] = Utils::PaddingDepth;
+        }
+    }
+
+    void Denoiser::RunRows(ThreadPool* threadPool, DenoiseKernels::RowFunc kernel, const DenoiseKernels::RowPass& pass)
+    {
+        // Bands of one block row, so no two tasks write to the same framebuffer block
+        const uint32_t bandCount = (m_Height + Framebuffer::BlockSize - 1) / Framebuffer::BlockSize;
+        auto band = [&](uint32_t taskIndex, uint32_t /*workerIndex*/)
+        {
+            const uint32_t minY = taskIndex * Framebuffer::BlockSize;
+            const uint32_t maxY = glm::min(minY + Framebuffer::BlockSize, m_Height);
+            for (uint32_t y = minY; y < maxY; y++)
+                kernel(pass, y);
+        };
+
+        if (threadPool)
+            threadPool->ParallelFor(bandCount, band);
+        else
+        {
+            for (uint32_t i = 0; i < bandCount; i++)
+                band(i, 0);
+        }
+    }
+
+}
\ No newline at end of file
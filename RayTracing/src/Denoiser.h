@@ -0,0 +1,94 @@
+#pragma once
+
+#include "AlignedBuffer.h"
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "ThreadPool.h"
+
+namespace RayTracing {
+
+    namespace DenoiseKernels {
+
+        // What one step of the denoiser works on. The planes are row major with Stride floats per row and padding
+        // on both sides, so a row is processed eight pixels at a time without bounds checks
+        struct RowPass
+        {
+            Framebuffer* Target;
+            float* Depth; // Along the unnormalized camera ray, 0 for sky, negative for no samples and the padding
+            float* Normal[3];
+            const float* Input[4]; // Illumination red, green, blue and its variance
+            float* Output[4];
+
+            uint32_t Width, Height, Stride;
+            uint32_t Step; // Tap spacing of a filter pass
+
+            // Unnormalized ray direction through the sample position of pixel (0, 0), and its change per pixel
+            glm::vec3 RayOrigin, RayDeltaX, RayDeltaY;
+        };
+
+        using RowFunc = void(*)(const RowPass& pass, uint32_t y);
+
+        struct KernelSet
+        {
+            // Accumulation and features to illumination and guide planes, variance of the mean where a pixel has
+            // enough samples for it. Writes the illumination to Output[0..2], the variance or -1 to Output[3]
+            RowFunc Prepare;
+            // Spatial variance of the illumination around pixels marked -1 in Input[3], all of them to Output[3]
+            RowFunc EstimateVariance;
+            // One à-trous iteration from Input to Output
+            RowFunc Filter;
+            // Input times the albedo into the target's denoised blocks
+            RowFunc Remodulate;
+        };
+
+        extern const KernelSet Scalar;
+        extern const KernelSet AVX2;
+
+        // Widest kernels this CPU supports
+        const KernelSet& GetBest();
+        const char* GetName(const KernelSet& kernels);
+
+    }
+
+    // Edge-avoiding à-trous wavelet filter after SVGF (Schied et al. 2017). It filters illumination, the accumulated
+    // radiance divided by the first hit's albedo, so material edges stay sharp however far it blurs. Each iteration
+    // doubles the spacing of its 3x3 taps and weighs every tap by how well its normal and surface plane match the
+    // center's, and by their luminance difference relative to the noise the center's variance predicts
+    class Denoiser
+    {
+    public:
+        static constexpr uint32_t MaxIterations = 5;
+
+        Denoiser() = default;
+
+        Denoiser(const Denoiser&) = delete;
+        Denoiser& operator=(const Denoiser&) = delete;
+
+        // Filters the framebuffer's accumulation into its denoised blocks, guided by its features. pixelOffset is
+        // where in a pixel its first hits were sampled on average. threadPool null runs on the calling thread
+        void Denoise(Framebuffer& framebuffer, const Camera& camera, float pixelOffset, uint32_t iterations, bool useSIMD, ThreadPool* threadPool);
+    private:
+        enum Plane : uint32_t
+        {
+            Plane_Depth,
+            Plane_NormalX, Plane_NormalY, Plane_NormalZ,
+            // Two sets of red, green, blue and variance that the iterations ping-pong between
+            Plane_Illumination,
+            PlaneCount = Plane_Illumination + 8
+        };
+
+        // Far enough for the widest tap spacing
+        static constexpr uint32_t Padding = 1u << (MaxIterations - 1);
+
+        void Layout(uint32_t width, uint32_t height);
+        void RunRows(ThreadPool* threadPool, DenoiseKernels::RowFunc kernel, const DenoiseKernels::RowPass& pass);
+        float* GetPlane(uint32_t plane) { return m_Planes.GetData() + (size_t)plane * m_PlaneSize + Padding; }
+        float* GetIllumination(uint32_t set, uint32_t channel) { return GetPlane(Plane_Illumination + set * 4 + channel); }
+    private:
+        AlignedBuffer<float> m_Planes;
+        size_t m_PlaneSize = 0;
+        uint32_t m_Stride = 0;
+        uint32_t m_Width = 0, m_Height = 0;
+    };
+
+}
\ No newline at end of file
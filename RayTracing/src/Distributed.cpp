@@ -0,0 +1,664 @@
+#include "Distributed.h"
+
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <thread>
+#include <type_traits>
+
+namespace RayTracing::Distributed {
+
+    namespace Utils {
+
+        // Every message is a header and Size bytes of payload. Structs go over the wire as they are laid out in
+        // memory, coordinator and workers have to be the same build, which the hello checks
+        enum class MessageType : uint32_t
+        {
+            Hello, // Worker to coordinator, HelloMessage
+            Job, // JobMessage, the camera and a .rtscene file image
+            Assign, // AssignMessage
+            Result, // ResultMessage and the unit's accumulation blocks, row by row
+            JobDone // No payload, units still assigned can be dropped
+        };
+
+        struct MessageHeader
+        {
+            MessageType Type;
+            uint32_t Reserved;
+            uint64_t Size;
+        };
+
+        struct HelloMessage
+        {
+            uint32_t Magic;
+            uint32_t Version;
+            uint32_t SettingsSize;
+            uint32_t CameraSize;
+            uint32_t BlockSize;
+            uint32_t ThreadCount;
+        };
+
+        struct JobMessage
+        {
+            uint32_t JobIndex;
+            uint32_t Width, Height;
+            uint32_t FrameCount;
+            uint32_t BatchSize; // Units the worker renders at once, enough tiles to keep its threads busy
+            Renderer::Settings Settings;
+        };
+
+        struct AssignMessage
+        {
+            uint32_t JobIndex;
+            uint32_t UnitIndex;
+            Renderer::Tile Region;
+        };
+
+        struct ResultMessage
+        {
+            uint32_t JobIndex;
+            uint32_t UnitIndex;
+            uint64_t RayCount;
+            double RenderMs; // The unit's share of the batch
+            double BatchMs;
+        };
+
+        static_assert(std::is_trivially_copyable_v<Renderer::Settings> && std::is_trivially_copyable_v<Camera>);
+
+        static constexpr uint32_t Magic = 0x4b575452; // "RTWK"
+        static constexpr uint32_t Version = 1;
+        static constexpr uint64_t MaxMessageSize = 1ull << 40; // Only for jobs, which carry the whole scene
+
+        static constexpr int HandshakeTimeoutMs = 5000; // From accepting the connection to a complete hello
+        static constexpr int MessageTimeoutMs = 10000; // Silence in the middle of a message
+        static constexpr int PollIntervalMs = 50;
+        static constexpr int ConnectRetryMs = 100;
+        static constexpr int ConnectTimeoutMs = 10000;
+
+        // Without a measured batch time the first units may take as long as loading the scene
+        static constexpr double InitialTimeoutMs = 60000.0;
+        static constexpr double MinTimeoutMs = 1000.0;
+        static constexpr double TimeoutFactor = 4.0;
+
+        static constexpr uint32_t MaxUnitSize = 64;
+        static constexpr uint32_t UnitsPerWorker = 16; // Automatic unit size aims for at least this many
+        static constexpr uint32_t TilesPerThread = 4; // In a worker's batch, so its own tile scheduling can balance
+
+        static bool Fail(std::string* error, const std::string& message)
+        {
+            if (error)
+                *error = message;
+            return false;
+        }
+
+        // Small messages go out in one piece, large payloads after the header without copying them
+        static bool SendMessage(Socket& socket, MessageType type, const void* data, size_t size, const void* tail = nullptr, size_t tailSize = 0)
+        {
+            const MessageHeader header = { type, 0, (uint64_t)(size + tailSize) };
+            std::vector<char> message(sizeof(header) + size);
+            memcpy(message.data(), &header, sizeof(header));
+            if (size)
+                memcpy(message.data() + sizeof(header), data, size);
+
+            return socket.Send(message.data(), message.size()) && (!tailSize || socket.Send(tail, tailSize));
+        }
+
+        static bool ReceiveHeader(Socket& socket, MessageHeader& header, int timeoutMs)
+        {
+            return socket.Receive(&header, sizeof(header), timeoutMs);
+        }
+
+        // The size comes from the peer, it is checked against what the message can hold before allocating
+        static bool ReceivePayload(Socket& socket, const MessageHeader& header, uint64_t maxSize, std::vector<char>& payload)
+        {
+            if (header.Size > maxSize)
+                return false;
+
+            payload.resize((size_t)header.Size);
+            return socket.Receive(payload.data(), payload.size(), MessageTimeoutMs);
+        }
+
+        static bool ReceiveMessage(Socket& socket, MessageType type, uint64_t maxSize, std::vector<char>& payload, int timeoutMs)
+        {
+            MessageHeader header;
+            return ReceiveHeader(socket, header, timeoutMs) && header.Type == type && ReceivePayload(socket, header, maxSize, payload);
+        }
+
+        static bool IsReadable(const Socket& socket)
+        {
+            std::vector<uint8_t> readable;
+            return Socket::WaitReadable({ &socket }, readable, 0);
+        }
+
+        // The accumulation blocks a region covers, regions start on block boundaries
+        static uint32_t GetBlockCount(const Renderer::Tile& region)
+        {
+            const uint32_t blockSize = Framebuffer::BlockSize;
+            return ((region.MaxX - region.MinX + blockSize - 1) / blockSize) * ((region.MaxY - region.MinY + blockSize - 1) / blockSize);
+        }
+
+        template<typename Function>
+        static void ForEachBlock(const Renderer::Tile& region, Function&& function)
+        {
+            for (uint32_t y = region.MinY; y < region.MaxY; y += Framebuffer::BlockSize)
+            {
+                for (uint32_t x = region.MinX; x < region.MaxX; x += Framebuffer::BlockSize)
+                    function(x, y);
+            }
+        }
+
+        static uint32_t ChooseUnitSize(uint32_t width, uint32_t height, uint32_t workerCount)
+        {
+            uint32_t unitSize = MaxUnitSize;
+            while (unitSize > Renderer::TileSize)
+            {
+                uint32_t unitCount = ((width + unitSize - 1) / unitSize) * ((height + unitSize - 1) / unitSize);
+                if (unitCount >= UnitsPerWorker * workerCount)
+                    break;
+                unitSize /= 2;
+            }
+            return unitSize;
+        }
+
+    }
+
+    bool Coordinator::Listen(const std::string& address, std::string* error)
+    {
+        m_Listener = Socket::Listen(address, error);
+        return m_Listener.IsValid();
+    }
+
+    bool Coordinator::Render(const Scene& scene, const Camera& camera, const Renderer::Settings& settings, uint32_t width, uint32_t height,
+        uint32_t frameCount, Framebuffer& framebuffer, std::string* error)
+    {
+        if (!m_Listener.IsValid())
+            return Utils::Fail(error, "Not listening for workers");
+        if (!width || !height || !frameCount)
+            return Utils::Fail(error, "Nothing to render");
+
+        // Workers save loading time from the BVH stored with the scene
+        std::vector<char> sceneData;
+        if (!SceneFile::Save(sceneData, scene))
+            return Utils::Fail(error, "Failed to serialize the scene");
+
+        Camera jobCamera = camera;
+        jobCamera.OnResize(width, height);
+        m_JobData.resize(sizeof(Camera) + sceneData.size());
+        memcpy(m_JobData.data(), &jobCamera, sizeof(Camera));
+        memcpy(m_JobData.data() + sizeof(Camera), sceneData.data(), sceneData.size());
+
+        m_JobIndex++;
+        m_RenderSettings = settings;
+        m_Width = width;
+        m_Height = height;
+        m_FrameCount = frameCount;
+
+        std::erase_if(m_Workers, [this](const Worker& worker) { return !IsConnected(worker); });
+        const uint32_t workerCount = std::max(m_Settings.MinWorkers, (uint32_t)m_Workers.size());
+
+        uint32_t unitSize = m_Settings.UnitSize ? m_Settings.UnitSize : Utils::ChooseUnitSize(width, height, workerCount);
+        unitSize = std::max((unitSize + Renderer::TileSize - 1) / Renderer::TileSize, 1u) * Renderer::TileSize;
+        m_TilesPerUnit = (unitSize / Renderer::TileSize) * (unitSize / Renderer::TileSize);
+
+        m_Units.clear();
+        m_Queue.clear();
+        uint32_t maxBlockCount = 0;
+        for (uint32_t y = 0; y < height; y += unitSize)
+        {
+            for (uint32_t x = 0; x < width; x += unitSize)
+            {
+                m_Queue.push_back((uint32_t)m_Units.size());
+                m_Units.push_back({ { x, y, std::min(x + unitSize, width), std::min(y + unitSize, height) }, false, true });
+                maxBlockCount = std::max(maxBlockCount, Utils::GetBlockCount(m_Units.back().Region));
+            }
+        }
+        m_MaxResultSize = sizeof(Utils::ResultMessage) + (uint64_t)maxBlockCount * sizeof(Framebuffer::AccumulationBlock);
+        m_DoneCount = 0;
+        m_ReissuedUnitCount = 0;
+        m_SlowestBatchMs = 0.0;
+        m_Started = false;
+
+        framebuffer.Resize(width, height);
+        framebuffer.ClearAccumulation();
+
+        for (Worker& worker : m_Workers)
+        {
+            worker.Stats = { worker.Stats.ThreadCount };
+            worker.Assigned.clear();
+            worker.Stalled = false;
+            if (!SendJob(worker))
+                DropWorker(worker);
+        }
+
+        std::vector<const Socket*> sockets;
+        std::vector<uint8_t> readable;
+        while (m_DoneCount < (uint32_t)m_Units.size())
+        {
+            AssignUnits();
+
+            sockets.assign(1, &m_Listener);
+            for (const Worker& worker : m_Workers)
+                sockets.push_back(&worker.Connection);
+            for (const PendingWorker& pending : m_PendingWorkers)
+                sockets.push_back(&pending.Connection);
+            // Closed connections are never readable, they only keep the indices in step
+            for (const Socket*& socket : sockets)
+            {
+                if (!socket->IsValid())
+                    socket = &m_Listener;
+            }
+
+            if (Socket::WaitReadable(sockets, readable, Utils::PollIntervalMs))
+            {
+                // Workers first, handshakes can grow m_Workers and accepting m_PendingWorkers
+                const size_t workerCount = m_Workers.size();
+                for (size_t i = 0; i < workerCount; i++)
+                {
+                    if (readable[1 + i] && sockets[1 + i] != &m_Listener)
+                        ReceiveResult(m_Workers[i], framebuffer);
+                }
+                for (size_t i = 1 + workerCount; i < sockets.size(); i++)
+                {
+                    if (readable[i] && sockets[i] != &m_Listener)
+                        ContinueHandshake(m_PendingWorkers[i - 1 - workerCount]);
+                }
+                if (readable[0])
+                    AcceptWorker();
+            }
+
+            // Finished, refused and silent handshakes leave the poll set
+            const auto now = std::chrono::steady_clock::now();
+            std::erase_if(m_PendingWorkers, [&](const PendingWorker& pending)
+            {
+                return !pending.Connection.IsValid() || now - pending.AcceptTime > std::chrono::milliseconds(Utils::HandshakeTimeoutMs);
+            });
+
+            CheckTimeouts();
+        }
+
+        for (Worker& worker : m_Workers)
+        {
+            if (IsConnected(worker) && !Utils::SendMessage(worker.Connection, Utils::MessageType::JobDone, nullptr, 0))
+                worker.Connection.Close();
+            worker.Assigned.clear();
+        }
+        return true;
+    }
+
+    std::vector<Coordinator::WorkerStats> Coordinator::GetWorkerStats() const
+    {
+        std::vector<WorkerStats> stats;
+        for (const Worker& worker : m_Workers)
+        {
+            stats.push_back(worker.Stats);
+            stats.back().Connected = IsConnected(worker);
+        }
+        return stats;
+    }
+
+    void Coordinator::AcceptWorker()
+    {
+        PendingWorker pending;
+        pending.Connection = m_Listener.Accept();
+        if (!pending.Connection.IsValid())
+            return;
+
+        pending.AcceptTime = std::chrono::steady_clock::now();
+        m_PendingWorkers.push_back(std::move(pending));
+    }
+
+    void Coordinator::ContinueHandshake(PendingWorker& pending)
+    {
+        constexpr size_t helloSize = sizeof(Utils::MessageHeader) + sizeof(Utils::HelloMessage);
+        char data[helloSize];
+        const size_t received = pending.Connection.ReceiveAvailable(data, helloSize - pending.Received.size());
+        if (received == 0)
+        {
+            pending.Connection.Close();
+            return;
+        }
+        pending.Received.insert(pending.Received.end(), data, data + received);
+
+        // Anything that isn't a worker of this very build is turned away, as soon as the header gives it away
+        Utils::MessageHeader header;
+        if (pending.Received.size() >= sizeof(header))
+        {
+            memcpy(&header, pending.Received.data(), sizeof(header));
+            if (header.Type != Utils::MessageType::Hello || header.Size != sizeof(Utils::HelloMessage))
+            {
+                pending.Connection.Close();
+                return;
+            }
+        }
+        if (pending.Received.size() < helloSize)
+            return;
+
+        Utils::HelloMessage hello;
+        memcpy(&hello, pending.Received.data() + sizeof(header), sizeof(hello));
+        if (hello.Magic != Utils::Magic || hello.Version != Utils::Version || hello.SettingsSize != sizeof(Renderer::Settings)
+            || hello.CameraSize != sizeof(Camera) || hello.BlockSize != Framebuffer::BlockSize)
+        {
+            pending.Connection.Close();
+            return;
+        }
+
+        Worker worker;
+        worker.Connection = std::move(pending.Connection);
+        worker.Stats.ThreadCount = std::max(hello.ThreadCount, 1u);
+        if (!SendJob(worker))
+            return;
+        m_Workers.push_back(std::move(worker));
+    }
+
+    bool Coordinator::SendJob(Worker& worker)
+    {
+        worker.BatchSize = std::max((Utils::TilesPerThread * worker.Stats.ThreadCount + m_TilesPerUnit - 1) / m_TilesPerUnit, 1u);
+
+        Utils::JobMessage job = {};
+        job.JobIndex = m_JobIndex;
+        job.Width = m_Width;
+        job.Height = m_Height;
+        job.FrameCount = m_FrameCount;
+        job.BatchSize = worker.BatchSize;
+        job.Settings = m_RenderSettings;
+        return Utils::SendMessage(worker.Connection, Utils::MessageType::Job, &job, sizeof(job), m_JobData.data(), m_JobData.size());
+    }
+
+    void Coordinator::ReceiveResult(Worker& worker, Framebuffer& framebuffer)
+    {
+        std::vector<char> payload;
+        Utils::ResultMessage result;
+        if (!Utils::ReceiveMessage(worker.Connection, Utils::MessageType::Result, m_MaxResultSize, payload, Utils::MessageTimeoutMs)
+            || payload.size() < sizeof(result))
+        {
+            DropWorker(worker);
+            return;
+        }
+
+        memcpy(&result, payload.data(), sizeof(result));
+        if (result.JobIndex != m_JobIndex)
+            return; // Late answer to an earlier job
+
+        if (result.UnitIndex >= (uint32_t)m_Units.size()
+            || payload.size() != sizeof(result) + Utils::GetBlockCount(m_Units[result.UnitIndex].Region) * sizeof(Framebuffer::AccumulationBlock))
+        {
+            DropWorker(worker);
+            return;
+        }
+
+        std::erase(worker.Assigned, result.UnitIndex);
+        worker.LastProgress = std::chrono::steady_clock::now();
+        worker.Stalled = false;
+        m_SlowestBatchMs = std::max(m_SlowestBatchMs, result.BatchMs);
+
+        // The first result of a unit wins, copies from workers it was reissued to are dropped
+        Unit& unit = m_Units[result.UnitIndex];
+        if (unit.Done)
+            return;
+
+        const char* blocks = payload.data() + sizeof(result);
+        Utils::ForEachBlock(unit.Region, [&](uint32_t x, uint32_t y)
+        {
+            memcpy(&framebuffer.GetBlock(x, y), blocks, sizeof(Framebuffer::AccumulationBlock));
+            blocks += sizeof(Framebuffer::AccumulationBlock);
+        });
+
+        unit.Done = true;
+        m_DoneCount++;
+        worker.Stats.UnitCount++;
+        worker.Stats.RayCount += result.RayCount;
+        worker.Stats.RenderMs += result.RenderMs;
+    }
+
+    void Coordinator::CheckTimeouts()
+    {
+        double timeoutMs = m_Settings.TimeoutMs;
+        if (timeoutMs <= 0.0)
+            timeoutMs = m_SlowestBatchMs > 0.0 ? std::max(Utils::MinTimeoutMs, Utils::TimeoutFactor * m_SlowestBatchMs) : Utils::InitialTimeoutMs;
+
+        // A stalled worker keeps its units in case it answers after all, other workers get them too
+        const auto now = std::chrono::steady_clock::now();
+        for (Worker& worker : m_Workers)
+        {
+            if (!IsConnected(worker) || worker.Stalled || worker.Assigned.empty()
+                || std::chrono::duration<double, std::milli>(now - worker.LastProgress).count() < timeoutMs)
+                continue;
+
+            worker.Stalled = true;
+            worker.Stats.TimeoutCount++;
+            for (uint32_t unitIndex : worker.Assigned)
+                Requeue(unitIndex);
+        }
+    }
+
+    void Coordinator::AssignUnits()
+    {
+        uint32_t connectedCount = 0;
+        for (const Worker& worker : m_Workers)
+            connectedCount += IsConnected(worker) ? 1 : 0;
+        if (!m_Started && connectedCount < m_Settings.MinWorkers)
+            return;
+        m_Started = true;
+
+        // Two batches per worker, so the next one is already there when it finishes one
+        for (Worker& worker : m_Workers)
+        {
+            if (!IsConnected(worker) || worker.Stalled)
+                continue;
+
+            while (worker.Assigned.size() < 2 * worker.BatchSize)
+            {
+                uint32_t unitIndex = UINT32_MAX;
+                while (!m_Queue.empty() && unitIndex == UINT32_MAX)
+                {
+                    const uint32_t queued = m_Queue.front();
+                    m_Queue.pop_front();
+                    m_Units[queued].Queued = false;
+                    if (!m_Units[queued].Done)
+                        unitIndex = queued;
+                }
+
+                // Once the queue runs dry an idle worker duplicates the unit that waited longest at a busier one,
+                // so the last units don't hold up the whole frame
+                if (unitIndex == UINT32_MAX && worker.Assigned.empty())
+                {
+                    for (const Worker& other : m_Workers)
+                    {
+                        if (&other == &worker || !IsConnected(other))
+                            continue;
+
+                        for (auto it = other.Assigned.rbegin(); it != other.Assigned.rend(); ++it)
+                        {
+                            if (!m_Units[*it].Done && std::find(worker.Assigned.begin(), worker.Assigned.end(), *it) == worker.Assigned.end())
+                            {
+                                unitIndex = *it;
+                                break;
+                            }
+                        }
+                        if (unitIndex != UINT32_MAX)
+                            break;
+                    }
+                }
+                if (unitIndex == UINT32_MAX)
+                    break;
+
+                const Utils::AssignMessage assign = { m_JobIndex, unitIndex, m_Units[unitIndex].Region };
+                if (!Utils::SendMessage(worker.Connection, Utils::MessageType::Assign, &assign, sizeof(assign)))
+                {
+                    Requeue(unitIndex);
+                    DropWorker(worker);
+                    break;
+                }
+
+                if (worker.Assigned.empty())
+                    worker.LastProgress = std::chrono::steady_clock::now();
+                worker.Assigned.push_back(unitIndex);
+            }
+        }
+    }
+
+    void Coordinator::DropWorker(Worker& worker)
+    {
+        worker.Connection.Close();
+        for (uint32_t unitIndex : worker.Assigned)
+            Requeue(unitIndex);
+        worker.Assigned.clear();
+    }
+
+    void Coordinator::Requeue(uint32_t unitIndex)
+    {
+        Unit& unit = m_Units[unitIndex];
+        if (unit.Done || unit.Queued)
+            return;
+
+        unit.Queued = true;
+        m_Queue.push_front(unitIndex);
+        m_ReissuedUnitCount++;
+    }
+
+    bool RunWorker(const std::string& address, uint32_t threadCount, bool pinThreads, std::string* error)
+    {
+        Socket connection;
+        const auto connectStart = std::chrono::steady_clock::now();
+        while (true)
+        {
+            connection = Socket::Connect(address, error);
+            if (connection.IsValid())
+                break;
+            if (std::chrono::steady_clock::now() - connectStart > std::chrono::milliseconds(Utils::ConnectTimeoutMs))
+                return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(Utils::ConnectRetryMs));
+        }
+
+        const uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        const Utils::HelloMessage hello = { Utils::Magic, Utils::Version, sizeof(Renderer::Settings), sizeof(Camera), Framebuffer::BlockSize,
+            threadCount ? threadCount : hardwareThreads };
+        if (!Utils::SendMessage(connection, Utils::MessageType::Hello, &hello, sizeof(hello)))
+            return Utils::Fail(error, "Lost the connection to the coordinator");
+
+        Renderer renderer;
+        Scene scene;
+        std::optional<Camera> camera;
+        Utils::JobMessage job = {};
+        std::vector<Utils::AssignMessage> batch;
+        std::vector<Renderer::Tile> regions;
+        Utils::MessageHeader header;
+        std::vector<char> payload, result;
+        while (true)
+        {
+            // Everything assigned so far, up to a batch, renders together
+            if (!batch.empty() && (batch.size() >= job.BatchSize || !Utils::IsReadable(connection)))
+            {
+                regions.clear();
+                for (const Utils::AssignMessage& assign : batch)
+                    regions.push_back(assign.Region);
+                renderer.SetRenderRegions(regions);
+
+                const auto start = std::chrono::steady_clock::now();
+                uint64_t rayCount = 0;
+                for (uint32_t frame = 0; frame < job.FrameCount; frame++)
+                {
+                    renderer.Render(scene, *camera);
+                    rayCount += renderer.GetLastRayCount();
+                }
+                const double batchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                const Framebuffer& framebuffer = renderer.GetFramebuffer();
+                for (const Utils::AssignMessage& assign : batch)
+                {
+                    const Utils::ResultMessage message = { job.JobIndex, assign.UnitIndex, rayCount / batch.size(), batchMs / batch.size(), batchMs };
+                    result.resize(sizeof(message) + Utils::GetBlockCount(assign.Region) * sizeof(Framebuffer::AccumulationBlock));
+                    memcpy(result.data(), &message, sizeof(message));
+
+                    char* blocks = result.data() + sizeof(message);
+                    Utils::ForEachBlock(assign.Region, [&](uint32_t x, uint32_t y)
+                    {
+                        memcpy(blocks, &framebuffer.GetBlock(x, y), sizeof(Framebuffer::AccumulationBlock));
+                        blocks += sizeof(Framebuffer::AccumulationBlock);
+                    });
+
+                    // A coordinator that has all it needs may close the connection before the last duplicates arrive
+                    if (!Utils::SendMessage(connection, Utils::MessageType::Result, result.data(), result.size()))
+                        return true;
+                }
+                batch.clear();
+                continue;
+            }
+
+            // The coordinator closing the connection is the normal end
+            if (!Utils::ReceiveHeader(connection, header, -1))
+                return true;
+
+            uint64_t maxSize = 0;
+            if (header.Type == Utils::MessageType::Job)
+                maxSize = Utils::MaxMessageSize;
+            else if (header.Type == Utils::MessageType::Assign)
+                maxSize = sizeof(Utils::AssignMessage);
+            else if (header.Type != Utils::MessageType::JobDone)
+                return Utils::Fail(error, "Unexpected message from the coordinator");
+
+            if (!Utils::ReceivePayload(connection, header, maxSize, payload))
+                return Utils::Fail(error, "Lost the connection to the coordinator");
+
+            switch (header.Type)
+            {
+            case Utils::MessageType::Job:
+            {
+                if (payload.size() < sizeof(job) + sizeof(Camera))
+                    return Utils::Fail(error, "Malformed job");
+
+                memcpy(&job, payload.data(), sizeof(job));
+                camera.emplace(45.0f, 0.1f, 100.0f);
+                memcpy(&*camera, payload.data() + sizeof(job), sizeof(Camera));
+
+                BVH sphereBVH;
+                const size_t sceneOffset = sizeof(job) + sizeof(Camera);
+                if (!SceneFile::Load(payload.data() + sceneOffset, payload.size() - sceneOffset, scene, &sphereBVH, error))
+                    return false;
+
+                // Only what this process can do differently, the rest has to match for the image to come out the same
+                Renderer::Settings& settings = renderer.GetSettings();
+                settings = job.Settings;
+                settings.ThreadCount = threadCount;
+                settings.PinThreads = pinThreads;
+                settings.Serial = false;
+                settings.CollectStats = false;
+                settings.Accumulate = true;
+                settings.Reprojection = false;
+                settings.Denoise = false;
+                settings.FrameBudgetMs = 0.0f;
+
+                renderer.OnResize(job.Width, job.Height);
+                renderer.SetSphereBVH(std::move(sphereBVH));
+                job.BatchSize = std::max(job.BatchSize, 1u);
+                batch.clear();
+                break;
+            }
+            case Utils::MessageType::Assign:
+            {
+                Utils::AssignMessage assign;
+                if (payload.size() != sizeof(assign) || !camera)
+                    return Utils::Fail(error, "Malformed assignment");
+
+                memcpy(&assign, payload.data(), sizeof(assign));
+                const Renderer::Tile& region = assign.Region;
+                if (region.MinX % Framebuffer::BlockSize || region.MinY % Framebuffer::BlockSize || region.MinX >= region.MaxX || region.MinY >= region.MaxY
+                    || region.MaxX > job.Width || region.MaxY > job.Height)
+                    return Utils::Fail(error, "Malformed assignment");
+
+                if (assign.JobIndex == job.JobIndex)
+                    batch.push_back(assign);
+                break;
+            }
+            case Utils::MessageType::JobDone:
+                batch.clear();
+                break;
+            default:
+                return Utils::Fail(error, "Unexpected message from the coordinator");
+            }
+        }
+    }
+
+}
\ No newline at end of file
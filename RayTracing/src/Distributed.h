@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Socket.h"
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace RayTracing::Distributed {
+
+    // Splits final frames into square units of tiles and renders them on worker processes. Each worker gets the
+    // scene, camera and settings once per job, then unit assignments; it renders every frame of a unit and sends
+    // back the accumulated radiance, which is merged into the framebuffer as it arrives. Units are handed out
+    // as workers finish the previous ones, so faster workers take more of them. The seeds only depend on the
+    // pixel and sample, the merged image is the one a local Render would have accumulated
+    class Coordinator
+    {
+    public:
+        struct Settings
+        {
+            uint32_t MinWorkers = 1; // Rendering starts once this many are connected, more can join later
+            float TimeoutMs = 0.0f; // Units a worker sat on this long go to others. 0 = a multiple of the slowest batch so far
+            uint32_t UnitSize = 0; // Edge of a unit in pixels, a multiple of Renderer::TileSize. 0 = by image size and worker count
+        };
+
+        struct WorkerStats
+        {
+            uint32_t ThreadCount = 0;
+            uint32_t UnitCount = 0; // Results merged into the image, duplicates not included
+            uint32_t TimeoutCount = 0;
+            uint64_t RayCount = 0;
+            double RenderMs = 0.0; // Time the worker spent rendering the merged units
+            bool Connected = true;
+        };
+    public:
+        Coordinator() = default;
+
+        bool Listen(const std::string& address, std::string* error = nullptr);
+        // Renders frameCount accumulated frames of width x height pixels on the workers and leaves the accumulation
+        // in framebuffer, resized to fit. Blocks until every unit is merged, waiting for workers as long as it takes
+        bool Render(const Scene& scene, const Camera& camera, const Renderer::Settings& settings, uint32_t width, uint32_t height,
+            uint32_t frameCount, Framebuffer& framebuffer, std::string* error = nullptr);
+
+        // Of the last Render, one entry per worker that took part
+        std::vector<WorkerStats> GetWorkerStats() const;
+        // Units of the last Render handed to a second worker, because the first timed out or dropped out
+        uint32_t GetReissuedUnitCount() const { return m_ReissuedUnitCount; }
+        Settings& GetSettings() { return m_Settings; }
+    private:
+        struct Unit
+        {
+            Renderer::Tile Region;
+            bool Done = false;
+            bool Queued = false;
+        };
+
+        // Connected, but the hello isn't complete yet. Read as it arrives, so a peer that sends nothing holds up
+        // nobody and is closed after the handshake timeout
+        struct PendingWorker
+        {
+            Socket Connection;
+            std::vector<char> Received; // Header and hello, at most
+            std::chrono::steady_clock::time_point AcceptTime;
+        };
+
+        struct Worker
+        {
+            Socket Connection;
+            WorkerStats Stats;
+            uint32_t BatchSize = 1;
+            std::vector<uint32_t> Assigned; // Sent and not answered yet, in order
+            std::chrono::steady_clock::time_point LastProgress;
+            bool Stalled = false; // Timed out, gets no more units until it answers
+        };
+
+        void AcceptWorker();
+        // Reads what arrived of the hello and adds the worker once it is complete, closes the connection if it isn't one
+        void ContinueHandshake(PendingWorker& pending);
+        bool SendJob(Worker& worker);
+        void ReceiveResult(Worker& worker, Framebuffer& framebuffer);
+        void CheckTimeouts();
+        void AssignUnits();
+        void DropWorker(Worker& worker);
+        void Requeue(uint32_t unitIndex);
+        bool IsConnected(const Worker& worker) const { return worker.Connection.IsValid(); }
+    private:
+        Settings m_Settings;
+        Socket m_Listener;
+        std::vector<Worker> m_Workers;
+        std::vector<PendingWorker> m_PendingWorkers;
+
+        // State of the job being rendered
+        uint32_t m_JobIndex = 0;
+        std::vector<char> m_JobData; // Camera and .rtscene image, the same for every worker
+        Renderer::Settings m_RenderSettings;
+        uint32_t m_Width = 0, m_Height = 0, m_FrameCount = 0;
+        uint32_t m_TilesPerUnit = 1;
+        uint64_t m_MaxResultSize = 0; // Of the largest unit
+        std::vector<Unit> m_Units;
+        std::deque<uint32_t> m_Queue;
+        uint32_t m_DoneCount = 0;
+        uint32_t m_ReissuedUnitCount = 0;
+        double m_SlowestBatchMs = 0.0;
+        bool m_Started = false;
+    };
+
+    // Connects to a coordinator, retrying for a few seconds in case it is still starting, and renders what it
+    // assigns until it closes the connection. threadCount and pinThreads replace the coordinator's settings
+    bool RunWorker(const std::string& address, uint32_t threadCount, bool pinThreads, std::string* error = nullptr);
+
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "Framebuffer.h"
+
+#include <cstring>
+
+namespace RayTracing {
+
+    bool Framebuffer::Resize(uint32_t width, uint32_t height)
+    {
+        if (width == m_Width && height == m_Height)
+            return false;
+
+        m_Width = width;
+        m_Height = height;
+        m_BlockCountX = (width + BlockSize - 1) / BlockSize;
+        m_BlockCountY = (height + BlockSize - 1) / BlockSize;
+
+        m_ImageData.Reserve((size_t)width * height);
+        m_AccumulationData.Reserve((size_t)m_BlockCountX * m_BlockCountY);
+        if (m_FeaturesEnabled)
+            SetFeaturesEnabled(true);
+
+        return true;
+    }
+
+    void Framebuffer::SetFeaturesEnabled(bool enabled)
+    {
+        m_FeaturesEnabled = enabled;
+        if (!enabled)
+            return;
+
+        const size_t blockCount = (size_t)m_BlockCountX * m_BlockCountY;
+        m_FeatureData.Reserve(blockCount);
+        m_DenoisedData.Reserve(blockCount);
+        memset(m_FeatureData.GetData(), 0, blockCount * sizeof(SurfaceBlock));
+        memset(m_DenoisedData.GetData(), 0, blockCount * sizeof(AccumulationBlock));
+    }
+
+    void Framebuffer::ReserveHistory()
+    {
+        const size_t blockCount = (size_t)m_BlockCountX * m_BlockCountY;
+        m_SurfaceData.Reserve(blockCount);
+        m_HistoryData.Reserve(blockCount);
+        m_HistorySurfaceData.Reserve(blockCount);
+    }
+
+    void Framebuffer::SwapHistory()
+    {
+        m_AccumulationData.Swap(m_HistoryData);
+        m_SurfaceData.Swap(m_HistorySurfaceData);
+    }
+
+    void Framebuffer::ClearAccumulation()
+    {
+        memset(m_AccumulationData.GetData(), 0, (size_t)m_BlockCountX * m_BlockCountY * sizeof(AccumulationBlock));
+        if (m_FeaturesEnabled)
+            memset(m_FeatureData.GetData(), 0, (size_t)m_BlockCountX * m_BlockCountY * sizeof(SurfaceBlock));
+    }
+
+    void Framebuffer::ClearAccumulation(uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY)
+    {
+        for (uint32_t y = minY; y < maxY; y++)
+        {
+            for (uint32_t x = minX; x < maxX; x++)
+            {
+                AccumulationBlock& block = GetBlock(x, y);
+                const uint32_t pixel = GetBlockPixel(x, y);
+                block.Red[pixel] = block.Green[pixel] = block.Blue[pixel] = 0.0f;
+                block.LuminanceMoment[pixel] = 0.0f;
+                block.SampleCount[pixel] = 0;
+
+                if (m_FeaturesEnabled)
+                {
+                    SurfaceBlock& features = GetFeatureBlock(x, y);
+                    features.Depth[pixel] = features.NormalX[pixel] = features.NormalY[pixel] = features.NormalZ[pixel] = 0.0f;
+                    features.AlbedoR[pixel] = features.AlbedoG[pixel] = features.AlbedoB[pixel] = 0.0f;
+                }
+            }
+        }
+    }
+
+}
\ No newline at end of file
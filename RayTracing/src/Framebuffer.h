@@ -0,0 +1,155 @@
+#pragma once
+
+#include "AlignedBuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+namespace RayTracing {
+
+    // CPU side render target, keeps the renderer independent of any windowing or graphics API.
+    // The presentation layer (Walnut::Image, a file on disk, ...) reads the final image from here.
+    class Framebuffer
+    {
+    public:
+        static constexpr uint32_t BlockSize = 8;
+        static constexpr uint32_t BlockPixelCount = BlockSize * BlockSize;
+
+        // Accumulated samples of an 8x8 pixel block. One plane per channel, so a block row is one 8 wide vector
+        // and the pixels a worker touches stay within a few cache lines
+        struct alignas(64) AccumulationBlock
+        {
+            float Red[BlockPixelCount];
+            float Green[BlockPixelCount];
+            float Blue[BlockPixelCount];
+            float LuminanceMoment[BlockPixelCount]; // Sum of squared sample luminance, for variance estimates
+            uint32_t SampleCount[BlockPixelCount];
+        };
+
+        // First hit of a pixel's rays. The surfaces used to match pixels between two views hold the ray through
+        // the pixel's sample position, the features the denoiser is guided by hold sums over all of its samples.
+        // Depth is the distance from the camera. A ray that hit nothing adds depth 0, a zero normal and albedo 1
+        struct alignas(64) SurfaceBlock
+        {
+            float Depth[BlockPixelCount];
+            float NormalX[BlockPixelCount];
+            float NormalY[BlockPixelCount];
+            float NormalZ[BlockPixelCount];
+            float AlbedoR[BlockPixelCount];
+            float AlbedoG[BlockPixelCount];
+            float AlbedoB[BlockPixelCount];
+        };
+    public:
+        Framebuffer() = default;
+
+        Framebuffer(const Framebuffer&) = delete;
+        Framebuffer& operator=(const Framebuffer&) = delete;
+
+        // Returns false if the size did not change
+        bool Resize(uint32_t width, uint32_t height);
+        void ClearAccumulation();
+        // Pixels [minX, maxX) x [minY, maxY) only
+        void ClearAccumulation(uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY);
+
+        void Accumulate(uint32_t x, uint32_t y, const glm::vec3& radiance, uint32_t sampleCount, float luminanceSquared)
+        {
+            AccumulationBlock& block = GetBlock(x, y);
+            const uint32_t pixel = GetBlockPixel(x, y);
+            block.Red[pixel] += radiance.r;
+            block.Green[pixel] += radiance.g;
+            block.Blue[pixel] += radiance.b;
+            block.LuminanceMoment[pixel] += luminanceSquared;
+            block.SampleCount[pixel] += sampleCount;
+        }
+
+        // Replaces what the pixel held, for rendering without accumulation
+        void Store(uint32_t x, uint32_t y, const glm::vec3& radiance, uint32_t sampleCount, float luminanceSquared)
+        {
+            AccumulationBlock& block = GetBlock(x, y);
+            const uint32_t pixel = GetBlockPixel(x, y);
+            block.Red[pixel] = radiance.r;
+            block.Green[pixel] = radiance.g;
+            block.Blue[pixel] = radiance.b;
+            block.LuminanceMoment[pixel] = luminanceSquared;
+            block.SampleCount[pixel] = sampleCount;
+        }
+
+        uint32_t GetSampleCount(uint32_t x, uint32_t y) const { return GetBlock(x, y).SampleCount[GetBlockPixel(x, y)]; }
+        glm::vec3 GetRadianceSum(uint32_t x, uint32_t y) const
+        {
+            const AccumulationBlock& block = GetBlock(x, y);
+            const uint32_t pixel = GetBlockPixel(x, y);
+            return { block.Red[pixel], block.Green[pixel], block.Blue[pixel] };
+        }
+        float GetLuminanceMoment(uint32_t x, uint32_t y) const { return GetBlock(x, y).LuminanceMoment[GetBlockPixel(x, y)]; }
+
+        // Summed first hit albedo, normal and depth of every sample, only kept while enabled. Enabling allocates
+        // them and the denoised blocks, the accumulation has to start over for the sums to cover all samples
+        void SetFeaturesEnabled(bool enabled);
+        bool HasFeatures() const { return m_FeaturesEnabled; }
+        void AccumulateFeatures(uint32_t x, uint32_t y, const glm::vec3& albedo, const glm::vec3& normal, float depth)
+        {
+            SurfaceBlock& block = GetFeatureBlock(x, y);
+            const uint32_t pixel = GetBlockPixel(x, y);
+            block.Depth[pixel] += depth;
+            block.NormalX[pixel] += normal.x;
+            block.NormalY[pixel] += normal.y;
+            block.NormalZ[pixel] += normal.z;
+            block.AlbedoR[pixel] += albedo.r;
+            block.AlbedoG[pixel] += albedo.g;
+            block.AlbedoB[pixel] += albedo.b;
+        }
+        void StoreFeatures(uint32_t x, uint32_t y, const glm::vec3& albedo, const glm::vec3& normal, float depth)
+        {
+            SurfaceBlock& block = GetFeatureBlock(x, y);
+            const uint32_t pixel = GetBlockPixel(x, y);
+            block.Depth[pixel] = depth;
+            block.NormalX[pixel] = normal.x;
+            block.NormalY[pixel] = normal.y;
+            block.NormalZ[pixel] = normal.z;
+            block.AlbedoR[pixel] = albedo.r;
+            block.AlbedoG[pixel] = albedo.g;
+            block.AlbedoB[pixel] = albedo.b;
+        }
+        SurfaceBlock& GetFeatureBlock(uint32_t x, uint32_t y) { return m_FeatureData.GetData()[GetBlockIndex(x, y)]; }
+        const SurfaceBlock& GetFeatureBlock(uint32_t x, uint32_t y) const { return m_FeatureData.GetData()[GetBlockIndex(x, y)]; }
+        // Written by the denoiser, one sample per pixel holding the filtered radiance
+        AccumulationBlock& GetDenoisedBlock(uint32_t x, uint32_t y) { return m_DenoisedData.GetData()[GetBlockIndex(x, y)]; }
+        const AccumulationBlock& GetDenoisedBlock(uint32_t x, uint32_t y) const { return m_DenoisedData.GetData()[GetBlockIndex(x, y)]; }
+
+        AccumulationBlock& GetBlock(uint32_t x, uint32_t y) { return m_AccumulationData.GetData()[GetBlockIndex(x, y)]; }
+        const AccumulationBlock& GetBlock(uint32_t x, uint32_t y) const { return m_AccumulationData.GetData()[GetBlockIndex(x, y)]; }
+        static uint32_t GetBlockPixel(uint32_t x, uint32_t y) { return y % BlockSize * BlockSize + x % BlockSize; }
+
+        // The surfaces and the accumulation of the previous view, only allocated once something reprojects
+        void ReserveHistory();
+        // The current accumulation and surfaces become the history and the other way around
+        void SwapHistory();
+        SurfaceBlock& GetSurfaceBlock(uint32_t x, uint32_t y) { return m_SurfaceData.GetData()[GetBlockIndex(x, y)]; }
+        const AccumulationBlock& GetHistoryBlock(uint32_t x, uint32_t y) const { return m_HistoryData.GetData()[GetBlockIndex(x, y)]; }
+        const SurfaceBlock& GetHistorySurfaceBlock(uint32_t x, uint32_t y) const { return m_HistorySurfaceData.GetData()[GetBlockIndex(x, y)]; }
+
+        uint32_t GetWidth() const { return m_Width; }
+        uint32_t GetHeight() const { return m_Height; }
+
+        // Row major RGBA8, written by the resolve pass
+        uint32_t* GetImageData() { return m_ImageData.GetData(); }
+        const uint32_t* GetImageData() const { return m_ImageData.GetData(); }
+    private:
+        size_t GetBlockIndex(uint32_t x, uint32_t y) const { return (size_t)(y / BlockSize) * m_BlockCountX + x / BlockSize; }
+    private:
+        uint32_t m_Width = 0, m_Height = 0;
+        uint32_t m_BlockCountX = 0, m_BlockCountY = 0;
+
+        AlignedBuffer<uint32_t> m_ImageData;
+        AlignedBuffer<AccumulationBlock> m_AccumulationData;
+        AlignedBuffer<SurfaceBlock> m_SurfaceData;
+        AlignedBuffer<AccumulationBlock> m_HistoryData;
+        AlignedBuffer<SurfaceBlock> m_HistorySurfaceData;
+        AlignedBuffer<SurfaceBlock> m_FeatureData;
+        AlignedBuffer<AccumulationBlock> m_DenoisedData;
+        bool m_FeaturesEnabled = false;
+    };
+
+}
\ No newline at end of file
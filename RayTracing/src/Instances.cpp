@@ -0,0 +1,153 @@
+#include "Instances.h"
+
+#include "RenderStats.h"
+
+namespace RayTracing {
+
+    void InstanceData::Build(const Scene& scene, bool useBVH)
+    {
+        Prototypes.resize(scene.Prototypes.size());
+        std::vector<AABB> prototypeBounds(scene.Prototypes.size());
+        for (size_t i = 0; i < scene.Prototypes.size(); i++)
+        {
+            const std::vector<Sphere>& spheres = scene.Prototypes[i].Spheres;
+            PrototypeData& prototype = Prototypes[i];
+            if (useBVH)
+            {
+                prototype.SphereBVH.Build(spheres);
+                prototype.Spheres.Build(spheres, prototype.SphereBVH.GetPrimitiveIndices());
+            }
+            else
+            {
+                prototype.SphereBVH.Clear();
+                prototype.Spheres.Build(spheres);
+            }
+
+            for (const Sphere& sphere : spheres)
+            {
+                float radius = glm::abs(sphere.Radius);
+                prototypeBounds[i].Grow(sphere.Position - radius);
+                prototypeBounds[i].Grow(sphere.Position + radius);
+            }
+        }
+
+        // World space bounds of the transformed prototype box
+        std::vector<uint32_t> instanceIndices;
+        std::vector<AABB> bounds;
+        std::vector<glm::vec3> centroids;
+        for (uint32_t i = 0; i < (uint32_t)scene.Instances.size(); i++)
+        {
+            const Instance& instance = scene.Instances[i];
+            if (instance.PrototypeIndex >= scene.Prototypes.size() || scene.Prototypes[instance.PrototypeIndex].Spheres.empty())
+                continue;
+
+            const AABB& box = prototypeBounds[instance.PrototypeIndex];
+            AABB& instanceBounds = bounds.emplace_back();
+            for (int corner = 0; corner < 8; corner++)
+            {
+                glm::vec3 point = { corner & 1 ? box.Max.x : box.Min.x, corner & 2 ? box.Max.y : box.Min.y, corner & 4 ? box.Max.z : box.Min.z };
+                instanceBounds.Grow(glm::vec3(instance.Transform * glm::vec4(point, 1.0f)));
+            }
+            centroids.push_back((instanceBounds.Min + instanceBounds.Max) * 0.5f);
+            instanceIndices.push_back(i);
+        }
+
+        Count = (uint32_t)instanceIndices.size();
+        if (useBVH)
+            TopLevel.Build(bounds, centroids);
+        else
+            TopLevel.Clear();
+
+        WorldToObject.resize(Count);
+        PrototypeIndices.resize(Count);
+        InstanceIndices.resize(Count);
+        for (uint32_t slot = 0; slot < Count; slot++)
+        {
+            uint32_t instanceIndex = instanceIndices[useBVH ? TopLevel.GetPrimitiveIndices()[slot] : slot];
+            const Instance& instance = scene.Instances[instanceIndex];
+            WorldToObject[slot] = glm::inverse(instance.Transform);
+            PrototypeIndices[slot] = instance.PrototypeIndex;
+            InstanceIndices[slot] = instanceIndex;
+        }
+    }
+
+    template<bool Stats>
+    int InstanceData::Intersect(const Ray& ray, SphereKernels::IntersectFunc intersect, float& hitDistance, uint32_t& sphereSlot) const
+    {
+        int closestSlot = -1;
+        auto intersectInstances = [&](uint32_t first, uint32_t count)
+        {
+            for (uint32_t slot = first; slot < first + count; slot++)
+            {
+                // The direction is not renormalized, so distances along the ray are the same in both spaces
+                const glm::mat4& worldToObject = WorldToObject[slot];
+                Ray objectRay;
+                objectRay.Origin = glm::vec3(worldToObject * glm::vec4(ray.Origin, 1.0f));
+                objectRay.Direction = glm::vec3(worldToObject * glm::vec4(ray.Direction, 0.0f));
+
+                const PrototypeData& prototype = Prototypes[PrototypeIndices[slot]];
+                int hitSlot;
+                if (prototype.SphereBVH.IsEmpty())
+                {
+                    hitSlot = intersect(prototype.Spheres, objectRay, 0, prototype.Spheres.Count, hitDistance);
+                    RT_STATS_ADD_IF(Stats, SphereTests, prototype.Spheres.Count);
+                }
+                else
+                {
+                    hitSlot = prototype.SphereBVH.Intersect<Stats>(objectRay, prototype.Spheres, intersect, hitDistance);
+                }
+
+                if (hitSlot >= 0)
+                {
+                    closestSlot = (int)slot;
+                    sphereSlot = (uint32_t)hitSlot;
+                }
+            }
+        };
+
+        if (TopLevel.IsEmpty())
+            intersectInstances(0, Count);
+        else
+            TopLevel.Traverse(ray, hitDistance, intersectInstances);
+        return closestSlot;
+    }
+
+    template<bool Stats>
+    bool InstanceData::Occluded(const Ray& ray, SphereKernels::IntersectFunc intersect, float maxDistance) const
+    {
+        auto occludedByInstances = [&](uint32_t first, uint32_t count)
+        {
+            for (uint32_t slot = first; slot < first + count; slot++)
+            {
+                const glm::mat4& worldToObject = WorldToObject[slot];
+                Ray objectRay;
+                objectRay.Origin = glm::vec3(worldToObject * glm::vec4(ray.Origin, 1.0f));
+                objectRay.Direction = glm::vec3(worldToObject * glm::vec4(ray.Direction, 0.0f));
+
+                const PrototypeData& prototype = Prototypes[PrototypeIndices[slot]];
+                if (prototype.SphereBVH.IsEmpty())
+                {
+                    float hitDistance = maxDistance;
+                    RT_STATS_ADD_IF(Stats, SphereTests, prototype.Spheres.Count);
+                    if (intersect(prototype.Spheres, objectRay, 0, prototype.Spheres.Count, hitDistance) >= 0)
+                        return true;
+                }
+                else if (prototype.SphereBVH.Occluded<Stats>(objectRay, prototype.Spheres, intersect, maxDistance))
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        if (TopLevel.IsEmpty())
+            return occludedByInstances(0, Count);
+        return TopLevel.TraverseAny(ray, maxDistance, occludedByInstances);
+    }
+
+    template int InstanceData::Intersect<false>(const Ray&, SphereKernels::IntersectFunc, float&, uint32_t&) const;
+    template int InstanceData::Intersect<true>(const Ray&, SphereKernels::IntersectFunc, float&, uint32_t&) const;
+    template bool InstanceData::Occluded<false>(const Ray&, SphereKernels::IntersectFunc, float) const;
+    template bool InstanceData::Occluded<true>(const Ray&, SphereKernels::IntersectFunc, float) const;
+
+}
\ No newline at end of file
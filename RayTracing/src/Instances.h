@@ -0,0 +1,43 @@
+#pragma once
+
+#include "BVH.h"
+#include "Ray.h"
+#include "Scene.h"
+#include "SphereKernels.h"
+
+#include <vector>
+
+namespace RayTracing {
+
+    // Two level acceleration structure for Scene::Prototypes and Scene::Instances: a BVH per prototype over its
+    // spheres in prototype space, and a top level BVH over the instances' world space bounds. Instance slots are
+    // stored in top level BVH order like SphereSoA, InstanceIndices maps a slot back to Scene::Instances.
+    struct InstanceData
+    {
+        struct PrototypeData
+        {
+            BVH SphereBVH; // Empty when built without BVHs
+            SphereSoA Spheres;
+        };
+
+        std::vector<PrototypeData> Prototypes;
+        BVH TopLevel; // Empty when built without BVHs
+
+        // Per slot. Instances with a missing or empty prototype get no slot
+        std::vector<glm::mat4> WorldToObject;
+        std::vector<uint32_t> PrototypeIndices;
+        std::vector<uint32_t> InstanceIndices;
+        uint32_t Count = 0;
+
+        void Build(const Scene& scene, bool useBVH);
+
+        // Closest hit closer than hitDistance. Returns the instance slot and the prototype's SoA slot in
+        // sphereSlot and shrinks hitDistance, or -1 on miss. Stats = count the sphere tests into t_RenderStats
+        template<bool Stats>
+        int Intersect(const Ray& ray, SphereKernels::IntersectFunc intersect, float& hitDistance, uint32_t& sphereSlot) const;
+        // Whether any instance is hit closer than maxDistance, stops at the first one found
+        template<bool Stats>
+        bool Occluded(const Ray& ray, SphereKernels::IntersectFunc intersect, float maxDistance) const;
+    };
+
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Ray.h"
+
+#include <glm/glm.hpp>
+
+#include <limits>
+
+namespace RayTracing::Intersection {
+
+    // Slab test, returns the entry distance or float max if the box is missed or lies beyond maxDistance
+    inline float RayAABB(const Ray& ray, const glm::vec3& inverseDirection, const glm::vec3& boxMin, const glm::vec3& boxMax, float maxDistance)
+    {
+        float tx0 = (boxMin.x - ray.Origin.x) * inverseDirection.x, tx1 = (boxMax.x - ray.Origin.x) * inverseDirection.x;
+        float ty0 = (boxMin.y - ray.Origin.y) * inverseDirection.y, ty1 = (boxMax.y - ray.Origin.y) * inverseDirection.y;
+        float tz0 = (boxMin.z - ray.Origin.z) * inverseDirection.z, tz1 = (boxMax.z - ray.Origin.z) * inverseDirection.z;
+
+        float tNear = glm::max(glm::max(glm::min(tx0, tx1), glm::min(ty0, ty1)), glm::min(tz0, tz1));
+        float tFar = glm::min(glm::min(glm::max(tx0, tx1), glm::max(ty0, ty1)), glm::max(tz0, tz1));
+
+        if (tFar < tNear || tFar <= 0.0f || tNear >= maxDistance)
+            return std::numeric_limits<float>::max();
+
+        return tNear;
+    }
+
+    // Moller-Trumbore, two sided. Returns the hit distance or float max if the triangle is missed or lies beyond maxDistance
+    inline float RayTriangle(const Ray& ray, const glm::vec3& vertex0, const glm::vec3& edge1, const glm::vec3& edge2, float maxDistance)
+    {
+        glm::vec3 p = glm::cross(ray.Direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (determinant == 0.0f)
+            return std::numeric_limits<float>::max(); // Ray parallel to the triangle or degenerate triangle
+
+        float inverseDeterminant = 1.0f / determinant;
+        glm::vec3 s = ray.Origin - vertex0;
+        float u = glm::dot(s, p) * inverseDeterminant;
+        if (u < 0.0f || u > 1.0f)
+            return std::numeric_limits<float>::max();
+
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(ray.Direction, q) * inverseDeterminant;
+        if (v < 0.0f || u + v > 1.0f)
+            return std::numeric_limits<float>::max();
+
+        float t = glm::dot(edge2, q) * inverseDeterminant;
+        if (t <= 0.0f || t >= maxDistance)
+            return std::numeric_limits<float>::max();
+
+        return t;
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "Lights.h"
+
+#include "Utils.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace RayTracing {
+
+    namespace Utils {
+
+        // 1 - cos of the half angle of the cone a sphere covers, stable for distant spheres where the cosine is
+        // close to 1. Negative inside the sphere
+        static float ConeSolidAngleFactor(const LightData::Light& light, const glm::vec3& position, float& distanceSquared)
+        {
+            glm::vec3 toCenter = light.Position - position;
+            distanceSquared = glm::dot(toCenter, toCenter);
+            float sinSquared = light.Radius * light.Radius / distanceSquared;
+            if (sinSquared >= 1.0f)
+                return -1.0f;
+
+            return sinSquared / (1.0f + glm::sqrt(1.0f - sinSquared));
+        }
+
+    }
+
+    void LightData::Build(const Scene& scene)
+    {
+        Lights.clear();
+        CumulativeProbabilities.clear();
+        SphereLights.clear();
+
+        std::vector<uint32_t> emissive;
+        for (uint32_t i = 0; i < (uint32_t)scene.Spheres.size(); i++)
+        {
+            const Sphere& sphere = scene.Spheres[i];
+            if (sphere.MaterialIndex < 0 || sphere.MaterialIndex >= (int)scene.Materials.size())
+                continue;
+
+            const Material& material = scene.Materials[sphere.MaterialIndex];
+            const float power = Utils::Luminance(material.EmissionColor * material.EmissionStrength) * sphere.Radius * sphere.Radius;
+            if (power > 0.0f)
+                emissive.push_back(i);
+        }
+        if (emissive.empty())
+            return;
+
+        // Ordered by what the spheres are rather than where they are stored, scene files keep the spheres in BVH
+        // order and the picks have to come out the same after a round trip
+        std::sort(emissive.begin(), emissive.end(), [&](uint32_t a, uint32_t b)
+        {
+            const Sphere& sphereA = scene.Spheres[a];
+            const Sphere& sphereB = scene.Spheres[b];
+            return std::tie(sphereA.Position.x, sphereA.Position.y, sphereA.Position.z, sphereA.Radius, sphereA.MaterialIndex)
+                < std::tie(sphereB.Position.x, sphereB.Position.y, sphereB.Position.z, sphereB.Radius, sphereB.MaterialIndex);
+        });
+
+        SphereLights.assign(scene.Spheres.size(), -1);
+        float totalPower = 0.0f;
+        for (uint32_t i : emissive)
+        {
+            const Sphere& sphere = scene.Spheres[i];
+            const Material& material = scene.Materials[sphere.MaterialIndex];
+            const glm::vec3 radiance = material.EmissionColor * material.EmissionStrength;
+            const float power = Utils::Luminance(radiance) * sphere.Radius * sphere.Radius;
+            SphereLights[i] = (int)Lights.size();
+
+            Light& light = Lights.emplace_back();
+            light.Position = sphere.Position;
+            light.Radius = glm::abs(sphere.Radius);
+            light.Radiance = radiance;
+            light.Probability = power;
+            totalPower += power;
+        }
+
+        float sum = 0.0f;
+        for (Light& light : Lights)
+        {
+            light.Probability /= totalPower;
+            sum += light.Probability;
+            CumulativeProbabilities.push_back(sum);
+        }
+    }
+
+    bool LightData::Sample(const glm::vec3& position, float u, const glm::vec2& uv, LightSample& sample) const
+    {
+        // Rounding can leave the last sum a little below 1
+        uint32_t lightIndex = (uint32_t)(std::upper_bound(CumulativeProbabilities.begin(), CumulativeProbabilities.end(), u) - CumulativeProbabilities.begin());
+        lightIndex = glm::min(lightIndex, (uint32_t)Lights.size() - 1);
+        const Light& light = Lights[lightIndex];
+
+        float distanceSquared;
+        const float oneMinusCosMax = Utils::ConeSolidAngleFactor(light, position, distanceSquared);
+        if (oneMinusCosMax <= 0.0f)
+            return false;
+
+        // Uniform in the cone, the sine from (1 - cos)(1 + cos) keeps its precision for narrow cones
+        const float oneMinusCos = uv.x * oneMinusCosMax;
+        const float cosTheta = 1.0f - oneMinusCos;
+        const float sinTheta = glm::sqrt(glm::max(oneMinusCos * (2.0f - oneMinusCos), 0.0f));
+        const glm::vec3 toCenter = light.Position - position;
+        const float distance = glm::sqrt(distanceSquared);
+        sample.Direction = Utils::DirectionAround(toCenter / distance, cosTheta, sinTheta, uv.y);
+
+        // Near intersection with the sphere, directions grazing its outline may round to just outside of it
+        const float b = glm::dot(sample.Direction, toCenter);
+        sample.Distance = b - glm::sqrt(glm::max(light.Radius * light.Radius - (distanceSquared - b * b), 0.0f));
+        sample.Radiance = light.Radiance;
+        sample.Pdf = light.Probability / (2.0f * 3.1415926f * oneMinusCosMax);
+        return true;
+    }
+
+    float LightData::GetPdf(uint32_t lightIndex, const glm::vec3& position) const
+    {
+        const Light& light = Lights[lightIndex];
+        float distanceSquared;
+        const float oneMinusCosMax = Utils::ConeSolidAngleFactor(light, position, distanceSquared);
+        if (oneMinusCosMax <= 0.0f)
+            return 0.0f;
+
+        return light.Probability / (2.0f * 3.1415926f * oneMinusCosMax);
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Scene.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace RayTracing {
+
+    // The spheres of Scene::Spheres with an emissive material, for sampling light directly at a surface. A light is
+    // picked in proportion to its power, then a direction inside the cone it covers as seen from the surface.
+    // Spheres of prototypes and emissive meshes are only found by paths that happen to hit them
+    struct LightData
+    {
+        struct Light
+        {
+            glm::vec3 Position;
+            float Radius;
+            glm::vec3 Radiance;
+            float Probability; // Of being picked
+        };
+
+        struct LightSample
+        {
+            glm::vec3 Direction;
+            float Distance; // To the light's surface
+            glm::vec3 Radiance;
+            float Pdf; // Per solid angle, including the pick
+        };
+
+        std::vector<Light> Lights;
+        std::vector<float> CumulativeProbabilities;
+        std::vector<int> SphereLights; // Scene::Spheres index to light index or -1, empty without lights
+
+        void Build(const Scene& scene);
+
+        bool IsEmpty() const { return Lights.empty(); }
+        int GetLightIndex(uint32_t sphereIndex) const { return SphereLights.empty() ? -1 : SphereLights[sphereIndex]; }
+
+        // Picks a light with u and a direction towards it with uv, both in [0, 1). False if the position is inside
+        // the light, which is then never sampled from there
+        bool Sample(const glm::vec3& position, float u, const glm::vec2& uv, LightSample& sample) const;
+        // Density Sample gives a direction from position that hits the light
+        float GetPdf(uint32_t lightIndex, const glm::vec3& position) const;
+    };
+
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RayTracing {
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::Open(const std::string& path)
+    {
+        Close();
+
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        m_File = file;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+        {
+            Close();
+            return false;
+        }
+
+        m_Size = (size_t)size.QuadPart;
+        if (m_Size == 0)
+            return true; // Empty files can't be mapped, but they are valid
+
+        m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_Mapping)
+        {
+            Close();
+            return false;
+        }
+
+        m_Data = (const char*)MapViewOfFile((HANDLE)m_Mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!m_Data)
+        {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_Data)
+            UnmapViewOfFile(m_Data);
+        if (m_Mapping)
+            CloseHandle((HANDLE)m_Mapping);
+        if (m_File)
+            CloseHandle((HANDLE)m_File);
+
+        m_Data = nullptr;
+        m_Size = 0;
+        m_Mapping = nullptr;
+        m_File = nullptr;
+    }
+#else
+    bool MappedFile::Open(const std::string& path)
+    {
+        Close();
+
+        m_File = open(path.c_str(), O_RDONLY);
+        if (m_File < 0)
+            return false;
+
+        struct stat status;
+        if (fstat(m_File, &status) != 0)
+        {
+            Close();
+            return false;
+        }
+
+        m_Size = (size_t)status.st_size;
+        if (m_Size == 0)
+            return true; // Empty files can't be mapped, but they are valid
+
+        void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_File, 0);
+        if (data == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+
+        // The parsers read front to back, let the kernel read ahead aggressively
+        madvise(data, m_Size, MADV_SEQUENTIAL);
+        m_Data = (const char*)data;
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_Data)
+            munmap((void*)m_Data, m_Size);
+        if (m_File >= 0)
+            close(m_File);
+
+        m_Data = nullptr;
+        m_Size = 0;
+        m_File = -1;
+    }
+#endif
+
+}
\ No newline at end of file
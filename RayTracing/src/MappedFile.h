@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace RayTracing {
+
+    // Read-only memory mapping of a whole file, unmapped on destruction
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool Open(const std::string& path);
+        void Close();
+
+        const char* GetData() const { return m_Data; }
+        size_t GetSize() const { return m_Size; }
+    private:
+        const char* m_Data = nullptr;
+        size_t m_Size = 0;
+#ifdef _WIN32
+        void* m_File = nullptr;
+        void* m_Mapping = nullptr;
+#else
+        int m_File = -1;
+#endif
+    };
+
+}
\ No newline at end of file
@@ -0,0 +1,309 @@
+#include "MeshLoader.h"
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+namespace RayTracing::MeshLoader {
+
+    namespace Utils {
+
+        struct BinaryHeader
+        {
+            char Magic[4];
+            uint32_t Version;
+            uint64_t VertexCount;
+            uint64_t IndexCount;
+        };
+
+        static constexpr char BinaryMagic[4] = { 'R', 'T', 'M', 'B' };
+        static constexpr uint32_t BinaryVersion = 1;
+
+        // Chunks smaller than this aren't worth a task
+        static constexpr size_t MinChunkSize = 64 * 1024;
+
+        struct Chunk
+        {
+            const char* Begin;
+            const char* End;
+            uint64_t VertexCount = 0;
+            uint64_t TriangleCount = 0;
+            uint64_t FirstVertex = 0;
+            uint64_t FirstTriangle = 0;
+        };
+
+        static bool IsSpace(char c)
+        {
+            return c == ' ' || c == '\t';
+        }
+
+        static bool IsLineEnd(char c)
+        {
+            return c == '\n' || c == '\r' || c == '#';
+        }
+
+        static const char* SkipSpaces(const char* p, const char* end)
+        {
+            while (p < end && IsSpace(*p))
+                p++;
+            return p;
+        }
+
+        static const char* NextLine(const char* p, const char* end)
+        {
+            const char* newline = (const char*)memchr(p, '\n', end - p);
+            return newline ? newline + 1 : end;
+        }
+
+        // "v" or "f" followed by whitespace, so "vt", "vn" and "fo" don't match
+        static bool IsKeyword(const char* p, const char* end, char keyword)
+        {
+            return end - p >= 2 && p[0] == keyword && IsSpace(p[1]);
+        }
+
+        static uint32_t CountFaceVertices(const char* p, const char* end)
+        {
+            uint32_t count = 0;
+            p = SkipSpaces(p + 1, end);
+            while (p < end && !IsLineEnd(*p))
+            {
+                count++;
+                while (p < end && !IsSpace(*p) && !IsLineEnd(*p))
+                    p++;
+                p = SkipSpaces(p, end);
+            }
+            return count;
+        }
+
+        static void CountChunk(Chunk& chunk)
+        {
+            for (const char* p = chunk.Begin; p < chunk.End; p = NextLine(p, chunk.End))
+            {
+                p = SkipSpaces(p, chunk.End);
+                if (IsKeyword(p, chunk.End, 'v'))
+                    chunk.VertexCount++;
+                else if (IsKeyword(p, chunk.End, 'f'))
+                    chunk.TriangleCount += std::max(CountFaceVertices(p, chunk.End), 2u) - 2;
+            }
+        }
+
+        static const char* ParseFloat(const char* p, const char* end, float& value, bool& ok)
+        {
+            p = SkipSpaces(p, end);
+            if (p < end && *p == '+')
+                p++; // from_chars doesn't take an explicit plus sign
+
+            auto [next, errorCode] = std::from_chars(p, end, value);
+            ok = ok && errorCode == std::errc();
+            return next;
+        }
+
+        // Fills the chunk's share of the mesh arrays, counts must match CountChunk. OBJ indices are 1 based,
+        // negative ones count back from the last vertex defined so far
+        static bool ParseChunk(const Chunk& chunk, Mesh& mesh)
+        {
+            const uint64_t vertexCount = mesh.Positions.size();
+            uint64_t vertex = chunk.FirstVertex;
+            uint32_t* indices = mesh.Indices.data() + chunk.FirstTriangle * 3;
+
+            for (const char* p = chunk.Begin; p < chunk.End; p = NextLine(p, chunk.End))
+            {
+                p = SkipSpaces(p, chunk.End);
+                if (IsKeyword(p, chunk.End, 'v'))
+                {
+                    bool ok = true;
+                    glm::vec3& position = mesh.Positions[vertex++];
+                    p = ParseFloat(p + 1, chunk.End, position.x, ok);
+                    p = ParseFloat(p, chunk.End, position.y, ok);
+                    p = ParseFloat(p, chunk.End, position.z, ok);
+                    if (!ok)
+                        return false;
+                }
+                else if (IsKeyword(p, chunk.End, 'f'))
+                {
+                    uint32_t faceVertexCount = 0;
+                    uint32_t first = 0, previous = 0;
+
+                    p = SkipSpaces(p + 1, chunk.End);
+                    while (p < chunk.End && !IsLineEnd(*p))
+                    {
+                        int64_t index = 0;
+                        auto [next, errorCode] = std::from_chars(p, chunk.End, index);
+                        if (errorCode != std::errc() || index == 0)
+                            return false;
+
+                        index = index > 0 ? index - 1 : (int64_t)vertex + index;
+                        if (index < 0 || (uint64_t)index >= vertexCount)
+                            return false;
+
+                        // Texture coordinate and normal indices after the slashes are skipped
+                        p = next;
+                        while (p < chunk.End && !IsSpace(*p) && !IsLineEnd(*p))
+                            p++;
+                        p = SkipSpaces(p, chunk.End);
+
+                        uint32_t current = (uint32_t)index;
+                        if (faceVertexCount == 0)
+                            first = current;
+                        else if (faceVertexCount >= 2)
+                        {
+                            *indices++ = first;
+                            *indices++ = previous;
+                            *indices++ = current;
+                        }
+                        previous = current;
+                        faceVertexCount++;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        static bool Fail(std::string* error, const std::string& message)
+        {
+            if (error)
+                *error = message;
+            return false;
+        }
+
+    }
+
+    bool Load(const std::string& path, Mesh& mesh, std::string* error)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+            return Utils::Fail(error, "Can't open '" + path + "'");
+
+        const bool binary = path.size() >= 7 && path.compare(path.size() - 7, 7, ".rtmesh") == 0;
+        if (binary)
+            return LoadBinary(file.GetData(), file.GetSize(), mesh, error);
+
+        return LoadOBJ(file.GetData(), file.GetSize(), mesh, error);
+    }
+
+    bool LoadOBJ(const char* data, size_t size, Mesh& mesh, std::string* error)
+    {
+        mesh.Positions.clear();
+        mesh.Indices.clear();
+        if (size == 0)
+            return true;
+
+        ThreadPool threadPool;
+        const size_t chunkCount = std::max<size_t>(std::min<size_t>(threadPool.GetWorkerCount() * 4, size / Utils::MinChunkSize), 1);
+
+        // Chunk borders are moved to the next line start, every line belongs to exactly one chunk
+        const char* end = data + size;
+        std::vector<Utils::Chunk> chunks(chunkCount);
+        for (size_t i = 0; i < chunkCount; i++)
+        {
+            const char* begin = data + size * i / chunkCount;
+            if (i > 0 && begin[-1] != '\n')
+                begin = Utils::NextLine(begin, end);
+            chunks[i].Begin = begin;
+        }
+        for (size_t i = 0; i < chunkCount; i++)
+            chunks[i].End = i + 1 < chunkCount ? chunks[i + 1].Begin : end;
+
+        // First pass only counts, so the second one can write every chunk's output in place without any locking
+        threadPool.ParallelFor((uint32_t)chunkCount, [&](uint32_t chunkIndex, uint32_t /*workerIndex*/)
+        {
+            Utils::CountChunk(chunks[chunkIndex]);
+        });
+
+        uint64_t vertexCount = 0, triangleCount = 0;
+        for (Utils::Chunk& chunk : chunks)
+        {
+            chunk.FirstVertex = vertexCount;
+            chunk.FirstTriangle = triangleCount;
+            vertexCount += chunk.VertexCount;
+            triangleCount += chunk.TriangleCount;
+        }
+
+        if (vertexCount > UINT32_MAX || triangleCount * 3 > UINT32_MAX)
+            return Utils::Fail(error, "Too many vertices or triangles for 32 bit indices");
+
+        mesh.Positions.resize(vertexCount);
+        mesh.Indices.resize(triangleCount * 3);
+
+        std::atomic<bool> ok = true;
+        threadPool.ParallelFor((uint32_t)chunkCount, [&](uint32_t chunkIndex, uint32_t /*workerIndex*/)
+        {
+            if (!Utils::ParseChunk(chunks[chunkIndex], mesh))
+                ok = false;
+        });
+
+        if (!ok)
+        {
+            mesh.Positions.clear();
+            mesh.Indices.clear();
+            return Utils::Fail(error, "Malformed vertex or face, or a face index out of range");
+        }
+
+        return true;
+    }
+
+    bool LoadBinary(const char* data, size_t size, Mesh& mesh, std::string* error)
+    {
+        Utils::BinaryHeader header;
+        if (size < sizeof(header))
+            return Utils::Fail(error, "File too small for a mesh header");
+
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.Magic, Utils::BinaryMagic, sizeof(header.Magic)) != 0)
+            return Utils::Fail(error, "Not a binary mesh");
+        if (header.Version != Utils::BinaryVersion)
+            return Utils::Fail(error, "Unsupported binary mesh version " + std::to_string(header.Version));
+
+        // Both counts are bounded by the file size before the expected size is computed, so it can't wrap around
+        const uint64_t payloadSize = size - sizeof(header);
+        if (header.IndexCount % 3 != 0 || header.VertexCount > UINT32_MAX || header.VertexCount > payloadSize / sizeof(glm::vec3)
+            || header.IndexCount > payloadSize / sizeof(uint32_t)
+            || header.VertexCount * sizeof(glm::vec3) + header.IndexCount * sizeof(uint32_t) != payloadSize)
+            return Utils::Fail(error, "Corrupt binary mesh");
+
+        const char* positions = data + sizeof(header);
+        const char* indices = positions + header.VertexCount * sizeof(glm::vec3);
+        mesh.Positions.resize(header.VertexCount);
+        mesh.Indices.resize(header.IndexCount);
+        memcpy(mesh.Positions.data(), positions, header.VertexCount * sizeof(glm::vec3));
+        memcpy(mesh.Indices.data(), indices, header.IndexCount * sizeof(uint32_t));
+
+        for (uint32_t index : mesh.Indices)
+        {
+            if (index >= header.VertexCount)
+            {
+                mesh.Positions.clear();
+                mesh.Indices.clear();
+                return Utils::Fail(error, "Corrupt binary mesh, index out of range");
+            }
+        }
+
+        return true;
+    }
+
+    bool SaveBinary(const std::string& path, const Mesh& mesh)
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        Utils::BinaryHeader header;
+        memcpy(header.Magic, Utils::BinaryMagic, sizeof(header.Magic));
+        header.Version = Utils::BinaryVersion;
+        header.VertexCount = mesh.Positions.size();
+        header.IndexCount = mesh.Indices.size();
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = ok && fwrite(mesh.Positions.data(), sizeof(glm::vec3), mesh.Positions.size(), file) == mesh.Positions.size();
+        ok = ok && fwrite(mesh.Indices.data(), sizeof(uint32_t), mesh.Indices.size(), file) == mesh.Indices.size();
+        ok = fclose(file) == 0 && ok;
+        return ok;
+    }
+
+}
\ No newline at end of file
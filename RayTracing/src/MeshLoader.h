@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Scene.h"
+
+#include <string>
+
+namespace RayTracing::MeshLoader {
+
+    // Loads a Wavefront OBJ or a binary .rtmesh file, picked by extension. The file is memory mapped and OBJ
+    // text is parsed in parallel straight into the mesh arrays. Only positions and faces are read from OBJ,
+    // polygons are split into triangle fans and everything ends up in one mesh. On failure error says why
+    bool Load(const std::string& path, Mesh& mesh, std::string* error = nullptr);
+
+    bool LoadOBJ(const char* data, size_t size, Mesh& mesh, std::string* error = nullptr);
+    bool LoadBinary(const char* data, size_t size, Mesh& mesh, std::string* error = nullptr);
+
+    // Positions and indices as stored in memory behind a small versioned header, loading it is a copy
+    bool SaveBinary(const std::string& path, const Mesh& mesh);
+
+}
\ No newline at end of file
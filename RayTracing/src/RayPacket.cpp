@@ -0,0 +1,204 @@
+#include "RayPacket.h"
+
+#include "SIMD.h"
+
+#include <limits>
+
+namespace RayTracing {
+
+    void RayPacket::SetRay(uint32_t lane, const Ray& ray)
+    {
+        OriginX[lane] = ray.Origin.x;
+        OriginY[lane] = ray.Origin.y;
+        OriginZ[lane] = ray.Origin.z;
+        DirectionX[lane] = ray.Direction.x;
+        DirectionY[lane] = ray.Direction.y;
+        DirectionZ[lane] = ray.Direction.z;
+        InverseDirectionX[lane] = 1.0f / ray.Direction.x;
+        InverseDirectionY[lane] = 1.0f / ray.Direction.y;
+        InverseDirectionZ[lane] = 1.0f / ray.Direction.z;
+        DirectionLengthSquared[lane] = ray.Direction.x * ray.Direction.x + ray.Direction.y * ray.Direction.y + ray.Direction.z * ray.Direction.z;
+        HitDistance[lane] = std::numeric_limits<float>::max();
+        Slot[lane] = -1;
+    }
+
+    namespace PacketKernels {
+
+#if RT_SIMD_X86
+        struct PacketRegisters
+        {
+            __m256 OriginX, OriginY, OriginZ;
+            __m256 DirectionX, DirectionY, DirectionZ;
+            __m256 InverseDirectionX, InverseDirectionY, InverseDirectionZ;
+            __m256 A, InverseA;
+            __m256 HitDistance;
+            __m256i Slot;
+        };
+
+        RT_TARGET("avx2")
+        static void Load(const RayPacket& packet, PacketRegisters& r)
+        {
+            r.OriginX = _mm256_load_ps(packet.OriginX);
+            r.OriginY = _mm256_load_ps(packet.OriginY);
+            r.OriginZ = _mm256_load_ps(packet.OriginZ);
+            r.DirectionX = _mm256_load_ps(packet.DirectionX);
+            r.DirectionY = _mm256_load_ps(packet.DirectionY);
+            r.DirectionZ = _mm256_load_ps(packet.DirectionZ);
+            r.InverseDirectionX = _mm256_load_ps(packet.InverseDirectionX);
+            r.InverseDirectionY = _mm256_load_ps(packet.InverseDirectionY);
+            r.InverseDirectionZ = _mm256_load_ps(packet.InverseDirectionZ);
+            r.A = _mm256_load_ps(packet.DirectionLengthSquared);
+            r.InverseA = _mm256_div_ps(_mm256_set1_ps(1.0f), r.A);
+            r.HitDistance = _mm256_load_ps(packet.HitDistance);
+            r.Slot = _mm256_load_si256((const __m256i*)packet.Slot);
+        }
+
+        RT_TARGET("avx2")
+        static void Store(const PacketRegisters& r, RayPacket& packet)
+        {
+            _mm256_store_ps(packet.HitDistance, r.HitDistance);
+            _mm256_store_si256((__m256i*)packet.Slot, r.Slot);
+        }
+
+        // Same operations in the same order as SphereKernels::IntersectScalar, one sphere against eight rays
+        RT_TARGET("avx2")
+        static void IntersectSphere(PacketRegisters& r, const SphereSoA& spheres, uint32_t slot)
+        {
+            const __m256 zero = _mm256_setzero_ps();
+
+            __m256 ox = _mm256_sub_ps(r.OriginX, _mm256_set1_ps(spheres.CenterX[slot]));
+            __m256 oy = _mm256_sub_ps(r.OriginY, _mm256_set1_ps(spheres.CenterY[slot]));
+            __m256 oz = _mm256_sub_ps(r.OriginZ, _mm256_set1_ps(spheres.CenterZ[slot]));
+
+            __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, r.DirectionX), _mm256_mul_ps(oy, r.DirectionY)), _mm256_mul_ps(oz, r.DirectionZ));
+            __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy)), _mm256_mul_ps(oz, oz)), _mm256_set1_ps(spheres.RadiusSquared[slot]));
+            __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(r.A, c));
+
+            __m256 t = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(zero, b), _mm256_sqrt_ps(discriminant)), r.InverseA);
+
+            __m256 hit = _mm256_and_ps(_mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+            hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, r.HitDistance, _CMP_LT_OQ));
+
+            r.HitDistance = _mm256_blendv_ps(r.HitDistance, t, hit);
+            r.Slot = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(r.Slot), _mm256_castsi256_ps(_mm256_set1_epi32((int)slot)), hit));
+        }
+
+        // Lane mask of rays that enter the node before their current closest hit, plus the nearest entry distance
+        RT_TARGET("avx2")
+        static int IntersectNode(const PacketRegisters& r, const BVHNode& node, float& nearestEntry)
+        {
+            __m256 tx0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.Min.x), r.OriginX), r.InverseDirectionX);
+            __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.Max.x), r.OriginX), r.InverseDirectionX);
+            __m256 ty0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.Min.y), r.OriginY), r.InverseDirectionY);
+            __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.Max.y), r.OriginY), r.InverseDirectionY);
+            __m256 tz0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.Min.z), r.OriginZ), r.InverseDirectionZ);
+            __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.Max.z), r.OriginZ), r.InverseDirectionZ);
+
+            __m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx0, tx1), _mm256_min_ps(ty0, ty1)), _mm256_min_ps(tz0, tz1));
+            __m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx0, tx1), _mm256_max_ps(ty0, ty1)), _mm256_max_ps(tz0, tz1));
+
+            __m256 hit = _mm256_and_ps(_mm256_cmp_ps(tFar, tNear, _CMP_GE_OQ), _mm256_cmp_ps(tFar, _mm256_setzero_ps(), _CMP_GT_OQ));
+            hit = _mm256_and_ps(hit, _mm256_cmp_ps(tNear, r.HitDistance, _CMP_LT_OQ));
+
+            int mask = _mm256_movemask_ps(hit);
+            if (!mask)
+                return 0;
+
+            // Horizontal min over the lanes that hit
+            __m256 entry = _mm256_blendv_ps(_mm256_set1_ps(std::numeric_limits<float>::max()), tNear, hit);
+            entry = _mm256_min_ps(entry, _mm256_permute2f128_ps(entry, entry, 1));
+            entry = _mm256_min_ps(entry, _mm256_shuffle_ps(entry, entry, _MM_SHUFFLE(1, 0, 3, 2)));
+            entry = _mm256_min_ps(entry, _mm256_shuffle_ps(entry, entry, _MM_SHUFFLE(2, 3, 0, 1)));
+            nearestEntry = _mm256_cvtss_f32(entry);
+            return mask;
+        }
+
+        bool IsSupported()
+        {
+            return SphereKernels::GetBest() == SphereKernels::IntersectAVX2;
+        }
+
+        RT_TARGET("avx2")
+        uint32_t IntersectBVH(RayPacket& packet, const BVH& bvh, const SphereSoA& spheres)
+        {
+            const std::vector<BVHNode>& nodes = bvh.GetNodes();
+            if (nodes.empty())
+                return 0;
+
+            PacketRegisters r;
+            Load(packet, r);
+
+            float rootEntry;
+            if (!IntersectNode(r, nodes[0], rootEntry))
+                return 0;
+
+            uint32_t sphereTests = 0;
+            // Interior nodes push at most one child per level
+            uint32_t stack[BVH::MaxDepth + 1];
+            uint32_t stackSize = 0;
+            stack[stackSize++] = 0;
+            while (stackSize > 0)
+            {
+                const BVHNode& node = nodes[stack[--stackSize]];
+                if (node.IsLeaf())
+                {
+                    for (uint32_t i = 0; i < node.PrimitiveCount; i++)
+                        IntersectSphere(r, spheres, node.LeftFirst + i);
+                    sphereTests += node.PrimitiveCount * RayPacket::Width;
+                    continue;
+                }
+
+                uint32_t nearIndex = node.LeftFirst;
+                uint32_t farIndex = node.LeftFirst + 1;
+                float nearEntry = 0.0f, farEntry = 0.0f;
+                int nearMask = IntersectNode(r, nodes[nearIndex], nearEntry);
+                int farMask = IntersectNode(r, nodes[farIndex], farEntry);
+                if (farMask && (!nearMask || farEntry < nearEntry))
+                {
+                    std::swap(nearIndex, farIndex);
+                    std::swap(nearMask, farMask);
+                }
+
+                // Far child goes below the near one so the packet visits front to back
+                if (farMask)
+                    stack[stackSize++] = farIndex;
+                if (nearMask)
+                    stack[stackSize++] = nearIndex;
+            }
+
+            Store(r, packet);
+            return sphereTests;
+        }
+
+        RT_TARGET("avx2")
+        uint32_t IntersectAll(RayPacket& packet, const SphereSoA& spheres)
+        {
+            PacketRegisters r;
+            Load(packet, r);
+
+            for (uint32_t slot = 0; slot < spheres.Count; slot++)
+                IntersectSphere(r, spheres, slot);
+
+            Store(r, packet);
+            return spheres.Count * RayPacket::Width;
+        }
+#else
+        bool IsSupported()
+        {
+            return false;
+        }
+
+        uint32_t IntersectBVH(RayPacket& packet, const BVH& bvh, const SphereSoA& spheres)
+        {
+            return 0;
+        }
+
+        uint32_t IntersectAll(RayPacket& packet, const SphereSoA& spheres)
+        {
+            return 0;
+        }
+#endif
+
+    }
+
+}
\ No newline at end of file
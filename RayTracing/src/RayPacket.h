@@ -0,0 +1,39 @@
+#pragma once
+
+#include "BVH.h"
+#include "Ray.h"
+#include "SphereKernels.h"
+
+namespace RayTracing {
+
+    // Eight coherent rays traced together, one per SIMD lane (a row of eight neighbouring camera rays)
+    struct alignas(32) RayPacket
+    {
+        static constexpr uint32_t Width = 8;
+
+        float OriginX[Width], OriginY[Width], OriginZ[Width];
+        float DirectionX[Width], DirectionY[Width], DirectionZ[Width];
+        float InverseDirectionX[Width], InverseDirectionY[Width], InverseDirectionZ[Width];
+        float DirectionLengthSquared[Width];
+
+        // Closest hit per lane, filled in by the kernels
+        float HitDistance[Width];
+        int Slot[Width];
+
+        void SetRay(uint32_t lane, const Ray& ray);
+    };
+
+    namespace PacketKernels {
+
+        // The packet kernels need AVX2, callers fall back to single rays otherwise
+        bool IsSupported();
+
+        // Closest SphereSoA slot per lane. The whole packet walks the BVH together and a node is only
+        // skipped when every lane misses it. Per lane results match BVH::Intersect.
+        // Both return the sphere tests done, counting every lane, for the caller's stats
+        uint32_t IntersectBVH(RayPacket& packet, const BVH& bvh, const SphereSoA& spheres);
+        uint32_t IntersectAll(RayPacket& packet, const SphereSoA& spheres);
+
+    }
+
+}
\ No newline at end of file
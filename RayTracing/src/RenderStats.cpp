@@ -0,0 +1,37 @@
+#include "RenderStats.h"
+
+namespace RayTracing {
+
+    thread_local RenderStats* t_RenderStats = nullptr;
+
+    void RenderStats::Merge(const RenderStats& other)
+    {
+        PrimaryRays += other.PrimaryRays;
+        SecondaryRays += other.SecondaryRays;
+        ShadowRays += other.ShadowRays;
+        SphereTests += other.SphereTests;
+        TriangleTests += other.TriangleTests;
+        Hits += other.Hits;
+        Misses += other.Misses;
+
+        for (uint32_t i = 0; i < PathLengthBins; i++)
+            PathLengths[i] += other.PathLengths[i];
+        for (uint32_t i = 0; i < StageCount; i++)
+            StageMs[i] += other.StageMs[i];
+    }
+
+    const char* RenderStats::GetStageName(uint32_t stage)
+    {
+        switch (stage)
+        {
+            case Stage_Scene: return "Scene";
+            case Stage_Render: return "Render";
+            case Stage_Tiles: return "Tiles";
+            case Stage_Resolve: return "Resolve";
+            case Stage_Reproject: return "Reproject";
+            case Stage_Denoise: return "Denoise";
+        }
+        return "Unknown";
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+// Build with RT_ENABLE_STATS=0 to strip the counters from the hot path entirely
+#ifndef RT_ENABLE_STATS
+#define RT_ENABLE_STATS 1
+#endif
+
+namespace RayTracing {
+
+    struct alignas(64) RenderStats
+    {
+        enum Stage : uint32_t
+        {
+            Stage_Scene,  // Acceleration structure rebuilds
+            Stage_Render, // Wall time of the whole Render call
+            Stage_Tiles,  // Tile time summed over all workers
+            Stage_Resolve, // Wall time of the resolve pass
+            Stage_Reproject, // Carrying the accumulation over to a new view
+            Stage_Denoise, // Wall time of the denoiser
+            StageCount
+        };
+
+        static constexpr uint32_t PathLengthBins = 16;
+
+        uint64_t PrimaryRays = 0;
+        uint64_t SecondaryRays = 0;
+        uint64_t ShadowRays = 0; // Towards sampled lights
+        uint64_t SphereTests = 0; // Packets count every lane
+        uint64_t TriangleTests = 0;
+        uint64_t Hits = 0;
+        uint64_t Misses = 0;
+        // Surfaces a path bounced off before it reached the sky or ran out of bounces, the last bin collects longer paths
+        uint64_t PathLengths[PathLengthBins] = {};
+        double StageMs[StageCount] = {};
+
+        void Merge(const RenderStats& other);
+        void Clear() { *this = RenderStats(); }
+
+        static const char* GetStageName(uint32_t stage);
+    };
+
+    // Counters of the tile the calling thread is rendering, null outside of tiles so BVH queries from elsewhere aren't counted
+    extern thread_local RenderStats* t_RenderStats;
+
+}
+
+#if RT_ENABLE_STATS
+#define RT_STATS_ADD(counter, value) do { if (RayTracing::t_RenderStats) RayTracing::t_RenderStats->counter += (value); } while (0)
+#else
+#define RT_STATS_ADD(counter, value) do {} while (0)
+#endif
+
+// For code specialized on whether it counts, nothing is compiled in when enabled is false
+#define RT_STATS_ADD_IF(enabled, counter, value) do { if constexpr (enabled) RT_STATS_ADD(counter, value); } while (0)
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include "RenderThread.h"
+
+#include "Upscaler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace RayTracing {
+
+    namespace Utils {
+
+        // Settings that change what a sample estimates, samples taken before and after can't be averaged
+        static bool ChangesEstimator(const Renderer::Settings& a, const Renderer::Settings& b)
+        {
+            return a.JitterPrimaryRays != b.JitterPrimaryRays || a.Sampler != b.Sampler || a.MaxDepth != b.MaxDepth
+                || a.RussianRoulette != b.RussianRoulette || a.RussianRouletteDepth != b.RussianRouletteDepth
+                || a.NextEventEstimation != b.NextEventEstimation;
+        }
+
+    }
+
+    RenderThread::RenderThread(bool dropFrames)
+        : m_DropFrames(dropFrames)
+    {
+        m_Thread = std::thread([this]() { Run(); });
+    }
+
+    RenderThread::~RenderThread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_InputCondition.notify_all();
+        m_Thread.join();
+    }
+
+    void RenderThread::SubmitCamera(const Camera& camera, uint32_t width, uint32_t height)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Input.ViewCamera = camera;
+        m_Input.Width = width;
+        m_Input.Height = height;
+        m_Input.CameraChanged = true;
+        m_Input.Version++;
+        m_InputCondition.notify_all();
+    }
+
+    void RenderThread::SubmitSettings(const Renderer::Settings& settings)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Input.Settings == settings)
+            return;
+
+        m_Input.Settings = settings;
+        m_Input.Version++;
+        m_InputCondition.notify_all();
+    }
+
+    void RenderThread::SubmitScene(Scene scene, BVH sphereBVH)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        // Edits still queued are already part of the new scene
+        m_Input.NewScene = std::move(scene);
+        m_Input.SphereBVH = std::move(sphereBVH);
+        m_Input.SphereEdits.clear();
+        m_Input.MaterialEdits.clear();
+        m_Input.Version++;
+        m_InputCondition.notify_all();
+    }
+
+    void RenderThread::SubmitSceneChanges(Scene& scene)
+    {
+        if (!scene.HasChanges())
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (uint32_t index : scene.DirtySpheres)
+        {
+            if (index < scene.Spheres.size())
+                m_Input.SphereEdits.emplace_back(index, scene.Spheres[index]);
+        }
+        for (uint32_t index : scene.DirtyMaterials)
+        {
+            if (index < scene.Materials.size())
+                m_Input.MaterialEdits.emplace_back(index, scene.Materials[index]);
+        }
+        scene.ClearChanges();
+
+        m_Input.Version++;
+        m_InputCondition.notify_all();
+    }
+
+    void RenderThread::ResetAccumulation()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Input.Reset = true;
+        m_Input.Version++;
+        m_InputCondition.notify_all();
+    }
+
+    void RenderThread::SetFrameLimit(uint32_t frameLimit)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Input.FrameLimit == frameLimit)
+            return;
+
+        m_Input.FrameLimit = frameLimit;
+        m_Input.Version++;
+        m_InputCondition.notify_all();
+    }
+
+    void RenderThread::SetDynamicResolution(const DynamicResolution& dynamicResolution)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Input.Resolution == dynamicResolution)
+            return;
+
+        m_Input.Resolution = dynamicResolution;
+        m_Input.Version++;
+        m_InputCondition.notify_all();
+    }
+
+    const RenderThread::Frame* RenderThread::AcquireFrame()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (!m_ReadyFresh)
+            return nullptr;
+
+        std::swap(m_FrontIndex, m_ReadyIndex);
+        m_ReadyFresh = false;
+        m_InputCondition.notify_all();
+        return &m_Frames[m_FrontIndex];
+    }
+
+    const RenderThread::Frame* RenderThread::WaitForFrame()
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_FrameCondition.wait(lock, [this]() { return m_ReadyFresh; });
+
+        std::swap(m_FrontIndex, m_ReadyIndex);
+        m_ReadyFresh = false;
+        m_InputCondition.notify_all();
+        return &m_Frames[m_FrontIndex];
+    }
+
+    uint64_t RenderThread::GetInputVersion()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Input.Version;
+    }
+
+    void RenderThread::Run()
+    {
+        Input input;
+        while (true)
+        {
+            // Keeps rendering on its own up to the frame limit, past it only new input wakes the thread
+            bool hasInput = false;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                auto ready = [&]() { return m_Stop || m_Input.Version != m_RenderedVersion || CanRender(); };
+                // Stopped at a reduced resolution, e.g. by the frame limit, it still wakes up for full resolution
+                if (m_RenderScale < 1.0f)
+                    m_InputCondition.wait_until(lock, m_LastChange + StillDelay, ready);
+                else
+                    m_InputCondition.wait(lock, ready);
+                if (m_Stop)
+                    return;
+
+                // The camera and settings stay in m_Input as the latest state, everything else moves out
+                if (m_Input.Version != m_RenderedVersion)
+                {
+                    input.Version = m_Input.Version;
+                    input.Settings = m_Input.Settings;
+                    input.ViewCamera = m_Input.ViewCamera;
+                    input.Width = m_Input.Width;
+                    input.Height = m_Input.Height;
+                    input.FrameLimit = m_Input.FrameLimit;
+                    input.Resolution = m_Input.Resolution;
+
+                    input.NewScene = std::move(m_Input.NewScene);
+                    m_Input.NewScene.reset();
+                    input.SphereBVH = std::move(m_Input.SphereBVH);
+                    m_Input.SphereBVH.Clear();
+                    input.SphereEdits.swap(m_Input.SphereEdits);
+                    input.MaterialEdits.swap(m_Input.MaterialEdits);
+                    input.CameraChanged = std::exchange(m_Input.CameraChanged, false);
+                    input.Reset = std::exchange(m_Input.Reset, false);
+
+                    m_RenderedVersion = m_Input.Version;
+                    hasInput = true;
+                }
+            }
+
+            if (hasInput)
+                ApplyInput(input);
+            UpdateRenderSize();
+
+            if (CanRender())
+            {
+                auto start = std::chrono::steady_clock::now();
+                m_Renderer.Render(m_Scene, *m_Camera);
+                float renderMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+                MeasureFrame(renderMs);
+                Publish(renderMs);
+            }
+            else if (hasInput && HasTarget())
+            {
+                // Done accumulating, but display settings may have changed
+                m_Renderer.ResolveImage();
+                Publish(0.0f);
+            }
+        }
+    }
+
+    bool RenderThread::HasTarget() const
+    {
+        const Framebuffer& framebuffer = m_Renderer.GetFramebuffer();
+        return m_HasScene && m_Camera && framebuffer.GetWidth() && framebuffer.GetHeight();
+    }
+
+    bool RenderThread::CanRender() const
+    {
+        return HasTarget() && (m_FrameLimit == 0 || m_Renderer.GetFrameIndex() <= m_FrameLimit);
+    }
+
+    void RenderThread::ApplyInput(Input& input)
+    {
+        // Reset here rather than by the caller, the settings and a separately queued reset could be taken apart
+        if (Utils::ChangesEstimator(m_Renderer.GetSettings(), input.Settings))
+            input.Reset = true;
+        m_Renderer.GetSettings() = input.Settings;
+        m_FrameLimit = input.FrameLimit;
+        m_DynamicResolution = input.Resolution;
+
+        if (input.CameraChanged || input.NewScene || !input.SphereEdits.empty() || !input.MaterialEdits.empty())
+            m_LastChange = std::chrono::steady_clock::now();
+
+        // The copy is sized for the viewport, UpdateRenderSize resizes it to the traced resolution
+        if (input.ViewCamera)
+            m_Camera = input.ViewCamera;
+        m_ViewportWidth = input.Width;
+        m_ViewportHeight = input.Height;
+        UpdateRenderSize();
+
+        if (input.NewScene)
+        {
+            // Same Scene object with new contents, the renderer can't tell by itself
+            m_Scene = std::move(*input.NewScene);
+            m_HasScene = true;
+            m_Renderer.InvalidateScene();
+            if (!input.SphereBVH.IsEmpty())
+                m_Renderer.SetSphereBVH(std::move(input.SphereBVH));
+            m_Renderer.ResetFrameIndex();
+        }
+
+        for (const auto& [index, sphere] : input.SphereEdits)
+        {
+            if (index < m_Scene.Spheres.size())
+            {
+                m_Scene.Spheres[index] = sphere;
+                m_Scene.MarkSphereDirty(index);
+            }
+        }
+        for (const auto& [index, material] : input.MaterialEdits)
+        {
+            if (index < m_Scene.Materials.size())
+            {
+                m_Scene.Materials[index] = material;
+                m_Scene.MarkMaterialDirty(index);
+            }
+        }
+        // Regions an edit clears and pixels reprojection drops are only refilled by more passes, which the frame
+        // limit would not allow. Neither are the features the denoiser needs when it was just turned on
+        const bool limitReached = m_FrameLimit > 0 && m_Renderer.GetFrameIndex() > m_FrameLimit;
+        const bool needsFeatures = input.Settings.Denoise && !m_Renderer.GetFramebuffer().HasFeatures();
+        if (limitReached && (m_Scene.HasChanges() || input.CameraChanged || needsFeatures))
+            input.Reset = true;
+        m_Renderer.ApplySceneChanges(m_Scene);
+
+        if (input.CameraChanged)
+            m_Renderer.OnCameraMoved();
+        if (input.Reset)
+            m_Renderer.ResetFrameIndex();
+
+        input.NewScene.reset();
+        input.SphereBVH.Clear();
+        input.SphereEdits.clear();
+        input.MaterialEdits.clear();
+    }
+
+    void RenderThread::UpdateRenderSize()
+    {
+        float scale = 1.0f;
+        const bool changing = std::chrono::steady_clock::now() - m_LastChange < StillDelay;
+        if (m_DynamicResolution.Enabled && changing && m_MsPerPixel > 0.0f && m_ViewportWidth && m_ViewportHeight)
+        {
+            // The time grows with the pixel count, so the sides scale with the square root of the time. Steps of
+            // 1/16, so frame time jitter doesn't resize (and restart) the image every frame
+            const float targetMs = 1000.0f / std::max(m_DynamicResolution.TargetFPS, 1.0f);
+            scale = std::sqrt(targetMs / (m_MsPerPixel * (float)m_ViewportWidth * (float)m_ViewportHeight));
+            scale = std::clamp(std::floor(scale * 16.0f) / 16.0f, std::clamp(m_DynamicResolution.MinScale, 1.0f / 16.0f, 1.0f), 1.0f);
+        }
+        m_RenderScale = scale;
+
+        uint32_t width = m_ViewportWidth, height = m_ViewportHeight;
+        if (scale < 1.0f)
+        {
+            width = std::max((uint32_t)std::lround((float)width * scale), 1u);
+            height = std::max((uint32_t)std::lround((float)height * scale), 1u);
+        }
+
+        if (m_Camera)
+            m_Camera->OnResize(width, height);
+        m_Renderer.OnResize(width, height);
+    }
+
+    void RenderThread::MeasureFrame(float renderMs)
+    {
+        // A call that only rendered part of a pass says little about a whole one
+        if (m_Renderer.GetSettings().FrameBudgetMs > 0.0f)
+            return;
+
+        const Framebuffer& framebuffer = m_Renderer.GetFramebuffer();
+        const float msPerPixel = renderMs / (float)(framebuffer.GetWidth() * framebuffer.GetHeight());
+        m_MsPerPixel = m_MsPerPixel > 0.0f ? m_MsPerPixel + (msPerPixel - m_MsPerPixel) * 0.5f : msPerPixel;
+    }
+
+    void RenderThread::Publish(float renderMs)
+    {
+        // Only this thread touches the back buffer, so it is filled without holding the lock
+        Frame& frame = m_Frames[m_BackIndex];
+        const Framebuffer& framebuffer = m_Renderer.GetFramebuffer();
+        frame.RenderWidth = framebuffer.GetWidth();
+        frame.RenderHeight = framebuffer.GetHeight();
+        frame.Width = m_ViewportWidth;
+        frame.Height = m_ViewportHeight;
+        if (frame.Width == frame.RenderWidth && frame.Height == frame.RenderHeight)
+        {
+            frame.ImageData.assign(framebuffer.GetImageData(), framebuffer.GetImageData() + (size_t)frame.Width * frame.Height);
+        }
+        else
+        {
+            frame.ImageData.resize((size_t)frame.Width * frame.Height);
+            Upscaler::Bilinear(framebuffer.GetImageData(), frame.RenderWidth, frame.RenderHeight, frame.ImageData.data(), frame.Width, frame.Height);
+        }
+
+        frame.InputVersion = m_RenderedVersion;
+        frame.RenderMs = renderMs;
+        frame.FrameIndex = m_Renderer.GetFrameIndex();
+        frame.PassProgress = m_Renderer.GetPassProgress();
+        frame.RayCount = m_Renderer.GetLastRayCount();
+        frame.ActivePixelCount = m_Renderer.GetLastActivePixelCount();
+        frame.TileTimes = m_Renderer.GetTileTimes();
+        frame.Stats = m_Renderer.GetLastStats();
+
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        if (!m_DropFrames)
+            m_InputCondition.wait(lock, [this]() { return !m_ReadyFresh || m_Stop; });
+
+        frame.Sequence = ++m_Sequence;
+        std::swap(m_BackIndex, m_ReadyIndex);
+        m_ReadyFresh = true;
+        m_FrameCondition.notify_all();
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Camera.h"
+#include "Renderer.h"
+#include "Scene.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace RayTracing {
+
+    // Runs a Renderer on a thread of its own, so neither the UI nor the texture upload waits for tracing.
+    // Camera, scene and settings changes are queued as snapshots and picked up before the next Render call,
+    // finished frames go into a triple buffer the consumer takes the latest one from.
+    class RenderThread
+    {
+    public:
+        // A completed Render call, the image and what the renderer reported right after it
+        struct Frame
+        {
+            std::vector<uint32_t> ImageData; // Row major RGBA8, same layout as Framebuffer::GetImageData
+            uint32_t Width = 0, Height = 0; // The viewport's
+            uint32_t RenderWidth = 0, RenderHeight = 0; // Traced, the image is upscaled from this when it is smaller
+
+            uint64_t Sequence = 0; // Counts published frames
+            uint64_t InputVersion = 0; // Version of the snapshot it was rendered from
+
+            float RenderMs = 0.0f;
+            uint32_t FrameIndex = 1;
+            float PassProgress = 0.0f;
+            uint64_t RayCount = 0;
+            uint32_t ActivePixelCount = 0;
+            std::vector<float> TileTimes;
+            RenderStats Stats;
+        };
+
+        // Traces below the viewport's resolution while the camera or scene keeps changing and upscales the image,
+        // so the view keeps up with the input. The scale follows the measured frame times to hold the target frame
+        // rate, full resolution returns once nothing changed for StillDelay
+        struct DynamicResolution
+        {
+            bool Enabled = false;
+            float TargetFPS = 30.0f;
+            float MinScale = 0.25f; // Smallest fraction of the viewport's width and height that is traced
+
+            bool operator==(const DynamicResolution&) const = default;
+        };
+
+        static constexpr std::chrono::milliseconds StillDelay{ 100 };
+    public:
+        // Without frame dropping every Render call waits until the consumer took the previous frame, for
+        // consumers that need all of them. Otherwise older frames nobody took are overwritten
+        RenderThread(bool dropFrames = true);
+        ~RenderThread();
+
+        RenderThread(const RenderThread&) = delete;
+        RenderThread& operator=(const RenderThread&) = delete;
+
+        // Every Submit bumps the input version, nothing renders until there is a scene and a non-empty viewport.
+        // A new scene restarts accumulation, a new camera too unless the renderer reprojects
+        void SubmitCamera(const Camera& camera, uint32_t width, uint32_t height);
+        // Restarts accumulation with the new settings when they change what the samples estimate (depth, sampler, ...)
+        void SubmitSettings(const Renderer::Settings& settings);
+        // The whole scene, with an optional prebuilt sphere BVH as for Renderer::SetSphereBVH
+        void SubmitScene(Scene scene, BVH sphereBVH = BVH());
+        // Copies only the spheres and materials marked in the scene, then clears the marks
+        void SubmitSceneChanges(Scene& scene);
+        void ResetAccumulation();
+        // Idle once this many frames are accumulated, until the next reset. 0 = never
+        void SetFrameLimit(uint32_t frameLimit);
+        void SetDynamicResolution(const DynamicResolution& dynamicResolution);
+
+        // Latest published frame if there is one newer than the last acquired, otherwise null. The frame stays
+        // valid until the next Acquire or Wait call
+        const Frame* AcquireFrame();
+        // Blocks until a frame newer than the last acquired one is published
+        const Frame* WaitForFrame();
+
+        uint64_t GetInputVersion();
+    private:
+        struct Input
+        {
+            uint64_t Version = 0;
+
+            // Latest state, copied on every take
+            Renderer::Settings Settings;
+            std::optional<Camera> ViewCamera;
+            uint32_t Width = 0, Height = 0;
+            uint32_t FrameLimit = 0;
+            DynamicResolution Resolution;
+
+            // Consumed by the take
+            std::optional<Scene> NewScene;
+            BVH SphereBVH;
+            std::vector<std::pair<uint32_t, Sphere>> SphereEdits;
+            std::vector<std::pair<uint32_t, Material>> MaterialEdits;
+            bool CameraChanged = false;
+            bool Reset = false;
+        };
+
+        void Run();
+        bool HasTarget() const;
+        bool CanRender() const;
+        void ApplyInput(Input& input);
+        // Picks the render scale and resizes the renderer and its camera to the viewport scaled by it
+        void UpdateRenderSize();
+        void MeasureFrame(float renderMs);
+        void Publish(float renderMs);
+    private:
+        // Owned by the render thread
+        Renderer m_Renderer;
+        Scene m_Scene;
+        std::optional<Camera> m_Camera;
+        bool m_HasScene = false;
+        uint32_t m_FrameLimit = 0;
+        uint64_t m_RenderedVersion = 0;
+
+        DynamicResolution m_DynamicResolution;
+        uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
+        float m_RenderScale = 1.0f;
+        float m_MsPerPixel = 0.0f; // Smoothed over the last frames, what the render scale is picked from
+        std::chrono::steady_clock::time_point m_LastChange; // Of the camera or the scene
+
+        std::mutex m_Mutex;
+        std::condition_variable m_InputCondition;
+        std::condition_variable m_FrameCondition;
+        Input m_Input;
+        bool m_Stop = false;
+
+        // Back is written by the render thread, ready is the latest complete frame, front is held by the consumer
+        Frame m_Frames[3];
+        uint32_t m_BackIndex = 0, m_ReadyIndex = 1, m_FrontIndex = 2;
+        bool m_ReadyFresh = false;
+        uint64_t m_Sequence = 0;
+        const bool m_DropFrames;
+
+        std::thread m_Thread;
+    };
+
+}
\ No newline at end of file
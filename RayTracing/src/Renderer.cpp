@@ -1,209 +1,1404 @@
 #include "Renderer.h"
 
-#include <execution>
+#include "Utils.h"
 
-namespace RayTracing {
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <utility>
+
+// Counters of the kernels, only compiled into the variants that collect stats
+#define RT_KERNEL_STATS_ADD(counter, value) RT_STATS_ADD_IF((Flags & Kernel_Stats) != 0, counter, value)
 
-#define RT_ENABLE_MT 1
+namespace RayTracing {
 
     namespace Utils {
 
-        static float FastRandom(uint32_t& state)
+        // Interleaves the bits of x and y, neighbouring codes are neighbouring tiles
+        static uint32_t MortonCode(uint32_t x, uint32_t y)
+        {
+            auto spread = [](uint32_t v)
+            {
+                v &= 0x0000ffff;
+                v = (v | (v << 8)) & 0x00ff00ff;
+                v = (v | (v << 4)) & 0x0f0f0f0f;
+                v = (v | (v << 2)) & 0x33333333;
+                v = (v | (v << 1)) & 0x55555555;
+                return v;
+            };
+            return spread(x) | (spread(y) << 1);
+        }
+
+    }
+
+    // Each worker runs its tiles through the same queues, they only grow to the largest tile's sample count
+    static thread_local WavefrontQueues t_WavefrontQueues;
+    
+    void Renderer::OnResize(uint32_t width, uint32_t height)
+    {
+        if (!m_Framebuffer.Resize(width, height))
+            return;
+
+        // Tiles in Morton order, so a contiguous run of tiles (one worker's share) is a compact screen region
+        m_Tiles.clear();
+        for (uint32_t y = 0; y < height; y += TileSize)
+        {
+            for (uint32_t x = 0; x < width; x += TileSize)
+                m_Tiles.push_back({ x, y, glm::min(x + TileSize, width), glm::min(y + TileSize, height) });
+        }
+
+        std::sort(m_Tiles.begin(), m_Tiles.end(), [](const Tile& a, const Tile& b)
+        {
+            return Utils::MortonCode(a.MinX / TileSize, a.MinY / TileSize) < Utils::MortonCode(b.MinX / TileSize, b.MinY / TileSize);
+        });
+
+        m_TileTimes.assign(m_Tiles.size(), 0.0f);
+        m_TileConverged.assign(m_Tiles.size(), 0);
+        m_TileRendered.assign(m_Tiles.size(), 0);
+
+        // The new buffers hold no samples yet
+        ResetFrameIndex();
+        m_SurfacesValid = false;
+    }
+
+    void Renderer::Render(const Scene& scene, const Camera& camera)
+    {
+        if (!m_Framebuffer.GetWidth() || !m_Framebuffer.GetHeight())
+            return;
+
+        auto frameStart = std::chrono::steady_clock::now();
+
+        if (m_ActiveScene != &scene)
+            m_SceneDirty = true;
+
+        m_ActiveScene = &scene;
+        m_ActiveCamera = &camera;
+        m_RayCount = 0;
+
+        // Also rebuild when the BVH was toggled, the SoA slot order depends on it
+        [[maybe_unused]] double sceneMs = 0.0;
+        if (m_SceneDirty || m_Settings.UseBVH != m_SceneUsesBVH)
         {
-            state = state * 747796405 + 2891336453;
-            uint32_t result = ((state >> ((state >> 28) + 4)) ^ state) * 277803737;
-            result = (result >> 22) ^ result;
-            return (float)result / 4294967295.0f;
+            auto sceneStart = std::chrono::steady_clock::now();
+            BuildAccelerationStructures(scene);
+            m_SceneDirty = false;
+            sceneMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sceneStart).count();
         }
 
-        static float RandomValueNormalDistribution(uint32_t& state)
+        m_IntersectSpheres = m_Settings.UseSIMD ? SphereKernels::GetBest() : SphereKernels::IntersectScalar;
+
+        // Workers stay alive across frames, only a settings change restarts them
+        if (m_Settings.Serial)
+            m_ThreadPool.reset();
+        else if (!m_ThreadPool || m_ThreadPoolThreadCount != m_Settings.ThreadCount || m_ThreadPool->IsPinned() != m_Settings.PinThreads)
         {
-            float theta = 2 * 3.1415926f * FastRandom(state);
-            float rho = glm::sqrt(-2 * glm::log(FastRandom(state)));
-            return rho * glm::cos(theta);
+            m_ThreadPool = std::make_unique<ThreadPool>(m_Settings.ThreadCount, m_Settings.PinThreads);
+            m_ThreadPoolThreadCount = m_Settings.ThreadCount;
         }
+        m_WorkerStats.resize(m_ThreadPool ? m_ThreadPool->GetWorkerCount() : 1);
+        for (RenderStats& stats : m_WorkerStats)
+            stats.Clear();
 
-        static glm::vec3 RandomDirection(uint32_t& state)
+        // The features have to cover every sample of a pixel, they start out with the accumulation
+        if (m_Settings.Denoise != m_Framebuffer.HasFeatures())
         {
-            float x = RandomValueNormalDistribution(state);
-            float y = RandomValueNormalDistribution(state);
-            float z = RandomValueNormalDistribution(state);
-            return glm::normalize(glm::vec3(x, y, z));
+            m_Framebuffer.SetFeaturesEnabled(m_Settings.Denoise);
+            if (m_Settings.Denoise)
+                ResetFrameIndex();
         }
 
-        static uint32_t ConvertToRGBA(const glm::vec4& color)
+        [[maybe_unused]] double reprojectMs = 0.0;
+        if (m_CameraMoved)
         {
-            uint8_t r = (uint8_t)(color.r * 255.0f);
-            uint8_t g = (uint8_t)(color.g * 255.0f);
-            uint8_t b = (uint8_t)(color.b * 255.0f);
-            uint8_t a = (uint8_t)(color.a * 255.0f);
+            auto reprojectStart = std::chrono::steady_clock::now();
+            if (CanReproject())
+                Reproject(camera);
+            else
+                ResetFrameIndex();
+            m_CameraMoved = false;
+            reprojectMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reprojectStart).count();
+        }
+
+        // A pass renders every tile once, with a frame budget it is spread over several Render calls
+        if (m_PassTileCount == 0)
+            BeginPass();
 
-            uint32_t result = (a << 24) | (b << 16) | (g << 8) | r;
-            return result;
+        const uint32_t kernelFlags = GetKernelFlags();
+        const TileKernel renderTile = GetTileKernel(kernelFlags);
+        const bool collectStats = (kernelFlags & Kernel_Stats) != 0;
+
+        m_PendingTiles.clear();
+        for (uint32_t i = 0; i < (uint32_t)m_Tiles.size(); i++)
+        {
+            if (!m_TileRendered[i])
+                m_PendingTiles.push_back(i);
         }
 
+        // Tiles not started when the budget runs out are picked up by the next call. The first tile of a call
+        // always renders, so even a budget shorter than one tile makes progress
+        const float budgetMs = m_Settings.FrameBudgetMs;
+        std::atomic<uint32_t> renderedTileCount = 0;
+        auto renderPendingTile = [&](uint32_t taskIndex, uint32_t workerIndex)
+        {
+            const uint32_t tileIndex = m_PendingTiles[taskIndex];
+            if (budgetMs > 0.0f && taskIndex > 0)
+            {
+                // Last pass's time for this tile predicts whether it still fits
+                float elapsedMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+                if (elapsedMs + m_TileTimes[tileIndex] > budgetMs)
+                    return;
+            }
+
+            if (collectStats)
+                t_RenderStats = &m_WorkerStats[workerIndex];
+            (this->*renderTile)(tileIndex);
+            t_RenderStats = nullptr;
+            m_TileRendered[tileIndex] = 1;
+            renderedTileCount.fetch_add(1, std::memory_order_relaxed);
+        };
+
+        RunParallel((uint32_t)m_PendingTiles.size(), renderPendingTile);
+
+        // The denoiser's output changes everywhere, also where nothing was traced
+        [[maybe_unused]] double denoiseMs = 0.0;
+        if (m_Settings.Denoise)
+        {
+            auto denoiseStart = std::chrono::steady_clock::now();
+            Denoise(camera);
+            denoiseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - denoiseStart).count();
+        }
+
+        // Tracing only accumulated radiance, turn it into display pixels where it changed. New display settings
+        // apply to the whole image right away
+        const ResolveSettings resolveSettings = { m_Settings.ToneMap, m_Settings.Exposure, m_Settings.SRGB, m_Settings.Denoise };
+        const bool resolveAll = resolveSettings != m_ResolveSettings || m_Settings.Denoise;
+        m_ResolveSettings = resolveSettings;
+
+        auto resolveStart = std::chrono::steady_clock::now();
+        Resolve(resolveAll);
+        [[maybe_unused]] double resolveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - resolveStart).count();
+
+        // Each worker counted into its own slot, nothing was shared until here
+        m_LastStats.Clear();
+        if (collectStats)
+        {
+            for (const RenderStats& stats : m_WorkerStats)
+                m_LastStats.Merge(stats);
+            m_LastStats.StageMs[RenderStats::Stage_Scene] = sceneMs;
+            m_LastStats.StageMs[RenderStats::Stage_Resolve] = resolveMs;
+            m_LastStats.StageMs[RenderStats::Stage_Reproject] = reprojectMs;
+            m_LastStats.StageMs[RenderStats::Stage_Denoise] = denoiseMs;
+            m_LastStats.StageMs[RenderStats::Stage_Render] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        }
+
+        m_HistoryCamera = camera;
+
+        m_PassTileCount += renderedTileCount;
+        m_PassProgress = (float)m_PassTileCount / (float)m_Tiles.size();
+        if (m_PassTileCount < (uint32_t)m_Tiles.size())
+            return;
+
+        m_PassTileCount = 0;
+        m_LastActivePixelCount = m_ActivePixelCount;
+
+        if (m_Settings.Accumulate)
+            m_FrameIndex++;
+        else
+            m_FrameIndex = 1;
     }
-    
-    Renderer::~Renderer()
+
+    void Renderer::ResolveImage()
     {
-        delete[] m_ImageData;
+        if (!m_ActiveScene || !m_Framebuffer.GetWidth() || !m_Framebuffer.GetHeight())
+            return;
+
+        // Denoising needs features, which the next Render starts gathering if it was just turned on
+        m_ResolveSettings = { m_Settings.ToneMap, m_Settings.Exposure, m_Settings.SRGB, m_Settings.Denoise && m_Framebuffer.HasFeatures() };
+        if (m_ResolveSettings.Denoised && m_HistoryCamera)
+            Denoise(*m_HistoryCamera);
+
+        m_PendingTiles.clear();
+        Resolve(true);
     }
 
-    void Renderer::OnResize(uint32_t width, uint32_t height)
+    void Renderer::Resolve(bool resolveAll)
     {
-        if (m_FinalImage)
+        m_ResolveTiles.clear();
+        for (uint32_t tileIndex : m_PendingTiles)
         {
-            if (m_FinalImage->GetWidth() == width && m_FinalImage->GetHeight() == height)
-                return;
+            if (m_TileRendered[tileIndex])
+                m_ResolveTiles.push_back(tileIndex);
+        }
 
-            m_FinalImage->Resize(width, height);
+        if (resolveAll)
+        {
+            m_ResolveTiles.resize(m_Tiles.size());
+            for (uint32_t i = 0; i < (uint32_t)m_Tiles.size(); i++)
+                m_ResolveTiles[i] = i;
+        }
+
+        const ResolveKernels::ResolveFunc resolve = m_Settings.UseSIMD ? ResolveKernels::GetBest() : ResolveKernels::ResolveScalar;
+        auto resolveTile = [&](uint32_t taskIndex, uint32_t /*workerIndex*/)
+        {
+            const Tile& tile = m_Tiles[m_ResolveTiles[taskIndex]];
+            resolve(m_Framebuffer, tile.MinX, tile.MinY, tile.MaxX, tile.MaxY, m_ResolveSettings);
+        };
+
+        RunParallel((uint32_t)m_ResolveTiles.size(), resolveTile);
+    }
+
+    void Renderer::RunParallel(uint32_t taskCount, const ThreadPool::Task& task)
+    {
+        if (m_ThreadPool)
+        {
+            m_ThreadPool->ParallelFor(taskCount, task);
+            return;
+        }
+
+        for (uint32_t i = 0; i < taskCount; i++)
+            task(i, 0);
+    }
+
+    void Renderer::Denoise(const Camera& camera)
+    {
+        const float pixelOffset = m_Settings.JitterPrimaryRays ? 0.5f : 0.0f;
+        m_Denoiser.Denoise(m_Framebuffer, camera, pixelOffset, m_Settings.DenoiseIterations, m_Settings.UseSIMD, m_ThreadPool.get());
+    }
+
+    uint32_t Renderer::GetKernelFlags() const
+    {
+        uint32_t flags = 0;
+        if (m_Settings.PrimaryRayPackets && m_Settings.UseSIMD && PacketKernels::IsSupported())
+            flags |= Kernel_Packets;
+        if (m_Settings.Accumulate)
+            flags |= Kernel_Accumulate;
+        if (m_Framebuffer.HasFeatures())
+            flags |= Kernel_Features;
+#if RT_ENABLE_STATS
+        if (m_Settings.CollectStats)
+            flags |= Kernel_Stats;
+#endif
+        if (m_Settings.Sampler == SamplerType::Sobol)
+            flags |= Kernel_Sobol;
+        if (m_Settings.NextEventEstimation && !m_Lights.IsEmpty())
+            flags |= Kernel_LightSampling;
+        if (m_Settings.RussianRoulette)
+            flags |= Kernel_RussianRoulette;
+        if (m_Settings.Wavefront)
+            flags |= Kernel_Wavefront;
+        return flags;
+    }
+
+    Renderer::TileKernel Renderer::GetTileKernel(uint32_t flags)
+    {
+        // Every combination of flags compiled once, indexed by the flags
+        static constexpr std::array<TileKernel, KernelVariantCount> kernels = []<uint32_t... Flags>(std::integer_sequence<uint32_t, Flags...>)
+        {
+            return std::array<TileKernel, KernelVariantCount>{ &Renderer::RenderTile<Flags>... };
+        }(std::make_integer_sequence<uint32_t, KernelVariantCount>());
+
+        return kernels[flags];
+    }
+
+    bool Renderer::CanReproject() const
+    {
+        // Nothing accumulated yet, or nothing to carry over to
+        return m_Settings.Reprojection && m_Settings.Accumulate && m_HistoryCamera && m_FrameIndex > 1;
+    }
+
+    void Renderer::Reproject(const Camera& camera)
+    {
+        const Camera& previousCamera = *m_HistoryCamera;
+        m_Framebuffer.ReserveHistory();
+
+        // The surfaces are only traced when reprojecting, the ones of the previous view may be missing or stale
+        const glm::mat4 previousViewProjection = previousCamera.GetProjection() * previousCamera.GetView();
+        if (!m_SurfacesValid || m_SurfaceViewProjection != previousViewProjection)
+            TraceSurfaces(previousCamera);
+
+        m_Framebuffer.SwapHistory();
+        TraceSurfaces(camera);
+        m_SurfacesValid = true;
+        m_SurfaceViewProjection = camera.GetProjection() * camera.GetView();
+
+        RunParallel((uint32_t)m_Tiles.size(), [&](uint32_t tileIndex, uint32_t /*workerIndex*/)
+        {
+            ReprojectTile(tileIndex, camera, previousCamera);
+        });
+
+        // Continues with the carried over samples, a partly rendered pass is dropped
+        m_FrameIndex = glm::min(m_FrameIndex, glm::max(m_Settings.ReprojectionMaxHistory, 1u) + 1);
+        m_PassTileCount = 0;
+        m_SeedOffset += 0x9e3779b9;
+        std::fill(m_TileConverged.begin(), m_TileConverged.end(), (uint8_t)0);
+        m_LastActivePixelCount = m_Framebuffer.GetWidth() * m_Framebuffer.GetHeight();
+    }
+
+    void Renderer::TraceSurfaces(const Camera& camera)
+    {
+        // Jittered samples are spread over the pixel, centered on the middle of it
+        const float offset = m_Settings.JitterPrimaryRays ? 0.5f : 0.0f;
+
+        RunParallel((uint32_t)m_Tiles.size(), [&](uint32_t tileIndex, uint32_t /*workerIndex*/)
+        {
+            const Tile& tile = m_Tiles[tileIndex];
+            for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+            {
+                for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+                {
+                    Ray ray;
+                    ray.Origin = camera.GetPosition();
+                    ray.Direction = camera.GetRayDirection((float)x + offset, (float)y + offset);
+                    HitPayload payload = TraceRay<0>(ray);
+
+                    Framebuffer::SurfaceBlock& surface = m_Framebuffer.GetSurfaceBlock(x, y);
+                    const uint32_t pixel = Framebuffer::GetBlockPixel(x, y);
+                    const bool hit = payload.HitDistance >= 0.0f;
+                    surface.Depth[pixel] = hit ? payload.HitDistance : 0.0f;
+                    surface.NormalX[pixel] = hit ? payload.WorldNormal.x : 0.0f;
+                    surface.NormalY[pixel] = hit ? payload.WorldNormal.y : 0.0f;
+                    surface.NormalZ[pixel] = hit ? payload.WorldNormal.z : 0.0f;
+
+                    const glm::vec3 albedo = hit ? m_ActiveScene->Materials[payload.MaterialIndex].Albedo : glm::vec3(1.0f);
+                    surface.AlbedoR[pixel] = albedo.r;
+                    surface.AlbedoG[pixel] = albedo.g;
+                    surface.AlbedoB[pixel] = albedo.b;
+                }
+            }
+        });
+    }
+
+    void Renderer::ReprojectTile(uint32_t tileIndex, const Camera& camera, const Camera& previousCamera)
+    {
+        // A history pixel is used if its surface lies in the plane of the new one and faces the same way
+        constexpr float PlaneTolerance = 0.01f; // Relative to the distance from the camera
+        constexpr float NormalTolerance = 0.9f; // Cosine
+
+        const uint32_t width = m_Framebuffer.GetWidth();
+        const uint32_t height = m_Framebuffer.GetHeight();
+        const float offset = m_Settings.JitterPrimaryRays ? 0.5f : 0.0f;
+        const float maxHistory = (float)glm::max(m_Settings.ReprojectionMaxHistory, 1u);
+        const glm::mat4 previousViewProjection = previousCamera.GetProjection() * previousCamera.GetView();
+        const glm::vec3 previousPosition = previousCamera.GetPosition();
+
+        const Tile& tile = m_Tiles[tileIndex];
+        for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+        {
+            for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+            {
+                const Framebuffer::SurfaceBlock& surface = m_Framebuffer.GetSurfaceBlock(x, y);
+                const uint32_t pixel = Framebuffer::GetBlockPixel(x, y);
+                const float depth = surface.Depth[pixel];
+                const glm::vec3 normal = { surface.NormalX[pixel], surface.NormalY[pixel], surface.NormalZ[pixel] };
+
+                // Where the surface was on the previous screen. The sky is a direction, which projects like a point at infinity
+                const glm::vec3 direction = camera.GetRayDirection((float)x + offset, (float)y + offset);
+                const glm::vec3 position = camera.GetPosition() + direction * depth;
+                const glm::vec4 clip = depth > 0.0f ? previousViewProjection * glm::vec4(position, 1.0f) : previousViewProjection * glm::vec4(direction, 0.0f);
+                const float previousDepth = glm::length(position - previousPosition);
+
+                // Bilinear weights over the four nearest history pixels, leaving out the ones that don't match
+                glm::vec3 radiance(0.0f);
+                float luminanceMoment = 0.0f, sampleCount = 0.0f, totalWeight = 0.0f;
+                if (clip.w > 0.0f)
+                {
+                    glm::vec2 previousPixel = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * glm::vec2((float)width, (float)height) - offset;
+                    glm::vec2 base = glm::floor(previousPixel);
+                    glm::vec2 fraction = previousPixel - base;
+
+                    for (int tap = 0; tap < 4; tap++)
+                    {
+                        const int tapX = (int)base.x + (tap & 1), tapY = (int)base.y + (tap >> 1);
+                        if (tapX < 0 || tapY < 0 || tapX >= (int)width || tapY >= (int)height)
+                            continue;
+
+                        const Framebuffer::AccumulationBlock& history = m_Framebuffer.GetHistoryBlock(tapX, tapY);
+                        const Framebuffer::SurfaceBlock& historySurface = m_Framebuffer.GetHistorySurfaceBlock(tapX, tapY);
+                        const uint32_t tapPixel = Framebuffer::GetBlockPixel(tapX, tapY);
+                        const uint32_t tapSampleCount = history.SampleCount[tapPixel];
+                        const float tapDepth = historySurface.Depth[tapPixel];
+                        if (tapSampleCount == 0 || (tapDepth > 0.0f) != (depth > 0.0f))
+                            continue;
+
+                        if (depth > 0.0f)
+                        {
+                            const glm::vec3 tapNormal = { historySurface.NormalX[tapPixel], historySurface.NormalY[tapPixel], historySurface.NormalZ[tapPixel] };
+                            const glm::vec3 tapPosition = previousPosition + previousCamera.GetRayDirection((float)tapX + offset, (float)tapY + offset) * tapDepth;
+                            if (glm::dot(normal, tapNormal) < NormalTolerance || glm::abs(glm::dot(position - tapPosition, tapNormal)) > PlaneTolerance * previousDepth)
+                                continue;
+                        }
+
+                        const float weight = ((tap & 1) ? fraction.x : 1.0f - fraction.x) * ((tap >> 1) ? fraction.y : 1.0f - fraction.y);
+                        const float inverseCount = 1.0f / (float)tapSampleCount;
+                        radiance += weight * inverseCount * glm::vec3(history.Red[tapPixel], history.Green[tapPixel], history.Blue[tapPixel]);
+                        luminanceMoment += weight * inverseCount * history.LuminanceMoment[tapPixel];
+                        sampleCount += weight * (float)tapSampleCount;
+                        totalWeight += weight;
+                    }
+                }
+
+                // Means of the matching pixels, scaled back up to a sample count that is capped to the history length
+                Framebuffer::AccumulationBlock& block = m_Framebuffer.GetBlock(x, y);
+                uint32_t count = 0;
+                if (totalWeight > 1e-3f)
+                    count = (uint32_t)glm::max(glm::min(sampleCount / totalWeight, maxHistory), 1.0f);
+
+                const float scale = count ? (float)count / totalWeight : 0.0f;
+                block.Red[pixel] = radiance.r * scale;
+                block.Green[pixel] = radiance.g * scale;
+                block.Blue[pixel] = radiance.b * scale;
+                block.LuminanceMoment[pixel] = luminanceMoment * scale;
+                block.SampleCount[pixel] = count;
+
+                // Features of the history would need the same matching, the new surface stands in for all samples
+                if (m_Framebuffer.HasFeatures())
+                {
+                    Framebuffer::SurfaceBlock& features = m_Framebuffer.GetFeatureBlock(x, y);
+                    features.Depth[pixel] = depth * (float)count;
+                    features.NormalX[pixel] = normal.x * (float)count;
+                    features.NormalY[pixel] = normal.y * (float)count;
+                    features.NormalZ[pixel] = normal.z * (float)count;
+                    features.AlbedoR[pixel] = surface.AlbedoR[pixel] * (float)count;
+                    features.AlbedoG[pixel] = surface.AlbedoG[pixel] * (float)count;
+                    features.AlbedoB[pixel] = surface.AlbedoB[pixel] * (float)count;
+                }
+            }
+        }
+    }
+
+    void Renderer::BuildAccelerationStructures(const Scene& scene)
+    {
+        m_SceneUsesBVH = m_Settings.UseBVH;
+        if (m_Settings.UseBVH)
+        {
+            if (!m_PrebuiltSphereBVH.IsEmpty() && m_PrebuiltSphereBVH.GetPrimitiveIndices().size() == scene.Spheres.size())
+                m_SphereBVH = std::move(m_PrebuiltSphereBVH);
+            else
+                m_SphereBVH.Build(scene.Spheres);
+            m_PrebuiltSphereBVH.Clear();
+            m_SphereData.Build(scene.Spheres, m_SphereBVH.GetPrimitiveIndices());
+
+            std::vector<AABB> triangleBounds;
+            std::vector<glm::vec3> triangleCentroids;
+            TriangleData::GetBounds(scene.Meshes, triangleBounds, triangleCentroids);
+            m_TriangleBVH.Build(triangleBounds, triangleCentroids);
+            m_TriangleData.Build(scene.Meshes, m_TriangleBVH.GetPrimitiveIndices());
+
+            m_InstanceData.Build(scene, true);
         }
         else
         {
-            m_FinalImage = std::make_shared<Walnut::Image>(width, height, Walnut::ImageFormat::RGBA);
+            m_SphereBVH.Clear();
+            m_SphereData.Build(scene.Spheres);
+
+            m_TriangleBVH.Clear();
+            m_TriangleData.Build(scene.Meshes);
+
+            m_InstanceData.Build(scene, false);
         }
 
-        delete[] m_ImageData;
-        m_ImageData = new uint32_t[width * height];
+        m_SphereSlots.resize(m_SphereData.Count);
+        for (uint32_t slot = 0; slot < m_SphereData.Count; slot++)
+            m_SphereSlots[m_SphereData.SphereIndices[slot]] = slot;
+
+        m_Lights.Build(scene);
+    }
+
+    void Renderer::ApplySceneChanges(Scene& scene)
+    {
+        if (!scene.HasChanges())
+            return;
 
-        delete[] m_AccumulationData;
-        m_AccumulationData = new glm::vec4[width * height];
+        // Nothing was built for this scene yet, the next Render picks up everything anyway
+        if (m_SceneDirty || m_ActiveScene != &scene || !m_ActiveCamera)
+        {
+            scene.ClearChanges();
+            return;
+        }
 
-        m_ImageHorizontalIter.resize(width);
-        m_ImageVerticaltalIter.resize(height);
-        for (uint32_t i = 0; i < width; i++)
-            m_ImageHorizontalIter[i] = i;
-        for (uint32_t i = 0; i < height; i++)
-            m_ImageVerticaltalIter[i] = i;
+        // A material can show up anywhere through reflections
+        if (!scene.DirtyMaterials.empty())
+            ResetFrameIndex();
+
+        std::vector<uint32_t>& dirtySpheres = scene.DirtySpheres;
+        std::sort(dirtySpheres.begin(), dirtySpheres.end());
+        dirtySpheres.erase(std::unique(dirtySpheres.begin(), dirtySpheres.end()), dirtySpheres.end());
+
+        // Refitting many spheres costs about as much as a rebuild and leaves a much worse tree
+        if (scene.Spheres.size() != m_SphereData.Count || dirtySpheres.size() > m_SphereData.Count / 4)
+        {
+            InvalidateScene();
+            ResetFrameIndex();
+            scene.ClearChanges();
+            return;
+        }
+
+        // The surfaces reprojection matches against may show the spheres where they were
+        if (!dirtySpheres.empty())
+            m_SurfacesValid = false;
+
+        std::vector<uint32_t> slots;
+        slots.reserve(dirtySpheres.size());
+        for (uint32_t sphereIndex : dirtySpheres)
+        {
+            const uint32_t slot = m_SphereSlots[sphereIndex];
+            const Sphere& sphere = scene.Spheres[sphereIndex];
+
+            // Where the sphere was, from the copy the renderer still has, and where it is now
+            glm::vec3 oldCenter = { m_SphereData.CenterX[slot], m_SphereData.CenterY[slot], m_SphereData.CenterZ[slot] };
+            float oldRadius = glm::sqrt(m_SphereData.RadiusSquared[slot]);
+            float radius = glm::abs(sphere.Radius);
+            InvalidateRegion({ oldCenter - oldRadius, oldCenter + oldRadius });
+            InvalidateRegion({ sphere.Position - radius, sphere.Position + radius });
+
+            m_SphereData.Update(slot, sphere);
+            slots.push_back(slot);
+        }
+
+        if (m_SceneUsesBVH)
+        {
+            m_SphereBVH.Refit(slots, [&](uint32_t slot)
+            {
+                const Sphere& sphere = scene.Spheres[m_SphereData.SphereIndices[slot]];
+                float radius = glm::abs(sphere.Radius);
+                return AABB{ sphere.Position - radius, sphere.Position + radius };
+            });
+        }
+
+        // Lights shine on everything they can see, a light that was or is among the changed spheres restarts
+        // all of the accumulation
+        bool lightChanged = false;
+        for (uint32_t sphereIndex : dirtySpheres)
+            lightChanged |= m_Lights.GetLightIndex(sphereIndex) >= 0;
+        m_Lights.Build(scene);
+        for (uint32_t sphereIndex : dirtySpheres)
+            lightChanged |= m_Lights.GetLightIndex(sphereIndex) >= 0;
+        if (lightChanged)
+            ResetFrameIndex();
+
+        scene.ClearChanges();
     }
 
-    void Renderer::Render(const Scene& scene, const Camera& camera)
+    void Renderer::InvalidateRegion(const AABB& bounds)
     {
-        if (!m_FinalImage->GetWidth() || !m_FinalImage->GetHeight())
+        const uint32_t width = m_Framebuffer.GetWidth();
+        const uint32_t height = m_Framebuffer.GetHeight();
+        const glm::mat4 viewProjection = m_ActiveCamera->GetProjection() * m_ActiveCamera->GetView();
+
+        glm::vec2 min(std::numeric_limits<float>::max());
+        glm::vec2 max(-std::numeric_limits<float>::max());
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 point = { corner & 1 ? bounds.Max.x : bounds.Min.x, corner & 2 ? bounds.Max.y : bounds.Min.y, corner & 4 ? bounds.Max.z : bounds.Min.z };
+            glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            if (clip.w <= 0.0f)
+            {
+                // Reaches behind the camera, where the projection doesn't bound anything
+                min = glm::vec2(0.0f);
+                max = glm::vec2((float)width, (float)height);
+                break;
+            }
+
+            glm::vec2 pixel = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * glm::vec2((float)width, (float)height);
+            min = glm::min(min, pixel);
+            max = glm::max(max, pixel);
+        }
+
+        // Contact shadows and nearby reflections spill past the object's outline
+        glm::vec2 margin = (max - min) * 0.5f + 2.0f;
+        min = glm::clamp(min - margin, glm::vec2(0.0f), glm::vec2((float)width, (float)height));
+        max = glm::clamp(max + margin, glm::vec2(0.0f), glm::vec2((float)width, (float)height));
+
+        uint32_t minX = (uint32_t)min.x, minY = (uint32_t)min.y;
+        uint32_t maxX = (uint32_t)glm::ceil(max.x), maxY = (uint32_t)glm::ceil(max.y);
+        if (minX >= maxX || minY >= maxY)
             return;
 
+        m_Framebuffer.ClearAccumulation(minX, minY, maxX, maxY);
+        for (uint32_t i = 0; i < (uint32_t)m_Tiles.size(); i++)
+        {
+            const Tile& tile = m_Tiles[i];
+            if (tile.MinX < maxX && tile.MaxX > minX && tile.MinY < maxY && tile.MaxY > minY)
+                m_TileConverged[i] = 0;
+        }
+    }
+
+    void Renderer::BeginPass()
+    {
+        const uint32_t width = m_Framebuffer.GetWidth();
+        const uint32_t height = m_Framebuffer.GetHeight();
+
+        std::fill(m_TileRendered.begin(), m_TileRendered.end(), (uint8_t)0);
+
+        // Tiles outside the render regions count as done from the start
+        uint32_t pixelCount = width * height;
+        if (!m_RenderRegions.empty())
+        {
+            pixelCount = 0;
+            for (uint32_t i = 0; i < (uint32_t)m_Tiles.size(); i++)
+            {
+                const Tile& tile = m_Tiles[i];
+                bool inside = std::any_of(m_RenderRegions.begin(), m_RenderRegions.end(), [&](const Tile& region)
+                {
+                    return tile.MinX < region.MaxX && region.MinX < tile.MaxX && tile.MinY < region.MaxY && region.MinY < tile.MaxY;
+                });
+
+                if (inside)
+                    pixelCount += (tile.MaxX - tile.MinX) * (tile.MaxY - tile.MinY);
+                else
+                {
+                    m_TileRendered[i] = 1;
+                    m_PassTileCount++;
+                }
+            }
+        }
+
+        if (m_FrameIndex == 1 || m_Settings.AdaptiveThreshold != m_AdaptiveThreshold)
+        {
+            std::fill(m_TileConverged.begin(), m_TileConverged.end(), (uint8_t)0);
+            m_AdaptiveThreshold = m_Settings.AdaptiveThreshold;
+        }
+
+        // Without accumulation the kernels overwrite every pixel they render, only the ones outside the regions
+        // would be left over from earlier
         if (m_FrameIndex == 1)
-            memset(m_AccumulationData, 0, m_FinalImage->GetWidth() * m_FinalImage->GetHeight() * sizeof(glm::vec4));
+        {
+            if (m_Settings.Accumulate || !m_RenderRegions.empty())
+                m_Framebuffer.ClearAccumulation();
+            m_LastActivePixelCount = pixelCount;
+        }
 
-        m_ActiveScene = &scene;
-        m_ActiveCamera = &camera;
+        // Converged pixels hand their share of the frame's sample budget to the ones that are still noisy
+        const uint32_t samplesPerPixel = glm::max(m_Settings.SamplesPerPixel, 1u);
+        m_FrameSamplesPerPixel = samplesPerPixel;
+        if (m_Settings.AdaptiveSampling && m_LastActivePixelCount > 0)
+        {
+            uint64_t budget = (uint64_t)samplesPerPixel * pixelCount;
+            m_FrameSamplesPerPixel = (uint32_t)std::clamp<uint64_t>(budget / m_LastActivePixelCount, samplesPerPixel, samplesPerPixel * MaxAdaptiveBoost);
+        }
+        m_ActivePixelCount = 0;
+    }
+
+    template<uint32_t Flags>
+    void Renderer::RenderTile(uint32_t tileIndex)
+    {
+        auto start = std::chrono::steady_clock::now();
 
-#if RT_ENABLE_MT
-        std::for_each(std::execution::par, m_ImageVerticaltalIter.begin(), m_ImageVerticaltalIter.end(), [this](uint32_t y)
+        // A tile whose pixels all converged costs nothing until the accumulation is reset
+        if (m_Settings.AdaptiveSampling && m_TileConverged[tileIndex])
         {
-            std::for_each(std::execution::par, m_ImageHorizontalIter.begin(), m_ImageHorizontalIter.end(), [this, y](uint32_t x)
+            m_TileTimes[tileIndex] = 0.0f;
+            return;
+        }
+
+        const Tile& tile = m_Tiles[tileIndex];
+
+        uint32_t rayCount = 0;
+        uint32_t activePixelCount = 0;
+        if constexpr ((Flags & Kernel_Wavefront) != 0)
+            rayCount = RenderTileWavefront<Flags & WavefrontFlags>(tile, activePixelCount);
+        else
+        {
+            for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
             {
-                glm::vec4 color = PerPixel(x, y);
-                m_AccumulationData[x + y * m_FinalImage->GetWidth()] += color;
+                if constexpr ((Flags & Kernel_Packets) != 0)
+                {
+                    for (uint32_t x = tile.MinX; x < tile.MaxX; x += RayPacket::Width)
+                    {
+                        const uint32_t laneCount = glm::min(RayPacket::Width, tile.MaxX - x);
 
-                glm::vec4 accumulateColor = m_AccumulationData[x + y * m_FinalImage->GetWidth()] / (float)m_FrameIndex;
-                accumulateColor = glm::clamp(accumulateColor, glm::vec4(0.0f), glm::vec4(1.0f));
-                m_ImageData[x + y * m_FinalImage->GetWidth()] = Utils::ConvertToRGBA(accumulateColor);
-            });
-        });
-#else
-        for (uint32_t y = 0; y < m_FinalImage->GetHeight(); y++)
+                        uint32_t activeLanes = 0;
+                        for (uint32_t lane = 0; lane < laneCount; lane++)
+                        {
+                            if (!IsConverged<Flags>(x + lane, y))
+                                activeLanes |= 1u << lane;
+                        }
+
+                        if (activeLanes)
+                        {
+                            rayCount += RenderPacket<Flags & PixelFlags>(x, y, laneCount, activeLanes);
+                            activePixelCount += std::popcount(activeLanes);
+                        }
+                    }
+                }
+                else
+                {
+                    for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+                    {
+                        if (IsConverged<Flags>(x, y))
+                            continue;
+
+                        rayCount += RenderPixel<Flags & PixelFlags>(x, y);
+                        activePixelCount++;
+                    }
+                }
+            }
+        }
+
+        if (activePixelCount == 0)
+            m_TileConverged[tileIndex] = 1;
+
+        m_RayCount.fetch_add(rayCount, std::memory_order_relaxed);
+        m_ActivePixelCount.fetch_add(activePixelCount, std::memory_order_relaxed);
+        m_TileTimes[tileIndex] = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        RT_KERNEL_STATS_ADD(StageMs[RenderStats::Stage_Tiles], m_TileTimes[tileIndex]);
+    }
+
+    template<uint32_t Flags>
+    uint32_t Renderer::RenderPixel(uint32_t x, uint32_t y)
+    {
+        const uint32_t sampleCount = GetSampleCount<Flags>(x, y);
+
+        uint32_t rayCount = 0;
+        glm::vec3 color(0.0f);
+        float luminanceSquared = 0.0f;
+        SurfaceFeatures features;
+        for (uint32_t i = 0; i < m_FrameSamplesPerPixel; i++)
+        {
+            glm::vec3 sample = PerPixel<Flags>(x, y, sampleCount + i + 1, rayCount, features);
+            float luminance = Utils::Luminance(sample);
+
+            color += sample;
+            luminanceSquared += luminance * luminance;
+        }
+
+        StorePixel<Flags>(x, y, color, luminanceSquared, features);
+        return rayCount;
+    }
+
+    template<uint32_t Flags>
+    uint32_t Renderer::RenderPacket(uint32_t x, uint32_t y, uint32_t laneCount, uint32_t activeLanes)
+    {
+        uint32_t sampleCounts[RayPacket::Width];
+        for (uint32_t lane = 0; lane < laneCount; lane++)
+            sampleCounts[lane] = GetSampleCount<Flags>(x + lane, y);
+
+        uint32_t rayCount = 0;
+        glm::vec3 colors[RayPacket::Width] = {};
+        float luminanceSquared[RayPacket::Width] = {};
+        SurfaceFeatures features[RayPacket::Width];
+        for (uint32_t i = 0; i < m_FrameSamplesPerPixel; i++)
         {
-            for (uint32_t x = 0; x < m_FinalImage->GetWidth(); x++)
+            Sampler samplers[RayPacket::Width];
+            Ray rays[RayPacket::Width];
+            for (uint32_t lane = 0; lane < laneCount; lane++)
             {
-                glm::vec4 color = PerPixel(x, y);
-                color = glm::clamp(color, glm::vec4(0.0f), glm::vec4(1.0f));
-                m_ImageData[x + y * m_FinalImage->GetWidth()] = Utils::ConvertToRGBA(color);
+                samplers[lane] = GetSampler(x + lane, y, sampleCounts[lane] + i + 1);
+                rays[lane] = GetPrimaryRay(x + lane, y, samplers[lane]);
+            }
+
+            // A packet cut off by the edge of its tile repeats its last ray in the unused lanes
+            RayPacket packet;
+            for (uint32_t lane = 0; lane < RayPacket::Width; lane++)
+                packet.SetRay(lane, rays[glm::min(lane, laneCount - 1)]);
+
+            [[maybe_unused]] const uint32_t sphereTests = m_Settings.UseBVH ? PacketKernels::IntersectBVH(packet, m_SphereBVH, m_SphereData)
+                : PacketKernels::IntersectAll(packet, m_SphereData);
+            RT_KERNEL_STATS_ADD(SphereTests, sphereTests);
+
+            // Secondary rays lose coherence after the first bounce, trace those one at a time
+            for (uint32_t lane = 0; lane < laneCount; lane++)
+            {
+                if (!(activeLanes & (1u << lane)))
+                    continue;
+
+                // Packets only cover the scene's own spheres, the rest is traced per lane
+                float hitDistance = packet.Slot[lane] < 0 ? std::numeric_limits<float>::max() : packet.HitDistance[lane];
+                HitPayload payload = TraceBeyondSpheres<Flags & TraceFlags>(rays[lane], hitDistance, packet.Slot[lane]);
+                rayCount++;
+                RT_KERNEL_STATS_ADD(PrimaryRays, 1);
+                if constexpr ((Flags & Kernel_Features) != 0)
+                    AddFeatures(features[lane], payload);
+
+                glm::vec3 sample = TracePath<Flags & PathFlags>(rays[lane], payload, samplers[lane], rayCount);
+                float luminance = Utils::Luminance(sample);
+
+                colors[lane] += sample;
+                luminanceSquared[lane] += luminance * luminance;
             }
         }
-#endif
 
-        if (m_Settings.Accumulate)
-            m_FrameIndex++;
+        for (uint32_t lane = 0; lane < laneCount; lane++)
+        {
+            if (!(activeLanes & (1u << lane)))
+                continue;
+
+            StorePixel<Flags>(x + lane, y, colors[lane], luminanceSquared[lane], features[lane]);
+        }
+
+        return rayCount;
+    }
+
+    template<uint32_t Flags>
+    uint32_t Renderer::RenderTileWavefront(const Tile& tile, uint32_t& activePixelCount)
+    {
+        WavefrontQueues& queues = t_WavefrontQueues;
+
+        queues.Pixels.clear();
+        for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+        {
+            for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+            {
+                if (!IsConverged<Flags>(x, y))
+                    queues.Pixels.push_back(x | y << 16);
+            }
+        }
+
+        const uint32_t pixelCount = (uint32_t)queues.Pixels.size();
+        activePixelCount = pixelCount;
+        if (pixelCount == 0)
+            return 0;
+
+        // Generate a path per sample, sample by sample, so neighbouring slots start as neighbouring camera rays
+        const uint32_t sampleCount = pixelCount * m_FrameSamplesPerPixel;
+        queues.Reserve(sampleCount);
+
+        PathQueue& paths = queues.Paths;
+        for (uint32_t i = 0; i < m_FrameSamplesPerPixel; i++)
+        {
+            for (uint32_t pixel = 0; pixel < pixelCount; pixel++)
+            {
+                const uint32_t x = queues.Pixels[pixel] & 0xffff, y = queues.Pixels[pixel] >> 16;
+                const uint32_t slot = i * pixelCount + pixel;
+
+                paths.Samplers[slot] = GetSampler(x, y, GetSampleCount<Flags>(x, y) + i + 1);
+                Ray ray = GetPrimaryRay(x, y, paths.Samplers[slot]);
+                paths.Origins[slot] = ray.Origin;
+                paths.Directions[slot] = ray.Direction;
+                paths.Throughputs[slot] = glm::vec3(1.0f);
+                paths.Radiance[slot] = glm::vec3(0.0f);
+                paths.LightSampledPdfs[slot] = 0.0f;
+                paths.SampleSlots[slot] = slot;
+                paths.Alive[slot] = 1;
+            }
+        }
+        paths.Count = sampleCount;
+
+        // Every pass of the loop takes all paths still alive one bounce further
+        uint32_t rayCount = 0;
+        const uint32_t bounces = glm::max(m_Settings.MaxDepth, 1u);
+        for (uint32_t bounce = 0; bounce < bounces && paths.Count > 0; bounce++)
+        {
+            rayCount += ExtendPaths<Flags & ExtendFlags>(queues, bounce);
+
+            if (m_Settings.WavefrontSorting == PathSorting::Material)
+            {
+                // Misses first, they all shade the same
+                for (uint32_t slot = 0; slot < paths.Count; slot++)
+                    queues.SortKeys[slot] = queues.Hits.Distances[slot] < 0.0f ? 0 : (uint32_t)queues.Hits.MaterialIndices[slot] + 1;
+                queues.SortPaths(true);
+            }
+
+            rayCount += ShadePaths<Flags & PathFlags>(queues, bounce);
+            TraceShadowRays<Flags>(queues);
+
+            for (uint32_t slot = 0; slot < paths.Count; slot++)
+            {
+                if (!paths.Alive[slot])
+                    queues.SampleRadiance[paths.SampleSlots[slot]] = paths.Radiance[slot];
+            }
+
+            if (m_Settings.WavefrontSorting == PathSorting::Direction)
+            {
+                for (uint32_t slot = 0; slot < paths.Count; slot++)
+                {
+                    const glm::vec3& direction = paths.Directions[slot];
+                    queues.SortKeys[slot] = paths.Alive[slot] ? (direction.x < 0.0f) | (direction.y < 0.0f) << 1 | (direction.z < 0.0f) << 2 : WavefrontQueues::DeadKey;
+                }
+                queues.SortPaths(false);
+            }
+            else
+            {
+                queues.CompactPaths();
+            }
+        }
+
+        // Sum each pixel's samples in order, the same sums the path by path kernels make
+        for (uint32_t pixel = 0; pixel < pixelCount; pixel++)
+        {
+            glm::vec3 color(0.0f);
+            float luminanceSquared = 0.0f;
+            SurfaceFeatures features;
+            for (uint32_t i = 0; i < m_FrameSamplesPerPixel; i++)
+            {
+                const uint32_t slot = i * pixelCount + pixel;
+                const glm::vec3& sample = queues.SampleRadiance[slot];
+                float luminance = Utils::Luminance(sample);
+
+                color += sample;
+                luminanceSquared += luminance * luminance;
+                if constexpr ((Flags & Kernel_Features) != 0)
+                {
+                    features.Albedo += queues.SampleAlbedo[slot];
+                    features.Normal += queues.SampleNormal[slot];
+                    features.Depth += queues.SampleDepth[slot];
+                }
+            }
+
+            StorePixel<Flags>(queues.Pixels[pixel] & 0xffff, queues.Pixels[pixel] >> 16, color, luminanceSquared, features);
+        }
+
+        return rayCount;
+    }
+
+    template<uint32_t Flags>
+    uint32_t Renderer::ExtendPaths(WavefrontQueues& queues, uint32_t bounce)
+    {
+        PathQueue& paths = queues.Paths;
+        HitQueue& hits = queues.Hits;
+
+        auto storeHit = [&](uint32_t slot, const HitPayload& payload)
+        {
+            hits.Distances[slot] = payload.HitDistance;
+            hits.Positions[slot] = payload.WorldPosition;
+            hits.Normals[slot] = payload.WorldNormal;
+            hits.MaterialIndices[slot] = payload.MaterialIndex;
+            hits.LightIndices[slot] = payload.LightIndex;
+
+            if constexpr ((Flags & Kernel_Features) != 0)
+            {
+                if (bounce == 0)
+                {
+                    SurfaceFeatures features;
+                    AddFeatures(features, payload);
+
+                    const uint32_t sampleSlot = paths.SampleSlots[slot];
+                    queues.SampleAlbedo[sampleSlot] = features.Albedo;
+                    queues.SampleNormal[sampleSlot] = features.Normal;
+                    queues.SampleDepth[sampleSlot] = features.Depth;
+                }
+            }
+        };
+
+        if (bounce == 0)
+            RT_KERNEL_STATS_ADD(PrimaryRays, paths.Count);
         else
-            m_FrameIndex = 1;
+            RT_KERNEL_STATS_ADD(SecondaryRays, paths.Count);
+
+        // Camera rays are still coherent, the queue feeds them to the packet kernels eight at a time
+        if constexpr ((Flags & Kernel_Packets) != 0)
+        {
+            if (bounce == 0)
+            {
+                for (uint32_t first = 0; first < paths.Count; first += RayPacket::Width)
+                {
+                    const uint32_t laneCount = glm::min(RayPacket::Width, paths.Count - first);
+
+                    RayPacket packet;
+                    for (uint32_t lane = 0; lane < RayPacket::Width; lane++)
+                    {
+                        const uint32_t slot = first + glm::min(lane, laneCount - 1);
+                        packet.SetRay(lane, { paths.Origins[slot], paths.Directions[slot] });
+                    }
+
+                    [[maybe_unused]] const uint32_t sphereTests = m_Settings.UseBVH ? PacketKernels::IntersectBVH(packet, m_SphereBVH, m_SphereData)
+                        : PacketKernels::IntersectAll(packet, m_SphereData);
+                    RT_KERNEL_STATS_ADD(SphereTests, sphereTests);
+
+                    for (uint32_t lane = 0; lane < laneCount; lane++)
+                    {
+                        const uint32_t slot = first + lane;
+                        float hitDistance = packet.Slot[lane] < 0 ? std::numeric_limits<float>::max() : packet.HitDistance[lane];
+                        storeHit(slot, TraceBeyondSpheres<Flags & TraceFlags>({ paths.Origins[slot], paths.Directions[slot] }, hitDistance, packet.Slot[lane]));
+                    }
+                }
+                return paths.Count;
+            }
+        }
 
-        m_FinalImage->SetData(m_ImageData);
+        for (uint32_t slot = 0; slot < paths.Count; slot++)
+            storeHit(slot, TraceRay<Flags & TraceFlags>({ paths.Origins[slot], paths.Directions[slot] }));
+        return paths.Count;
     }
 
-    glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
+    template<uint32_t Flags>
+    uint32_t Renderer::ShadePaths(WavefrontQueues& queues, uint32_t bounce)
     {
+        constexpr SamplerType samplerType = (Flags & Kernel_Sobol) != 0 ? SamplerType::Sobol : SamplerType::Independent;
+
+        PathQueue& paths = queues.Paths;
+        const HitQueue& hits = queues.Hits;
+        ShadowQueue& shadows = queues.Shadows;
+        shadows.Count = 0;
+
+        // The same steps as one bounce of TracePath, see there
+        const uint32_t bounces = glm::max(m_Settings.MaxDepth, 1u);
+        for (uint32_t slot = 0; slot < paths.Count; slot++)
+        {
+            glm::vec3& color = paths.Throughputs[slot];
+            glm::vec3& incomingLight = paths.Radiance[slot];
+
+            if (hits.Distances[slot] < 0.0f)
+            {
+                glm::vec3 skyColor = glm::vec3(0.6f, 0.7f, 0.9f);
+                incomingLight += skyColor * color;
+                paths.Alive[slot] = 0;
+                RT_KERNEL_STATS_ADD(PathLengths[glm::min(bounce, RenderStats::PathLengthBins - 1)], 1);
+                continue;
+            }
+
+            const Material& material = m_ActiveScene->Materials[hits.MaterialIndices[slot]];
+            const glm::vec3& normal = hits.Normals[slot];
+            const Sampler& sampler = paths.Samplers[slot];
+
+            glm::vec3 emission = material.EmissionColor * material.EmissionStrength;
+            if (paths.LightSampledPdfs[slot] > 0.0f && hits.LightIndices[slot] >= 0)
+                emission *= Utils::PowerHeuristic(paths.LightSampledPdfs[slot], m_Lights.GetPdf((uint32_t)hits.LightIndices[slot], paths.Origins[slot]));
+            incomingLight += emission * color;
+
+            glm::vec3& origin = paths.Origins[slot];
+            glm::vec3& direction = paths.Directions[slot];
+            origin = hits.Positions[slot] + normal * 0.0001f;
+            glm::vec3 diffuseDir = Utils::CosineHemisphereDirection(normal, sampler.Get2D<samplerType>(Sampler::GetDirectionDimension(bounce)));
+            glm::vec3 reflectDir = glm::reflect(direction, normal);
+            direction = glm::normalize(glm::mix(reflectDir, diffuseDir, material.Roughness));
+
+            // The shadow ray waits in its queue, its light is added before the path's next hit is shaded
+            paths.LightSampledPdfs[slot] = 0.0f;
+            if ((Flags & Kernel_LightSampling) != 0 && material.Roughness >= 1.0f)
+            {
+                ShadowRay shadowRay;
+                if (SampleLight<Flags>(origin, normal, sampler, bounce, shadowRay))
+                {
+                    const uint32_t shadow = shadows.Count++;
+                    shadows.Origins[shadow] = shadowRay.ToLight.Origin;
+                    shadows.Directions[shadow] = shadowRay.ToLight.Direction;
+                    shadows.MaxDistances[shadow] = shadowRay.MaxDistance;
+                    shadows.Radiance[shadow] = shadowRay.Radiance * material.Albedo * color;
+                    shadows.PathSlots[shadow] = slot;
+                }
+                paths.LightSampledPdfs[slot] = glm::max(glm::dot(normal, direction), 0.0f) / 3.1415926f;
+            }
+
+            color *= material.Albedo;
+
+            if (bounce + 1 == bounces)
+            {
+                paths.Alive[slot] = 0;
+                RT_KERNEL_STATS_ADD(PathLengths[glm::min(bounces, RenderStats::PathLengthBins - 1)], 1);
+            }
+            else if ((Flags & Kernel_RussianRoulette) != 0 && bounce + 1 >= m_Settings.RussianRouletteDepth)
+            {
+                float survival = glm::min(glm::max(color.r, glm::max(color.g, color.b)), 1.0f);
+                if (sampler.Get1D<samplerType>(Sampler::GetRouletteDimension(bounce)) >= survival)
+                {
+                    paths.Alive[slot] = 0;
+                    RT_KERNEL_STATS_ADD(PathLengths[glm::min(bounce + 1, RenderStats::PathLengthBins - 1)], 1);
+                }
+                else
+                {
+                    color /= survival;
+                }
+            }
+        }
+
+        RT_KERNEL_STATS_ADD(ShadowRays, shadows.Count);
+        return shadows.Count;
+    }
+
+    template<uint32_t Flags>
+    void Renderer::TraceShadowRays(WavefrontQueues& queues) const
+    {
+        const ShadowQueue& shadows = queues.Shadows;
+        for (uint32_t shadow = 0; shadow < shadows.Count; shadow++)
+        {
+            if (!IsOccluded<Flags>({ shadows.Origins[shadow], shadows.Directions[shadow] }, shadows.MaxDistances[shadow]))
+                queues.Paths.Radiance[shadows.PathSlots[shadow]] += shadows.Radiance[shadow];
+        }
+    }
+
+    template<uint32_t Flags>
+    bool Renderer::IsConverged(uint32_t x, uint32_t y) const
+    {
+        // Without accumulation a pixel has no samples to judge before it is rendered
+        if (!(Flags & Kernel_Accumulate) || !m_Settings.AdaptiveSampling)
+            return false;
+
+        const float sampleCount = (float)m_Framebuffer.GetSampleCount(x, y);
+        if (sampleCount < (float)glm::max(m_Settings.AdaptiveMinSamples, 2u))
+            return false;
+
+        // Standard error of the mean luminance relative to the mean, floored so black pixels can converge too
+        float mean = Utils::Luminance(m_Framebuffer.GetRadianceSum(x, y)) / sampleCount;
+        float meanSquared = m_Framebuffer.GetLuminanceMoment(x, y) / sampleCount;
+        float variance = glm::max(meanSquared - mean * mean, 0.0f) * sampleCount / (sampleCount - 1.0f);
+        float standardError = glm::sqrt(variance / sampleCount);
+
+        return standardError <= m_Settings.AdaptiveThreshold * glm::max(mean, 0.01f);
+    }
+
+    Ray Renderer::GetPrimaryRay(uint32_t x, uint32_t y, const Sampler& sampler) const
+    {
+        glm::vec2 offset(0.0f);
+        if (m_Settings.JitterPrimaryRays)
+            offset = sampler.Get2D(Sampler::JitterDimension);
+
         Ray ray;
         ray.Origin = m_ActiveCamera->GetPosition();
-        ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_FinalImage->GetWidth()];
+        ray.Direction = m_ActiveCamera->GetRayDirection((float)x + offset.x, (float)y + offset.y);
+        return ray;
+    }
+
+    Sampler Renderer::GetSampler(uint32_t x, uint32_t y, uint32_t sampleIndex) const
+    {
+        // Only the sample index changes between a pixel's samples, so low-discrepancy sequences stay intact
+        uint32_t seed = Utils::HashCombine(x + y * m_Framebuffer.GetWidth(), m_SeedOffset);
+        return Sampler(m_Settings.Sampler, seed, sampleIndex - 1);
+    }
+
+    template<uint32_t Flags>
+    uint32_t Renderer::GetSampleCount(uint32_t x, uint32_t y) const
+    {
+        // Without accumulation every pass starts over, and the buffer may still hold the last one
+        if constexpr ((Flags & Kernel_Accumulate) != 0)
+            return m_Framebuffer.GetSampleCount(x, y);
+        else
+            return 0;
+    }
+
+    template<uint32_t Flags>
+    void Renderer::StorePixel(uint32_t x, uint32_t y, const glm::vec3& color, float luminanceSquared, const SurfaceFeatures& features)
+    {
+        if constexpr ((Flags & Kernel_Accumulate) != 0)
+            m_Framebuffer.Accumulate(x, y, color, m_FrameSamplesPerPixel, luminanceSquared);
+        else
+            m_Framebuffer.Store(x, y, color, m_FrameSamplesPerPixel, luminanceSquared);
+
+        if constexpr ((Flags & Kernel_Features) != 0 && (Flags & Kernel_Accumulate) != 0)
+            m_Framebuffer.AccumulateFeatures(x, y, features.Albedo, features.Normal, features.Depth);
+        else if constexpr ((Flags & Kernel_Features) != 0)
+            m_Framebuffer.StoreFeatures(x, y, features.Albedo, features.Normal, features.Depth);
+    }
+
+    template<uint32_t Flags>
+    glm::vec3 Renderer::PerPixel(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t& rayCount, SurfaceFeatures& features)
+    {
+        const Sampler sampler = GetSampler(x, y, sampleIndex);
+        Ray ray = GetPrimaryRay(x, y, sampler);
+        HitPayload payload = TraceRay<Flags & TraceFlags>(ray);
+        rayCount++;
+        RT_KERNEL_STATS_ADD(PrimaryRays, 1);
+        if constexpr ((Flags & Kernel_Features) != 0)
+            AddFeatures(features, payload);
+
+        return TracePath<Flags & PathFlags>(ray, payload, sampler, rayCount);
+    }
+
+    void Renderer::AddFeatures(SurfaceFeatures& features, const HitPayload& primaryHit) const
+    {
+        // The sky passes its color straight through, like a white surface would
+        if (primaryHit.HitDistance < 0.0f)
+        {
+            features.Albedo += glm::vec3(1.0f);
+            return;
+        }
+
+        features.Albedo += m_ActiveScene->Materials[primaryHit.MaterialIndex].Albedo;
+        features.Normal += primaryHit.WorldNormal;
+        features.Depth += primaryHit.HitDistance;
+    }
+
+    template<uint32_t Flags>
+    glm::vec3 Renderer::TracePath(Ray ray, HitPayload payload, const Sampler& sampler, uint32_t& rayCount)
+    {
+        constexpr SamplerType samplerType = (Flags & Kernel_Sobol) != 0 ? SamplerType::Sobol : SamplerType::Independent;
 
         glm::vec3 color = glm::vec3(1.0f);
         glm::vec3 incomingLight = glm::vec3(0.0f);
 
-        uint32_t seed = x + y * m_FinalImage->GetWidth();
-        seed *= m_FrameIndex;
+        // Density of the last bounce's direction when the lights were also sampled there, 0 otherwise
+        float lightSampledPdf = 0.0f;
 
-        int bounces = 5;
+        const int bounces = (int)glm::max(m_Settings.MaxDepth, 1u);
         for (int i = 0; i < bounces; i++)
         {
-            seed += i;
+            // The primary hit is traced by the caller, on its own or as part of a packet
+            if (i > 0)
+            {
+                payload = TraceRay<Flags & TraceFlags>(ray);
+                rayCount++;
+                RT_KERNEL_STATS_ADD(SecondaryRays, 1);
+            }
 
-            HitPayload payload = TraceRay(ray);
             if (payload.HitDistance >= 0.0f)
             {
-                const Sphere& closestSphere = m_ActiveScene->Spheres[payload.ObjectIndex];
-                const Material& material = m_ActiveScene->Materials[closestSphere.MaterialIndex];
+                const Material& material = m_ActiveScene->Materials[payload.MaterialIndex];
+
+                // A light the last surface sampled directly only counts with the weight of the bounce's density
+                glm::vec3 emission = material.EmissionColor * material.EmissionStrength;
+                if (lightSampledPdf > 0.0f && payload.LightIndex >= 0)
+                    emission *= Utils::PowerHeuristic(lightSampledPdf, m_Lights.GetPdf((uint32_t)payload.LightIndex, ray.Origin));
+                incomingLight += emission * color;
 
                 ray.Origin = payload.WorldPosition + payload.WorldNormal * 0.0001f; // Moving out little bit
-                glm::vec3 diffuseDir = glm::normalize(payload.WorldNormal + Utils::RandomDirection(seed));
+                glm::vec3 diffuseDir = Utils::CosineHemisphereDirection(payload.WorldNormal, sampler.Get2D<samplerType>(Sampler::GetDirectionDimension(i)));
                 glm::vec3 reflectDir = glm::reflect(ray.Direction, payload.WorldNormal);
                 ray.Direction = glm::normalize(glm::mix(reflectDir, diffuseDir, material.Roughness));
 
-                incomingLight += (material.EmissionColor * material.EmissionStrength) * color;
+                // Only fully rough surfaces bounce with a known density, cosine / pi. Blends with the mirror
+                // direction find the lights by chance alone
+                lightSampledPdf = 0.0f;
+                if ((Flags & Kernel_LightSampling) != 0 && material.Roughness >= 1.0f)
+                {
+                    ShadowRay shadowRay;
+                    if (SampleLight<Flags>(ray.Origin, payload.WorldNormal, sampler, (uint32_t)i, shadowRay))
+                    {
+                        rayCount++;
+                        RT_KERNEL_STATS_ADD(ShadowRays, 1);
+                        if (!IsOccluded<Flags>(shadowRay.ToLight, shadowRay.MaxDistance))
+                            incomingLight += shadowRay.Radiance * material.Albedo * color;
+                    }
+                    lightSampledPdf = glm::max(glm::dot(payload.WorldNormal, ray.Direction), 0.0f) / 3.1415926f;
+                }
+
                 color *= material.Albedo;
+
+                // Continue with a probability that follows the throughput and divide by it, paths that can't add
+                // much light end early while the estimate stays unbiased
+                if ((Flags & Kernel_RussianRoulette) != 0 && i + 1 >= (int)m_Settings.RussianRouletteDepth && i + 1 < bounces)
+                {
+                    float survival = glm::min(glm::max(color.r, glm::max(color.g, color.b)), 1.0f);
+                    if (sampler.Get1D<samplerType>(Sampler::GetRouletteDimension(i)) >= survival)
+                    {
+                        RT_KERNEL_STATS_ADD(PathLengths[glm::min((uint32_t)i + 1, RenderStats::PathLengthBins - 1)], 1);
+                        return incomingLight;
+                    }
+                    color /= survival;
+                }
             }
             else
             {
                 glm::vec3 skyColor = glm::vec3(0.6f, 0.7f, 0.9f);
                 incomingLight += skyColor * color;
-                break;
+                RT_KERNEL_STATS_ADD(PathLengths[glm::min((uint32_t)i, RenderStats::PathLengthBins - 1)], 1);
+                return incomingLight;
             }
         }
 
-        return glm::vec4(incomingLight, 1.0f);
+        RT_KERNEL_STATS_ADD(PathLengths[glm::min((uint32_t)bounces, RenderStats::PathLengthBins - 1)], 1);
+        return incomingLight;
     }
 
-    Renderer::HitPayload Renderer::TraceRay(const Ray& ray)
+    template<uint32_t Flags>
+    bool Renderer::SampleLight(const glm::vec3& position, const glm::vec3& normal, const Sampler& sampler, uint32_t bounce, ShadowRay& shadowRay) const
     {
-        // Circle intercept calculation
-        // (bx ^ 2 + by ^ 2)t ^ 2 + (2axbx + 2ayby)t + (ax ^ 2 + ay ^ 2 - r ^ 2) = 0
-        // a = ray origin (position of the camera)
-        // b = ray direction
-        // r = radius
+        constexpr SamplerType samplerType = (Flags & Kernel_Sobol) != 0 ? SamplerType::Sobol : SamplerType::Independent;
 
-        if (m_ActiveScene->Spheres.empty())
-            return Miss(ray);
+        LightData::LightSample light;
+        if (!m_Lights.Sample(position, sampler.Get1D<samplerType>(Sampler::GetLightDimension(bounce)), sampler.Get2D<samplerType>(Sampler::GetLightDirectionDimension(bounce)), light))
+            return false;
 
-        int closestSphere = -1;
-        float hitDistance = std::numeric_limits<float>::max();
+        const float cosine = glm::dot(normal, light.Direction);
+        if (cosine <= 0.0f)
+            return false;
 
-        for (size_t i = 0; i < m_ActiveScene->Spheres.size(); i++)
+        // Stop short of the light's surface, so the light itself doesn't shadow the sample
+        const float bsdfPdf = cosine / 3.1415926f;
+        shadowRay.ToLight = { position, light.Direction };
+        shadowRay.MaxDistance = light.Distance * 0.999f;
+        shadowRay.Radiance = light.Radiance * (bsdfPdf * Utils::PowerHeuristic(light.Pdf, bsdfPdf) / light.Pdf);
+        return true;
+    }
+
+    template<uint32_t Flags>
+    bool Renderer::IsOccluded(const Ray& ray, float maxDistance) const
+    {
+        constexpr bool stats = (Flags & Kernel_Stats) != 0;
+        if (m_SphereData.Count > 0)
         {
-            const Sphere& sphere = m_ActiveScene->Spheres[i];
-            glm::vec3 origin = ray.Origin - sphere.Position;
+            if (m_Settings.UseBVH)
+            {
+                if (m_SphereBVH.Occluded<stats>(ray, m_SphereData, m_IntersectSpheres, maxDistance))
+                    return true;
+            }
+            else
+            {
+                float hitDistance = maxDistance;
+                RT_KERNEL_STATS_ADD(SphereTests, m_SphereData.Count);
+                if (m_IntersectSpheres(m_SphereData, ray, 0, m_SphereData.Count, hitDistance) >= 0)
+                    return true;
+            }
+        }
 
-            float a = glm::dot(ray.Direction, ray.Direction); // (bx ^ 2 + by ^ 2 + bz ^ 2)
-            float b = 2.0f * glm::dot(origin, ray.Direction); // (2axbx + 2ayby + 2azbz)
-            float c = glm::dot(origin, origin) - sphere.Radius * sphere.Radius; // (ax ^ 2 + ay ^ 2 + az ^ 2 - r ^ 2)
+        if (m_TriangleData.Count > 0)
+        {
+            if (!m_Settings.UseBVH)
+            {
+                if (m_TriangleData.Occluded<stats>(ray, 0, m_TriangleData.Count, maxDistance))
+                    return true;
+            }
+            else if (m_TriangleBVH.TraverseAny(ray, maxDistance, [&](uint32_t first, uint32_t count) { return m_TriangleData.Occluded<stats>(ray, first, count, maxDistance); }))
+            {
+                return true;
+            }
+        }
 
-            float discriminant = b * b - 4.0f * a * c;
-            if (discriminant < 0) 
-                continue;
+        return m_InstanceData.Count > 0 && m_InstanceData.Occluded<stats>(ray, m_IntersectSpheres, maxDistance);
+    }
 
-            float t0 = (-b + glm::sqrt(discriminant)) / (a * 2.0f);
-            float t1 = (-b - glm::sqrt(discriminant)) / (a * 2.0f);
+    template<uint32_t Flags>
+    Renderer::HitPayload Renderer::TraceRay(const Ray& ray)
+    {
+        float hitDistance = std::numeric_limits<float>::max();
 
-            if (t1 > 0.0f && t1 < hitDistance) 
+        int closestSlot = -1;
+        if (m_SphereData.Count > 0)
+        {
+            if (m_Settings.UseBVH)
+                closestSlot = m_SphereBVH.Intersect<(Flags & Kernel_Stats) != 0>(ray, m_SphereData, m_IntersectSpheres, hitDistance);
+            else
             {
-                hitDistance = t1;
-                closestSphere = (int)i;
+                closestSlot = m_IntersectSpheres(m_SphereData, ray, 0, m_SphereData.Count, hitDistance);
+                RT_KERNEL_STATS_ADD(SphereTests, m_SphereData.Count);
             }
         }
 
-        if (closestSphere < 0)
+        return TraceBeyondSpheres<Flags>(ray, hitDistance, closestSlot);
+    }
+
+    template<uint32_t Flags>
+    Renderer::HitPayload Renderer::TraceBeyondSpheres(const Ray& ray, float hitDistance, int sphereSlot)
+    {
+        // Every test only accepts hits in front of the closest one so far
+        int triangleSlot = IntersectTriangles<Flags>(ray, hitDistance);
+
+        uint32_t instanceSphereSlot = 0;
+        int instanceSlot = m_InstanceData.Count > 0 ? m_InstanceData.Intersect<(Flags & Kernel_Stats) != 0>(ray, m_IntersectSpheres, hitDistance, instanceSphereSlot) : -1;
+        if (instanceSlot < 0 && triangleSlot < 0 && sphereSlot < 0)
+        {
+            RT_KERNEL_STATS_ADD(Misses, 1);
             return Miss(ray);
+        }
 
-        return ClosestHit(ray, hitDistance, closestSphere);
+        RT_KERNEL_STATS_ADD(Hits, 1);
+        if (instanceSlot >= 0)
+            return ClosestHitInstance(ray, hitDistance, (uint32_t)instanceSlot, instanceSphereSlot);
+
+        if (triangleSlot >= 0)
+            return ClosestHitTriangle(ray, hitDistance, (uint32_t)triangleSlot);
+
+        return ClosestHit(ray, hitDistance, (int)m_SphereData.SphereIndices[sphereSlot]);
+    }
+
+    template<uint32_t Flags>
+    int Renderer::IntersectTriangles(const Ray& ray, float& hitDistance) const
+    {
+        constexpr bool stats = (Flags & Kernel_Stats) != 0;
+        if (m_TriangleData.Count == 0)
+            return -1;
+
+        if (!m_Settings.UseBVH)
+            return m_TriangleData.Intersect<stats>(ray, 0, m_TriangleData.Count, hitDistance);
+
+        int closestSlot = -1;
+        m_TriangleBVH.Traverse(ray, hitDistance, [&](uint32_t first, uint32_t count)
+        {
+            int slot = m_TriangleData.Intersect<stats>(ray, first, count, hitDistance);
+            if (slot >= 0)
+                closestSlot = slot;
+        });
+        return closestSlot;
     }
 
     Renderer::HitPayload Renderer::ClosestHit(const Ray& ray, float hitDistance, int objectIndex)
@@ -213,15 +1408,53 @@ namespace RayTracing {
         payload.ObjectIndex = objectIndex;
 
         const Sphere& closestSphere = m_ActiveScene->Spheres[objectIndex];
+        payload.MaterialIndex = closestSphere.MaterialIndex;
+        payload.LightIndex = m_Lights.GetLightIndex((uint32_t)objectIndex);
         payload.WorldPosition = ray.Origin + ray.Direction * hitDistance;
         payload.WorldNormal = glm::normalize(payload.WorldPosition - closestSphere.Position);
         return payload;
     }
 
+    Renderer::HitPayload Renderer::ClosestHitTriangle(const Ray& ray, float hitDistance, uint32_t triangleSlot)
+    {
+        HitPayload payload;
+        payload.HitDistance = hitDistance;
+        payload.ObjectIndex = (int)m_TriangleData.MeshIndices[triangleSlot];
+        payload.MaterialIndex = m_ActiveScene->Meshes[payload.ObjectIndex].MaterialIndex;
+        payload.LightIndex = -1;
+        payload.WorldPosition = ray.Origin + ray.Direction * hitDistance;
+
+        // Triangles are two sided, shade the side the ray came from
+        glm::vec3 normal = m_TriangleData.GetNormal(triangleSlot);
+        payload.WorldNormal = glm::dot(normal, ray.Direction) > 0.0f ? -normal : normal;
+        return payload;
+    }
+
+    Renderer::HitPayload Renderer::ClosestHitInstance(const Ray& ray, float hitDistance, uint32_t instanceSlot, uint32_t sphereSlot)
+    {
+        const glm::mat4& worldToObject = m_InstanceData.WorldToObject[instanceSlot];
+        const InstanceData::PrototypeData& prototype = m_InstanceData.Prototypes[m_InstanceData.PrototypeIndices[instanceSlot]];
+        const Instance& instance = m_ActiveScene->Instances[m_InstanceData.InstanceIndices[instanceSlot]];
+        const Sphere& sphere = m_ActiveScene->Prototypes[instance.PrototypeIndex].Spheres[prototype.Spheres.SphereIndices[sphereSlot]];
+
+        HitPayload payload;
+        payload.HitDistance = hitDistance;
+        payload.ObjectIndex = (int)m_InstanceData.InstanceIndices[instanceSlot];
+        payload.MaterialIndex = instance.MaterialIndex >= 0 ? instance.MaterialIndex : sphere.MaterialIndex;
+        payload.LightIndex = -1;
+        payload.WorldPosition = ray.Origin + ray.Direction * hitDistance;
+
+        // Normals go back to world space with the inverse transpose of the instance transform
+        glm::vec3 objectPosition = glm::vec3(worldToObject * glm::vec4(payload.WorldPosition, 1.0f));
+        payload.WorldNormal = glm::normalize(glm::transpose(glm::mat3(worldToObject)) * (objectPosition - sphere.Position));
+        return payload;
+    }
+
     Renderer::HitPayload Renderer::Miss(const Ray& ray)
     {
         HitPayload payload;
         payload.HitDistance = -1.0f;
+        payload.LightIndex = -1;
         return payload;
     }
 
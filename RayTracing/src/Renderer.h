@@ -1,57 +1,275 @@
 #pragma once
 
-#include "Walnut/Image.h"
-#include "Walnut/Random.h"
-
+#include "BVH.h"
 #include "Ray.h"
+#include "RayPacket.h"
 #include "Scene.h"
+#include "SphereKernels.h"
 #include "Camera.h"
+#include "Denoiser.h"
+#include "Framebuffer.h"
+#include "Instances.h"
+#include "Lights.h"
+#include "RenderStats.h"
+#include "ResolveKernels.h"
+#include "Sampler.h"
+#include "ThreadPool.h"
+#include "Triangles.h"
+#include "Wavefront.h"
 
 #include <glm/glm.hpp>
 
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+
 namespace RayTracing {
 
     class Renderer
     {
     public:
+        struct Tile
+        {
+            uint32_t MinX, MinY;
+            uint32_t MaxX, MaxY; // Exclusive
+        };
+
+        static constexpr uint32_t TileSize = 16;
+        static constexpr uint32_t MaxAdaptiveBoost = 8; // Most samples per frame a noisy pixel gets, in multiples of SamplesPerPixel
+
         struct Settings
         {
             bool Accumulate = true;
+            uint32_t SamplesPerPixel = 1;
+            uint32_t ThreadCount = 0; // 0 = one worker per hardware thread
+            bool PinThreads = false;
+            bool Serial = false; // Everything on the calling thread without starting workers, e.g. for profiling
+            bool CollectStats = true; // Off = GetLastStats stays zero and the kernels are compiled without counters
+            bool UseBVH = true; // Off = test every sphere, for A/B checking the BVH
+            bool UseSIMD = true; // Off = scalar sphere and resolve kernels, same results
+            bool PrimaryRayPackets = true; // Trace camera rays eight at a time, needs AVX2
+            bool JitterPrimaryRays = false; // Random sub-pixel position per sample, anti-aliases edges
+            SamplerType Sampler = SamplerType::Sobol; // Where the random numbers of the paths come from
+
+            uint32_t MaxDepth = 5; // Surfaces a path can bounce off
+            // Randomly end paths with little throughput left, starting after this many bounces
+            bool RussianRoulette = true;
+            uint32_t RussianRouletteDepth = 2;
+            // Sample the emissive spheres directly at every fully diffuse surface with a shadow ray, weighted
+            // against paths that hit them by chance (multiple importance sampling)
+            bool NextEventEstimation = true;
+
+            // Trace a tile stage by stage over queues of all its paths (camera rays, closest hits, shading, shadow
+            // rays, next bounce) instead of one path after the other. Same estimator and random numbers, so the
+            // image is the same as without
+            bool Wavefront = false;
+            PathSorting WavefrontSorting = PathSorting::None;
+
+            // Stop sampling pixels whose relative standard error dropped below the threshold
+            bool AdaptiveSampling = false;
+            float AdaptiveThreshold = 0.02f;
+            uint32_t AdaptiveMinSamples = 16;
+
+            // Carry the accumulation over to the new view when the camera moves instead of starting over. Pixels that
+            // were hidden or showed a different surface before start from scratch, the rest keep at most
+            // ReprojectionMaxHistory samples, so lighting that depends on the view catches up
+            bool Reprojection = false;
+            uint32_t ReprojectionMaxHistory = 32;
+
+            // Filter the accumulated image with the edge-avoiding denoiser before resolving it, guided by the first
+            // hit's albedo, normal and depth. Those are only gathered while this is on, turning it on restarts accumulation
+            bool Denoise = false;
+            uint32_t DenoiseIterations = 5; // Filter passes, each one reaching twice as far, at most Denoiser::MaxIterations
+
+            // How accumulated radiance turns into display pixels, changing these doesn't restart accumulation
+            ToneMapping ToneMap = ToneMapping::ACES;
+            float Exposure = 1.0f;
+            bool SRGB = true;
+
+            // Milliseconds Render may spend, a pass that does not fit continues on the next call. 0 = whole pass every call
+            float FrameBudgetMs = 0.0f;
+
+            bool operator==(const Settings&) const = default;
         };
     public:
         Renderer() = default;
-        ~Renderer();
 
         void OnResize(uint32_t width, uint32_t height);
         void Render(const Scene& scene, const Camera& camera);
-        void ResetFrameIndex() { m_FrameIndex = 1; }
+        // Also abandons a pass that is only partly rendered
+        void ResetFrameIndex() { m_FrameIndex = 1; m_PassTileCount = 0; }
+        // Call instead of ResetFrameIndex when the camera moved, the next Render reprojects if that is enabled
+        void OnCameraMoved() { m_CameraMoved = true; }
+        // Call after editing the scene that is being rendered, rebuilds the acceleration structure on the next Render
+        void InvalidateScene() { m_SceneDirty = true; m_SurfacesValid = false; m_PrebuiltSphereBVH.Clear(); }
+        // Used instead of building one for the next scene rendered, e.g. a BVH loaded with SceneFile::Load.
+        // It must index the scene's spheres in their stored order
+        void SetSphereBVH(BVH bvh) { m_PrebuiltSphereBVH = std::move(bvh); m_SceneDirty = true; }
+        // Picks up the edits marked in the scene and clears the marks. Changed spheres are refitted into the BVH and
+        // only restart accumulation where they were and are on screen, material edits restart all of it
+        void ApplySceneChanges(Scene& scene);
+        // Render only traces the tiles inside these pixel regions, e.g. the parts of an image a coordinator handed
+        // to this process. Regions should start on tile boundaries, empty = the whole image. Restarts accumulation
+        void SetRenderRegions(std::vector<Tile> regions) { m_RenderRegions = std::move(regions); ResetFrameIndex(); }
+        // Resolves the whole image again with the current display settings, without tracing anything.
+        // Needs a Render call before it
+        void ResolveImage();
 
-        std::shared_ptr<Walnut::Image> GetFinalImage() const { return m_FinalImage; }
+        const Framebuffer& GetFramebuffer() const { return m_Framebuffer; }
+        uint32_t GetFrameIndex() const { return m_FrameIndex; }
+        // Fraction of the current pass's tiles rendered so far, 1 once the last Render call completed a pass
+        float GetPassProgress() const { return m_PassProgress; }
+        uint64_t GetLastRayCount() const { return m_RayCount; }
+        // Pixels that were still sampled in the last complete pass, all of them unless adaptive sampling is on
+        uint32_t GetLastActivePixelCount() const { return m_LastActivePixelCount; }
+        // Screen tiles in scheduling order and the milliseconds each one took last frame, to spot load imbalance
+        const std::vector<Tile>& GetTiles() const { return m_Tiles; }
+        const std::vector<float>& GetTileTimes() const { return m_TileTimes; }
+        // Counters of the last Render call, all zero when built with RT_ENABLE_STATS=0 or with CollectStats off
+        const RenderStats& GetLastStats() const { return m_LastStats; }
         Settings& GetSettings() { return m_Settings; }
     private:
+        // Settings the per pixel code is compiled for. Every combination is an instantiation of its own and Render
+        // picks one per frame, so the loops over pixels, samples and bounces don't test any of them
+        enum KernelFlags : uint32_t
+        {
+            Kernel_Packets = 1 << 0, // Camera rays eight at a time through the SIMD packet kernels, else one by one
+            Kernel_Accumulate = 1 << 1, // Add to the accumulation, else overwrite it
+            Kernel_Features = 1 << 2, // Gather the first hit's albedo, normal and depth for the denoiser
+            Kernel_Stats = 1 << 3,
+            Kernel_Sobol = 1 << 4, // Sobol sampler, else independent
+            Kernel_LightSampling = 1 << 5,
+            Kernel_RussianRoulette = 1 << 6,
+            Kernel_Wavefront = 1 << 7, // Stage by stage over queues of paths, else path by path
+            KernelVariantCount = 1 << 8
+        };
+
+        // The flags each level depends on, the rest are masked off so it isn't compiled more often than needed
+        static constexpr uint32_t TraceFlags = Kernel_Stats;
+        static constexpr uint32_t PathFlags = Kernel_Stats | Kernel_Sobol | Kernel_LightSampling | Kernel_RussianRoulette;
+        static constexpr uint32_t PixelFlags = PathFlags | Kernel_Accumulate | Kernel_Features;
+        static constexpr uint32_t ExtendFlags = TraceFlags | Kernel_Packets | Kernel_Features;
+        static constexpr uint32_t WavefrontFlags = PixelFlags | Kernel_Packets;
+
+        using TileKernel = void (Renderer::*)(uint32_t tileIndex);
+
         struct HitPayload
         {
             float HitDistance;
             glm::vec3 WorldPosition;
             glm::vec3 WorldNormal;
 
-            int ObjectIndex;
+            int ObjectIndex; // Into Scene::Spheres, Scene::Meshes or Scene::Instances, depending on what was hit
+            int MaterialIndex;
+            int LightIndex; // Into LightData::Lights when a sampled light was hit, -1 otherwise
+        };
+
+        struct ShadowRay
+        {
+            Ray ToLight;
+            float MaxDistance;
+            glm::vec3 Radiance; // Arriving if nothing is in the way, times cos / pi and its MIS weight
         };
 
-        glm::vec4 PerPixel(uint32_t x, uint32_t y);
-        HitPayload TraceRay(const Ray& ray);
+        // First hits of a pixel's samples summed up, for the denoiser
+        struct SurfaceFeatures
+        {
+            glm::vec3 Albedo{ 0.0f };
+            glm::vec3 Normal{ 0.0f };
+            float Depth = 0.0f;
+        };
+
+        void BuildAccelerationStructures(const Scene& scene);
+        void InvalidateRegion(const AABB& bounds);
+        void BeginPass();
+        uint32_t GetKernelFlags() const;
+        static TileKernel GetTileKernel(uint32_t flags);
+
+        template<uint32_t Flags> void RenderTile(uint32_t tileIndex);
+        template<uint32_t Flags> uint32_t RenderPixel(uint32_t x, uint32_t y);
+        template<uint32_t Flags> uint32_t RenderPacket(uint32_t x, uint32_t y, uint32_t laneCount, uint32_t activeLanes);
+        template<uint32_t Flags> uint32_t RenderTileWavefront(const Tile& tile, uint32_t& activePixelCount);
+        // The wavefront stages, each runs over the whole queue of paths and returns the rays it traced
+        template<uint32_t Flags> uint32_t ExtendPaths(WavefrontQueues& queues, uint32_t bounce);
+        template<uint32_t Flags> uint32_t ShadePaths(WavefrontQueues& queues, uint32_t bounce);
+        template<uint32_t Flags> void TraceShadowRays(WavefrontQueues& queues) const;
+        template<uint32_t Flags> bool IsConverged(uint32_t x, uint32_t y) const;
+        template<uint32_t Flags> uint32_t GetSampleCount(uint32_t x, uint32_t y) const;
+        void Resolve(bool resolveAll);
+        void RunParallel(uint32_t taskCount, const ThreadPool::Task& task);
+        void Denoise(const Camera& camera);
+
+        bool CanReproject() const;
+        void Reproject(const Camera& camera);
+        void TraceSurfaces(const Camera& camera);
+        void ReprojectTile(uint32_t tileIndex, const Camera& camera, const Camera& previousCamera);
+
+        Ray GetPrimaryRay(uint32_t x, uint32_t y, const Sampler& sampler) const;
+        // sampleIndex counts from 1
+        Sampler GetSampler(uint32_t x, uint32_t y, uint32_t sampleIndex) const;
+
+        // features only gathered with Kernel_Features
+        template<uint32_t Flags> glm::vec3 PerPixel(uint32_t x, uint32_t y, uint32_t sampleIndex, uint32_t& rayCount, SurfaceFeatures& features);
+        template<uint32_t Flags> void StorePixel(uint32_t x, uint32_t y, const glm::vec3& color, float luminanceSquared, const SurfaceFeatures& features);
+        void AddFeatures(SurfaceFeatures& features, const HitPayload& primaryHit) const;
+        template<uint32_t Flags> glm::vec3 TracePath(Ray ray, HitPayload payload, const Sampler& sampler, uint32_t& rayCount);
+        // Shadow ray from a diffuse surface towards one sampled light, false if the light can't reach the surface
+        template<uint32_t Flags> bool SampleLight(const glm::vec3& position, const glm::vec3& normal, const Sampler& sampler, uint32_t bounce, ShadowRay& shadowRay) const;
+        // Any hit closer than maxDistance, for shadow rays
+        template<uint32_t Flags> bool IsOccluded(const Ray& ray, float maxDistance) const;
+        template<uint32_t Flags> HitPayload TraceRay(const Ray& ray);
+        template<uint32_t Flags> HitPayload TraceBeyondSpheres(const Ray& ray, float hitDistance, int sphereSlot);
+        template<uint32_t Flags> int IntersectTriangles(const Ray& ray, float& hitDistance) const;
         HitPayload ClosestHit(const Ray& ray, float hitDistance, int objectIndex);
+        HitPayload ClosestHitTriangle(const Ray& ray, float hitDistance, uint32_t triangleSlot);
+        HitPayload ClosestHitInstance(const Ray& ray, float hitDistance, uint32_t instanceSlot, uint32_t sphereSlot);
         HitPayload Miss(const Ray& ray);
     private:
         Settings m_Settings;
-        std::shared_ptr<Walnut::Image> m_FinalImage;
+        Framebuffer m_Framebuffer;
+        Denoiser m_Denoiser;
+        BVH m_SphereBVH;
+        BVH m_PrebuiltSphereBVH;
+        SphereSoA m_SphereData;
+        std::vector<uint32_t> m_SphereSlots; // Scene::Spheres index to SoA slot
+        BVH m_TriangleBVH;
+        TriangleData m_TriangleData;
+        InstanceData m_InstanceData;
+        LightData m_Lights;
+        bool m_SceneUsesBVH = false;
+        SphereKernels::IntersectFunc m_IntersectSpheres = SphereKernels::IntersectScalar;
+        bool m_SceneDirty = true;
+
+        std::vector<Tile> m_Tiles;
+        std::vector<float> m_TileTimes;
+        std::vector<uint8_t> m_TileConverged;
+        std::vector<uint8_t> m_TileRendered; // In the current pass
+        std::vector<uint32_t> m_PendingTiles;
+        std::vector<uint32_t> m_ResolveTiles;
+        std::vector<Tile> m_RenderRegions;
+        ResolveSettings m_ResolveSettings;
+        uint32_t m_PassTileCount = 0;
+        float m_PassProgress = 0.0f;
 
-        uint32_t* m_ImageData = nullptr;
-        glm::vec4* m_AccumulationData = nullptr;
-        std::vector<uint32_t> m_ImageHorizontalIter;
-        std::vector<uint32_t> m_ImageVerticaltalIter;
+        std::unique_ptr<ThreadPool> m_ThreadPool; // Null when rendering serially
+        uint32_t m_ThreadPoolThreadCount = 0;
+        std::vector<RenderStats> m_WorkerStats;
+        RenderStats m_LastStats;
 
         uint32_t m_FrameIndex = 1;
+        uint32_t m_FrameSamplesPerPixel = 1;
+        float m_AdaptiveThreshold = 0.0f;
+        std::atomic<uint64_t> m_RayCount = 0;
+        std::atomic<uint32_t> m_ActivePixelCount = 0;
+        uint32_t m_LastActivePixelCount = 0;
+        uint32_t m_SeedOffset = 0; // Changed by reprojection, so reprojected pixels don't repeat their samples
+
+        // Camera of the last Render and the one the framebuffer's surfaces were traced with
+        std::optional<Camera> m_HistoryCamera;
+        glm::mat4 m_SurfaceViewProjection{ 1.0f };
+        bool m_SurfacesValid = false;
+        bool m_CameraMoved = false;
 
         const Scene* m_ActiveScene = nullptr;
         const Camera* m_ActiveCamera = nullptr;
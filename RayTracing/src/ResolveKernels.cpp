@@ -0,0 +1,207 @@
+#include "ResolveKernels.h"
+
+#include "SIMD.h"
+
+#include <cmath>
+
+#if RT_SIMD_X86 && defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace RayTracing::ResolveKernels {
+
+    namespace Utils {
+
+        // sRGB encoding indexed by sqrt(linear), which spends the entries where the curve is steep: neighboring
+        // entries are less than a tenth of an 8 bit step apart even near black
+        static constexpr uint32_t SRGBTableSize = 4096;
+
+        static const uint32_t* GetSRGBTable()
+        {
+            static const struct Table
+            {
+                uint32_t Values[SRGBTableSize];
+
+                Table()
+                {
+                    for (uint32_t i = 0; i < SRGBTableSize; i++)
+                    {
+                        double s = (double)i / (SRGBTableSize - 1);
+                        double linear = s * s;
+                        double encoded = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+                        Values[i] = (uint32_t)(encoded * 255.0 + 0.5);
+                    }
+                }
+            } s_Table;
+            return s_Table.Values;
+        }
+
+        // The scalar reference, the wide kernel evaluates exactly the same operations in the same order
+        static float ToneMap(float value, ToneMapping toneMap)
+        {
+            value = value > 0.0f ? value : 0.0f;
+            switch (toneMap)
+            {
+            case ToneMapping::Reinhard:
+                value = value / (value + 1.0f);
+                break;
+            case ToneMapping::ACES:
+                value = (value * (value * 2.51f + 0.03f)) / (value * (value * 2.43f + 0.59f) + 0.14f);
+                break;
+            default:
+                break;
+            }
+            return value < 1.0f ? value : 1.0f;
+        }
+
+        static uint32_t Encode(float value, bool srgb, const uint32_t* srgbTable)
+        {
+            if (srgb)
+                return srgbTable[(uint32_t)(std::sqrt(value) * (float)(SRGBTableSize - 1) + 0.5f)];
+            return (uint32_t)(value * 255.0f);
+        }
+
+    }
+
+    void ResolveScalar(Framebuffer& framebuffer, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, const ResolveSettings& settings)
+    {
+        const uint32_t* srgbTable = Utils::GetSRGBTable();
+        uint32_t* image = framebuffer.GetImageData();
+        const uint32_t width = framebuffer.GetWidth();
+
+        for (uint32_t y = minY; y < maxY; y++)
+        {
+            for (uint32_t x = minX; x < maxX; x++)
+            {
+                const Framebuffer::AccumulationBlock& block = settings.Denoised ? framebuffer.GetDenoisedBlock(x, y) : framebuffer.GetBlock(x, y);
+                const uint32_t pixel = Framebuffer::GetBlockPixel(x, y);
+
+                float sampleCount = (float)block.SampleCount[pixel];
+                sampleCount = sampleCount > 1.0f ? sampleCount : 1.0f;
+
+                uint32_t r = Utils::Encode(Utils::ToneMap(block.Red[pixel] / sampleCount * settings.Exposure, settings.ToneMap), settings.SRGB, srgbTable);
+                uint32_t g = Utils::Encode(Utils::ToneMap(block.Green[pixel] / sampleCount * settings.Exposure, settings.ToneMap), settings.SRGB, srgbTable);
+                uint32_t b = Utils::Encode(Utils::ToneMap(block.Blue[pixel] / sampleCount * settings.Exposure, settings.ToneMap), settings.SRGB, srgbTable);
+                image[x + y * width] = 0xff000000 | (b << 16) | (g << 8) | r;
+            }
+        }
+    }
+
+#if RT_SIMD_X86
+    namespace Utils {
+
+        RT_TARGET("avx2")
+        static __m256 ToneMapAVX2(__m256 value, ToneMapping toneMap)
+        {
+            const __m256 one = _mm256_set1_ps(1.0f);
+            value = _mm256_max_ps(value, _mm256_setzero_ps());
+            switch (toneMap)
+            {
+            case ToneMapping::Reinhard:
+                value = _mm256_div_ps(value, _mm256_add_ps(value, one));
+                break;
+            case ToneMapping::ACES:
+            {
+                // No FMA on purpose, it would round differently from the scalar kernel
+                __m256 numerator = _mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(2.51f)), _mm256_set1_ps(0.03f)));
+                __m256 denominator = _mm256_add_ps(_mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(2.43f)), _mm256_set1_ps(0.59f))), _mm256_set1_ps(0.14f));
+                value = _mm256_div_ps(numerator, denominator);
+                break;
+            }
+            default:
+                break;
+            }
+            return _mm256_min_ps(value, one);
+        }
+
+        RT_TARGET("avx2")
+        static __m256i EncodeAVX2(__m256 value, bool srgb, const uint32_t* srgbTable)
+        {
+            if (srgb)
+            {
+                __m256 index = _mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(value), _mm256_set1_ps((float)(SRGBTableSize - 1))), _mm256_set1_ps(0.5f));
+                return _mm256_i32gather_epi32((const int*)srgbTable, _mm256_cvttps_epi32(index), 4);
+            }
+            return _mm256_cvttps_epi32(_mm256_mul_ps(value, _mm256_set1_ps(255.0f)));
+        }
+
+    }
+
+    RT_TARGET("avx2")
+    void ResolveAVX2(Framebuffer& framebuffer, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, const ResolveSettings& settings)
+    {
+        const uint32_t* srgbTable = Utils::GetSRGBTable();
+        uint32_t* image = framebuffer.GetImageData();
+        const uint32_t width = framebuffer.GetWidth();
+
+        const __m256 exposure = _mm256_set1_ps(settings.Exposure);
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+        const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+        // One block row at a time, which is one aligned vector per plane
+        for (uint32_t y = minY; y < maxY; y++)
+        {
+            for (uint32_t x = minX; x < maxX; x += Framebuffer::BlockSize)
+            {
+                const Framebuffer::AccumulationBlock& block = settings.Denoised ? framebuffer.GetDenoisedBlock(x, y) : framebuffer.GetBlock(x, y);
+                const uint32_t row = Framebuffer::GetBlockPixel(x, y);
+
+                __m256 sampleCount = _mm256_cvtepi32_ps(_mm256_load_si256((const __m256i*)&block.SampleCount[row]));
+                sampleCount = _mm256_max_ps(sampleCount, one);
+
+                __m256 r = _mm256_mul_ps(_mm256_div_ps(_mm256_load_ps(&block.Red[row]), sampleCount), exposure);
+                __m256 g = _mm256_mul_ps(_mm256_div_ps(_mm256_load_ps(&block.Green[row]), sampleCount), exposure);
+                __m256 b = _mm256_mul_ps(_mm256_div_ps(_mm256_load_ps(&block.Blue[row]), sampleCount), exposure);
+
+                __m256i red = Utils::EncodeAVX2(Utils::ToneMapAVX2(r, settings.ToneMap), settings.SRGB, srgbTable);
+                __m256i green = Utils::EncodeAVX2(Utils::ToneMapAVX2(g, settings.ToneMap), settings.SRGB, srgbTable);
+                __m256i blue = Utils::EncodeAVX2(Utils::ToneMapAVX2(b, settings.ToneMap), settings.SRGB, srgbTable);
+                __m256i pixels = _mm256_or_si256(_mm256_or_si256(alpha, _mm256_slli_epi32(blue, 16)), _mm256_or_si256(_mm256_slli_epi32(green, 8), red));
+
+                // The right edge of the image can end inside a block
+                uint32_t* destination = image + x + y * width;
+                if (maxX - x >= Framebuffer::BlockSize)
+                    _mm256_storeu_si256((__m256i*)destination, pixels);
+                else
+                    _mm256_maskstore_epi32((int*)destination, _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(maxX - x)), laneIndex), pixels);
+            }
+        }
+    }
+
+    static bool SupportsAVX2()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+        if (!osSavesYmm)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#else
+    void ResolveAVX2(Framebuffer& framebuffer, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, const ResolveSettings& settings)
+    {
+        ResolveScalar(framebuffer, minX, minY, maxX, maxY, settings);
+    }
+
+    static bool SupportsAVX2() { return false; }
+#endif
+
+    ResolveFunc GetBest()
+    {
+        static const ResolveFunc s_Best = SupportsAVX2() ? ResolveAVX2 : ResolveScalar;
+        return s_Best;
+    }
+
+    const char* GetName(ResolveFunc kernel)
+    {
+        return kernel == ResolveAVX2 ? "AVX2" : "Scalar";
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Framebuffer.h"
+
+namespace RayTracing {
+
+    enum class ToneMapping
+    {
+        Clamp, // Values above 1 clip
+        Reinhard, // x / (1 + x)
+        ACES // Narkowicz's fit of the ACES filmic curve
+    };
+
+    struct ResolveSettings
+    {
+        ToneMapping ToneMap = ToneMapping::ACES;
+        float Exposure = 1.0f;
+        bool SRGB = true; // Encode for an sRGB display, off writes the tone mapped values linearly
+        bool Denoised = false; // Read the framebuffer's denoised blocks instead of the accumulation
+
+        bool operator==(const ResolveSettings&) const = default;
+    };
+
+    namespace ResolveKernels {
+
+        // Turns the accumulated radiance of pixels [minX, maxX) x [minY, maxY) into the framebuffer's RGBA8 image:
+        // average, exposure, tone mapping, then sRGB encoding. minX must be a multiple of Framebuffer::BlockSize.
+        // All kernels return bit-identical results.
+        using ResolveFunc = void(*)(Framebuffer& framebuffer, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, const ResolveSettings& settings);
+
+        void ResolveScalar(Framebuffer& framebuffer, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, const ResolveSettings& settings);
+        void ResolveAVX2(Framebuffer& framebuffer, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY, const ResolveSettings& settings);
+
+        // Widest kernel this CPU supports, detected on first use
+        ResolveFunc GetBest();
+        const char* GetName(ResolveFunc kernel);
+
+    }
+
+}
\ No newline at end of file
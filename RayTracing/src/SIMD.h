@@ -0,0 +1,17 @@
+#pragma once
+
+// Shared switches for the hand written SIMD kernels
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define RT_SIMD_X86 1
+    #include <immintrin.h>
+#else
+    #define RT_SIMD_X86 0
+#endif
+
+// GCC and Clang only allow intrinsics of the ISA a function is compiled for, MSVC always allows them
+#if defined(__GNUC__) || defined(__clang__)
+    #define RT_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define RT_TARGET(isa)
+#endif
\ No newline at end of file
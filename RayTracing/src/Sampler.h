@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Utils.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+
+namespace RayTracing {
+
+    enum class SamplerType
+    {
+        Independent, // Hashed PCG numbers per pixel, sample and dimension, white noise
+        Sobol // Owen scrambled Sobol points per dimension, a pixel's samples stratify each of its 2D domains
+    };
+
+    // Random numbers of one sample of a pixel. They are asked for by dimension, which names the decision they
+    // are used for, so the same decision of every sample of a pixel comes from one well distributed sequence.
+    // A pixel's seed scrambles its sequences, neighbouring pixels get uncorrelated ones
+    class Sampler
+    {
+    public:
+        // Pixel jitter, then a direction, a roulette decision and a light sample (which light, and where on it)
+        // for every bounce
+        static constexpr uint32_t JitterDimension = 0;
+        static uint32_t GetDirectionDimension(uint32_t bounce) { return 1 + 4 * bounce; }
+        static uint32_t GetRouletteDimension(uint32_t bounce) { return 2 + 4 * bounce; }
+        static uint32_t GetLightDimension(uint32_t bounce) { return 3 + 4 * bounce; }
+        static uint32_t GetLightDirectionDimension(uint32_t bounce) { return 4 + 4 * bounce; }
+    public:
+        Sampler() = default;
+        // sampleIndex counts the pixel's samples from 0, seed tells pixels and restarts of a pixel apart
+        Sampler(SamplerType type, uint32_t seed, uint32_t sampleIndex)
+            : m_Type(type), m_Seed(Utils::Hash(seed)), m_SampleIndex(sampleIndex) {}
+
+        float Get1D(uint32_t dimension) const
+        {
+            return m_Type == SamplerType::Sobol ? Get1D<SamplerType::Sobol>(dimension) : Get1D<SamplerType::Independent>(dimension);
+        }
+
+        glm::vec2 Get2D(uint32_t dimension) const
+        {
+            return m_Type == SamplerType::Sobol ? Get2D<SamplerType::Sobol>(dimension) : Get2D<SamplerType::Independent>(dimension);
+        }
+
+        // For code that is compiled for one type already, must match the type the sampler was created with
+        template<SamplerType Type>
+        float Get1D(uint32_t dimension) const
+        {
+            const uint32_t seed = Utils::HashCombine(m_Seed, dimension);
+            if constexpr (Type == SamplerType::Independent)
+                return Utils::ToUnitFloat(Utils::HashCombine(seed, m_SampleIndex));
+
+            // The first Sobol dimension is the bit reversed index, which the scramble reverses again
+            const uint32_t index = ShuffleIndex(seed);
+            return Utils::ToUnitFloat(ReverseBits(LaineKarrasPermutation(index, Utils::Hash(seed))));
+        }
+
+        template<SamplerType Type>
+        glm::vec2 Get2D(uint32_t dimension) const
+        {
+            const uint32_t seed = Utils::HashCombine(m_Seed, dimension);
+            if constexpr (Type == SamplerType::Independent)
+            {
+                const uint32_t hash = Utils::HashCombine(seed, m_SampleIndex);
+                return { Utils::ToUnitFloat(hash), Utils::ToUnitFloat(Utils::Hash(hash)) };
+            }
+
+            // The first two Sobol dimensions form a (0,2) sequence. Shuffling the index decorrelates the
+            // dimensions from each other, scrambling the outputs decorrelates the pixels (Burley 2020)
+            const uint32_t index = ShuffleIndex(seed);
+            const uint32_t x = ReverseBits(LaineKarrasPermutation(index, Utils::HashCombine(seed, 1)));
+            const uint32_t y = ReverseBits(LaineKarrasPermutation(SobolSecondDimensionReversed(index), Utils::HashCombine(seed, 2)));
+            return { Utils::ToUnitFloat(x), Utils::ToUnitFloat(y) };
+        }
+    private:
+        static uint32_t ReverseBits(uint32_t value)
+        {
+            value = (value << 16) | (value >> 16);
+            value = ((value & 0x00ff00ff) << 8) | ((value & 0xff00ff00) >> 8);
+            value = ((value & 0x0f0f0f0f) << 4) | ((value & 0xf0f0f0f0) >> 4);
+            value = ((value & 0x33333333) << 2) | ((value & 0xcccccccc) >> 2);
+            value = ((value & 0x55555555) << 1) | ((value & 0xaaaaaaaa) >> 1);
+            return value;
+        }
+
+        // Owen scrambling works on bit reversed values: every bit is flipped depending on a hash of the bits
+        // below it, which the multiply-xor steps provide (Laine and Karras 2011). Reversing the result gives
+        // the scrambled point
+        static uint32_t LaineKarrasPermutation(uint32_t value, uint32_t seed)
+        {
+            value += seed;
+            value ^= value * 0x6c50b47c;
+            value ^= value * 0xb82f1e52;
+            value ^= value * 0xc7afe638;
+            value ^= value * 0x8d22f6e6;
+            return value;
+        }
+
+        // Owen scrambled sample index, a permutation within every aligned power of two run of samples
+        uint32_t ShuffleIndex(uint32_t seed) const
+        {
+            return ReverseBits(LaineKarrasPermutation(ReverseBits(m_SampleIndex), seed));
+        }
+
+        // Sobol's second dimension, bit reversed for the scramble, all of its direction numbers are 1. The index
+        // is shuffled, so all 32 bits are in use; a table per index byte holds the xor of the direction numbers
+        // of every byte value
+        static uint32_t SobolSecondDimensionReversed(uint32_t index)
+        {
+            return SobolTables[0][index & 0xff] ^ SobolTables[1][(index >> 8) & 0xff] ^ SobolTables[2][(index >> 16) & 0xff] ^ SobolTables[3][index >> 24];
+        }
+
+        static constexpr std::array<std::array<uint32_t, 256>, 4> SobolTables = []
+        {
+            // Reversed direction numbers, v[0] = 1 and v[i] = v[i - 1] ^ (v[i - 1] << 1)
+            uint32_t directions[32];
+            directions[0] = 1;
+            for (uint32_t bit = 1; bit < 32; bit++)
+                directions[bit] = directions[bit - 1] ^ (directions[bit - 1] << 1);
+
+            std::array<std::array<uint32_t, 256>, 4> tables = {};
+            for (uint32_t byte = 0; byte < 4; byte++)
+            {
+                for (uint32_t value = 0; value < 256; value++)
+                {
+                    for (uint32_t bit = 0; bit < 8; bit++)
+                        tables[byte][value] ^= (value >> bit) & 1 ? directions[byte * 8 + bit] : 0;
+                }
+            }
+            return tables;
+        }();
+    private:
+        SamplerType m_Type = SamplerType::Independent;
+        uint32_t m_Seed = 0;
+        uint32_t m_SampleIndex = 0;
+    };
+
+}
\ No newline at end of file
@@ -22,10 +22,47 @@ namespace RayTracing {
         int MaterialIndex = 0;
     };
 
+    // Indexed triangle list, three indices per triangle
+    struct Mesh
+    {
+        std::vector<glm::vec3> Positions;
+        std::vector<uint32_t> Indices;
+
+        int MaterialIndex = 0;
+
+        uint32_t GetTriangleCount() const { return (uint32_t)(Indices.size() / 3); }
+    };
+
+    // Geometry shared by every instance that references it, in prototype space
+    struct Prototype
+    {
+        std::vector<Sphere> Spheres;
+    };
+
+    struct Instance
+    {
+        glm::mat4 Transform{ 1.0f }; // Prototype space to world space
+        uint32_t PrototypeIndex = 0;
+        int MaterialIndex = -1; // Replaces the materials of the prototype's spheres, -1 keeps them
+    };
+
     struct Scene
     {
         std::vector<Sphere> Spheres;
+        std::vector<Mesh> Meshes;
+        std::vector<Prototype> Prototypes;
+        std::vector<Instance> Instances;
         std::vector<Material> Materials;
+
+        // Edits the renderer has not picked up yet, see Renderer::ApplySceneChanges. Adding or removing
+        // anything, and edits to meshes or instances, still need Renderer::InvalidateScene
+        std::vector<uint32_t> DirtySpheres;
+        std::vector<uint32_t> DirtyMaterials;
+
+        void MarkSphereDirty(uint32_t index) { DirtySpheres.push_back(index); }
+        void MarkMaterialDirty(uint32_t index) { DirtyMaterials.push_back(index); }
+        bool HasChanges() const { return !DirtySpheres.empty() || !DirtyMaterials.empty(); }
+        void ClearChanges() { DirtySpheres.clear(); DirtyMaterials.clear(); }
     };
 
 }
\ No newline at end of file
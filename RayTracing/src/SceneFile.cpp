@@ -0,0 +1,332 @@
+#include "SceneFile.h"
+
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace RayTracing::SceneFile {
+
+    namespace Utils {
+
+        struct Section
+        {
+            uint64_t Offset; // From the start of the file
+            uint64_t Count;
+        };
+
+        enum SectionIndex
+        {
+            Section_Materials,
+            Section_Spheres,
+            Section_Meshes,
+            Section_MeshPositions,
+            Section_MeshIndices,
+            Section_SphereBVHNodes,
+            Section_Prototypes,
+            Section_PrototypeSpheres,
+            Section_Instances,
+            SectionCount
+        };
+
+        struct Header
+        {
+            char Magic[4];
+            uint32_t Version;
+            uint64_t FileSize;
+            Section Sections[SectionCount];
+        };
+
+        // Meshes are stored as ranges into the shared position and index sections
+        struct MeshRecord
+        {
+            uint64_t FirstPosition;
+            uint64_t PositionCount;
+            uint64_t FirstIndex;
+            uint64_t IndexCount;
+            int32_t MaterialIndex;
+            uint32_t Padding;
+        };
+
+        struct PrototypeRecord
+        {
+            uint64_t FirstSphere;
+            uint64_t SphereCount;
+        };
+
+        static constexpr char Magic[4] = { 'R', 'T', 'S', 'C' };
+        static constexpr uint32_t Version = 2;
+        static constexpr uint64_t Alignment = 64;
+
+        // The arrays are stored raw, any change to these structs needs a new version
+        static_assert(sizeof(Material) == 32 && sizeof(Sphere) == 20 && sizeof(BVHNode) == 32 && sizeof(MeshRecord) == 40
+            && sizeof(PrototypeRecord) == 16 && sizeof(Instance) == 72);
+
+        static uint64_t AlignUp(uint64_t value)
+        {
+            return (value + Alignment - 1) & ~(Alignment - 1);
+        }
+
+        static bool Fail(std::string* error, const std::string& message)
+        {
+            if (error)
+                *error = message;
+            return false;
+        }
+
+        template<typename T>
+        static const T* GetSection(const char* data, const Header& header, SectionIndex index)
+        {
+            return (const T*)(data + header.Sections[index].Offset);
+        }
+
+        template<typename T>
+        static bool IsSectionValid(const Header& header, SectionIndex index)
+        {
+            const Section& section = header.Sections[index];
+            return section.Offset % Alignment == 0 && section.Offset >= sizeof(Header) && section.Offset <= header.FileSize
+                && section.Count <= (header.FileSize - section.Offset) / sizeof(T);
+        }
+
+        // Writes to the file, or appends to the buffer when there is none
+        struct Writer
+        {
+            FILE* File;
+            std::vector<char>* Buffer = nullptr;
+            uint64_t Offset = 0;
+            bool Ok = true;
+
+            void Write(const void* data, uint64_t size)
+            {
+                if (Buffer)
+                    Buffer->insert(Buffer->end(), (const char*)data, (const char*)data + size);
+                else
+                    Ok = Ok && (size == 0 || fwrite(data, 1, size, File) == size);
+                Offset += size;
+            }
+
+            void Pad()
+            {
+                static const char zeros[Alignment] = {};
+                Write(zeros, AlignUp(Offset) - Offset);
+            }
+        };
+
+    }
+
+    bool Load(const std::string& path, Scene& scene, BVH* sphereBVH, std::string* error)
+    {
+        MappedFile file;
+        if (!file.Open(path))
+            return Utils::Fail(error, "Can't open '" + path + "'");
+
+        return Load(file.GetData(), file.GetSize(), scene, sphereBVH, error);
+    }
+
+    bool Load(const char* data, size_t size, Scene& scene, BVH* sphereBVH, std::string* error)
+    {
+        Utils::Header header;
+        if (size < sizeof(header))
+            return Utils::Fail(error, "File too small for a scene header");
+
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.Magic, Utils::Magic, sizeof(header.Magic)) != 0)
+            return Utils::Fail(error, "Not a scene file");
+        if (header.Version != Utils::Version)
+            return Utils::Fail(error, "Unsupported scene file version " + std::to_string(header.Version));
+        if (header.FileSize != size)
+            return Utils::Fail(error, "Scene file is truncated");
+
+        bool valid = Utils::IsSectionValid<Material>(header, Utils::Section_Materials)
+            && Utils::IsSectionValid<Sphere>(header, Utils::Section_Spheres)
+            && Utils::IsSectionValid<Utils::MeshRecord>(header, Utils::Section_Meshes)
+            && Utils::IsSectionValid<glm::vec3>(header, Utils::Section_MeshPositions)
+            && Utils::IsSectionValid<uint32_t>(header, Utils::Section_MeshIndices)
+            && Utils::IsSectionValid<BVHNode>(header, Utils::Section_SphereBVHNodes)
+            && Utils::IsSectionValid<Utils::PrototypeRecord>(header, Utils::Section_Prototypes)
+            && Utils::IsSectionValid<Sphere>(header, Utils::Section_PrototypeSpheres)
+            && Utils::IsSectionValid<Instance>(header, Utils::Section_Instances)
+            && header.Sections[Utils::Section_Spheres].Count <= UINT32_MAX;
+        if (!valid)
+            return Utils::Fail(error, "Corrupt scene file, section out of range");
+
+        const uint64_t materialCount = header.Sections[Utils::Section_Materials].Count;
+        const uint64_t sphereCount = header.Sections[Utils::Section_Spheres].Count;
+        const uint64_t meshCount = header.Sections[Utils::Section_Meshes].Count;
+        const uint64_t positionCount = header.Sections[Utils::Section_MeshPositions].Count;
+        const uint64_t indexCount = header.Sections[Utils::Section_MeshIndices].Count;
+        const uint64_t nodeCount = header.Sections[Utils::Section_SphereBVHNodes].Count;
+        const uint64_t prototypeCount = header.Sections[Utils::Section_Prototypes].Count;
+        const uint64_t prototypeSphereCount = header.Sections[Utils::Section_PrototypeSpheres].Count;
+        const uint64_t instanceCount = header.Sections[Utils::Section_Instances].Count;
+
+        // The rest is one bulk copy per array, checks included so a bad file can't send the renderer out of bounds
+        Scene loaded;
+        const Material* materials = Utils::GetSection<Material>(data, header, Utils::Section_Materials);
+        loaded.Materials.assign(materials, materials + materialCount);
+
+        const Sphere* spheres = Utils::GetSection<Sphere>(data, header, Utils::Section_Spheres);
+        loaded.Spheres.assign(spheres, spheres + sphereCount);
+        for (const Sphere& sphere : loaded.Spheres)
+        {
+            if (sphere.MaterialIndex < 0 || (uint64_t)sphere.MaterialIndex >= materialCount)
+                return Utils::Fail(error, "Corrupt scene file, sphere material out of range");
+        }
+
+        const Utils::MeshRecord* meshes = Utils::GetSection<Utils::MeshRecord>(data, header, Utils::Section_Meshes);
+        const glm::vec3* positions = Utils::GetSection<glm::vec3>(data, header, Utils::Section_MeshPositions);
+        const uint32_t* indices = Utils::GetSection<uint32_t>(data, header, Utils::Section_MeshIndices);
+        loaded.Meshes.resize(meshCount);
+        for (uint64_t i = 0; i < meshCount; i++)
+        {
+            const Utils::MeshRecord& record = meshes[i];
+            if (record.FirstPosition > positionCount || record.PositionCount > positionCount - record.FirstPosition
+                || record.FirstIndex > indexCount || record.IndexCount > indexCount - record.FirstIndex || record.IndexCount % 3 != 0
+                || record.MaterialIndex < 0 || (uint64_t)record.MaterialIndex >= materialCount)
+                return Utils::Fail(error, "Corrupt scene file, mesh out of range");
+
+            Mesh& mesh = loaded.Meshes[i];
+            mesh.Positions.assign(positions + record.FirstPosition, positions + record.FirstPosition + record.PositionCount);
+            mesh.Indices.assign(indices + record.FirstIndex, indices + record.FirstIndex + record.IndexCount);
+            mesh.MaterialIndex = record.MaterialIndex;
+            for (uint32_t index : mesh.Indices)
+            {
+                if (index >= record.PositionCount)
+                    return Utils::Fail(error, "Corrupt scene file, mesh index out of range");
+            }
+        }
+
+        const Utils::PrototypeRecord* prototypes = Utils::GetSection<Utils::PrototypeRecord>(data, header, Utils::Section_Prototypes);
+        const Sphere* prototypeSpheres = Utils::GetSection<Sphere>(data, header, Utils::Section_PrototypeSpheres);
+        loaded.Prototypes.resize(prototypeCount);
+        for (uint64_t i = 0; i < prototypeCount; i++)
+        {
+            const Utils::PrototypeRecord& record = prototypes[i];
+            if (record.FirstSphere > prototypeSphereCount || record.SphereCount > prototypeSphereCount - record.FirstSphere)
+                return Utils::Fail(error, "Corrupt scene file, prototype out of range");
+
+            std::vector<Sphere>& spheres = loaded.Prototypes[i].Spheres;
+            spheres.assign(prototypeSpheres + record.FirstSphere, prototypeSpheres + record.FirstSphere + record.SphereCount);
+            for (const Sphere& sphere : spheres)
+            {
+                if (sphere.MaterialIndex < 0 || (uint64_t)sphere.MaterialIndex >= materialCount)
+                    return Utils::Fail(error, "Corrupt scene file, sphere material out of range");
+            }
+        }
+
+        const Instance* instances = Utils::GetSection<Instance>(data, header, Utils::Section_Instances);
+        loaded.Instances.assign(instances, instances + instanceCount);
+        for (const Instance& instance : loaded.Instances)
+        {
+            if (instance.PrototypeIndex >= prototypeCount || instance.MaterialIndex < -1 || instance.MaterialIndex >= (int64_t)materialCount)
+                return Utils::Fail(error, "Corrupt scene file, instance out of range");
+        }
+
+        if (sphereBVH)
+        {
+            const BVHNode* nodes = Utils::GetSection<BVHNode>(data, header, Utils::Section_SphereBVHNodes);
+            if (!sphereBVH->Assign(std::vector<BVHNode>(nodes, nodes + nodeCount), (uint32_t)sphereCount))
+                return Utils::Fail(error, "Corrupt scene file, malformed BVH");
+        }
+
+        scene = std::move(loaded);
+        return true;
+    }
+
+    static bool WriteScene(Utils::Writer& writer, const Scene& scene, bool includeBVH)
+    {
+        // Spheres go to the file in BVH leaf order, so the stored tree indexes them directly
+        BVH bvh;
+        std::vector<Sphere> orderedSpheres;
+        if (includeBVH)
+        {
+            bvh.Build(scene.Spheres);
+            orderedSpheres.reserve(scene.Spheres.size());
+            for (uint32_t index : bvh.GetPrimitiveIndices())
+                orderedSpheres.push_back(scene.Spheres[index]);
+        }
+        const std::vector<Sphere>& spheres = includeBVH ? orderedSpheres : scene.Spheres;
+
+        std::vector<Utils::MeshRecord> meshes(scene.Meshes.size());
+        uint64_t positionCount = 0, indexCount = 0;
+        for (size_t i = 0; i < scene.Meshes.size(); i++)
+        {
+            meshes[i] = { positionCount, scene.Meshes[i].Positions.size(), indexCount, scene.Meshes[i].Indices.size(), scene.Meshes[i].MaterialIndex, 0 };
+            positionCount += scene.Meshes[i].Positions.size();
+            indexCount += scene.Meshes[i].Indices.size();
+        }
+
+        std::vector<Utils::PrototypeRecord> prototypes(scene.Prototypes.size());
+        uint64_t prototypeSphereCount = 0;
+        for (size_t i = 0; i < scene.Prototypes.size(); i++)
+        {
+            prototypes[i] = { prototypeSphereCount, scene.Prototypes[i].Spheres.size() };
+            prototypeSphereCount += scene.Prototypes[i].Spheres.size();
+        }
+
+        // Lay the sections out first, the header needs every offset
+        Utils::Header header = {};
+        memcpy(header.Magic, Utils::Magic, sizeof(header.Magic));
+        header.Version = Utils::Version;
+
+        const uint64_t elementSizes[Utils::SectionCount] = { sizeof(Material), sizeof(Sphere), sizeof(Utils::MeshRecord), sizeof(glm::vec3), sizeof(uint32_t), sizeof(BVHNode),
+            sizeof(Utils::PrototypeRecord), sizeof(Sphere), sizeof(Instance) };
+        const uint64_t counts[Utils::SectionCount] = { scene.Materials.size(), spheres.size(), meshes.size(), positionCount, indexCount, bvh.GetNodes().size(),
+            prototypes.size(), prototypeSphereCount, scene.Instances.size() };
+        uint64_t offset = Utils::AlignUp(sizeof(header));
+        for (int i = 0; i < Utils::SectionCount; i++)
+        {
+            header.Sections[i] = { offset, counts[i] };
+            offset = Utils::AlignUp(offset + counts[i] * elementSizes[i]);
+        }
+        header.FileSize = offset;
+
+        if (writer.Buffer)
+            writer.Buffer->reserve(writer.Buffer->size() + header.FileSize);
+
+        writer.Write(&header, sizeof(header));
+        writer.Pad();
+        writer.Write(scene.Materials.data(), scene.Materials.size() * sizeof(Material));
+        writer.Pad();
+        writer.Write(spheres.data(), spheres.size() * sizeof(Sphere));
+        writer.Pad();
+        writer.Write(meshes.data(), meshes.size() * sizeof(Utils::MeshRecord));
+        writer.Pad();
+        for (const Mesh& mesh : scene.Meshes)
+            writer.Write(mesh.Positions.data(), mesh.Positions.size() * sizeof(glm::vec3));
+        writer.Pad();
+        for (const Mesh& mesh : scene.Meshes)
+            writer.Write(mesh.Indices.data(), mesh.Indices.size() * sizeof(uint32_t));
+        writer.Pad();
+        writer.Write(bvh.GetNodes().data(), bvh.GetNodes().size() * sizeof(BVHNode));
+        writer.Pad();
+        writer.Write(prototypes.data(), prototypes.size() * sizeof(Utils::PrototypeRecord));
+        writer.Pad();
+        for (const Prototype& prototype : scene.Prototypes)
+            writer.Write(prototype.Spheres.data(), prototype.Spheres.size() * sizeof(Sphere));
+        writer.Pad();
+        writer.Write(scene.Instances.data(), scene.Instances.size() * sizeof(Instance));
+        writer.Pad();
+
+        return writer.Ok && writer.Offset == header.FileSize;
+    }
+
+    bool Save(const std::string& path, const Scene& scene, bool includeBVH)
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        Utils::Writer writer{ file };
+        bool ok = WriteScene(writer, scene, includeBVH);
+        return fclose(file) == 0 && ok;
+    }
+
+    bool Save(std::vector<char>& data, const Scene& scene, bool includeBVH)
+    {
+        data.clear();
+        Utils::Writer writer{ nullptr, &data };
+        return WriteScene(writer, scene, includeBVH);
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "BVH.h"
+#include "Scene.h"
+
+#include <string>
+#include <vector>
+
+namespace RayTracing::SceneFile {
+
+    // Binary .rtscene files: a versioned header followed by the scene's arrays exactly as they are laid out in
+    // memory, each starting on a 64 byte boundary. Loading maps the file and copies the arrays out in bulk,
+    // there is nothing to parse. With a BVH stored, the spheres are saved in leaf order and sphereBVH receives
+    // the tree, so the renderer can skip the build (see Renderer::SetSphereBVH)
+    bool Load(const std::string& path, Scene& scene, BVH* sphereBVH = nullptr, std::string* error = nullptr);
+    // The same from a file image already in memory, e.g. received over a socket
+    bool Load(const char* data, size_t size, Scene& scene, BVH* sphereBVH = nullptr, std::string* error = nullptr);
+
+    // Builds the sphere BVH to store along with the scene unless includeBVH is false
+    bool Save(const std::string& path, const Scene& scene, bool includeBVH = true);
+    // Writes the file image into data instead of a file
+    bool Save(std::vector<char>& data, const Scene& scene, bool includeBVH = true);
+
+}
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "Scenes.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <limits>
+
+namespace RayTracing::Scenes {
+
+    namespace Utils {
+
+        static float RandomFloat(uint32_t& state)
+        {
+            state = state * 747796405 + 2891336453;
+            uint32_t result = ((state >> ((state >> 28) + 4)) ^ state) * 277803737;
+            result = (result >> 22) ^ result;
+            return (float)result / 4294967295.0f;
+        }
+
+    }
+
+    Scene CreateDefault()
+    {
+        Scene scene;
+
+        Material& Material1 = scene.Materials.emplace_back();
+        Material1.Albedo = { 1.0f, 1.0f, 1.0f };
+        Material1.Roughness = 0.3f;
+
+        Material& Material2 = scene.Materials.emplace_back();
+        Material2.Albedo = { 0.95f, 0.89f, 0.89f };
+        Material2.Roughness = 1.0f;
+
+        Material& emissiveMaterial = scene.Materials.emplace_back();
+        emissiveMaterial.EmissionStrength = 0.5f;
+
+        {
+            Sphere sphere;
+            sphere.Position = { 0.0f, 0.0f, 0.0f };
+            sphere.Radius = 1.0f;
+            sphere.MaterialIndex = 0;
+            scene.Spheres.emplace_back(sphere);
+        }
+
+        {
+            Sphere sphere;
+            sphere.Position = { 2.5f, 0.0f, 0.0f };
+            sphere.Radius = 1.0f;
+            sphere.MaterialIndex = 1;
+            scene.Spheres.emplace_back(sphere);
+        }
+
+        {
+            Sphere sphere;
+            sphere.Position = { 0.0f, -101.0f, 0.0f };
+            sphere.Radius = 100.0f;
+            sphere.MaterialIndex = 1;
+            scene.Spheres.emplace_back(sphere);
+        }
+
+        {
+            Sphere sphere;
+            sphere.Position = { 5.0f, 0.0f, 16.0f };
+            sphere.Radius = 11.0f;
+            sphere.MaterialIndex = 2;
+            scene.Spheres.emplace_back(sphere);
+        }
+
+        return scene;
+    }
+
+    Scene CreateRandomSpheres(uint32_t count, uint32_t seed)
+    {
+        Scene scene;
+
+        Material& ground = scene.Materials.emplace_back();
+        ground.Albedo = { 0.8f, 0.8f, 0.8f };
+        ground.Roughness = 1.0f;
+
+        Material& light = scene.Materials.emplace_back();
+        light.EmissionColor = { 1.0f, 0.9f, 0.7f };
+        light.EmissionStrength = 4.0f;
+
+        uint32_t state = seed * 9781u + 1u;
+        for (int i = 0; i < 6; i++)
+        {
+            Material& material = scene.Materials.emplace_back();
+            material.Albedo = { Utils::RandomFloat(state), Utils::RandomFloat(state), Utils::RandomFloat(state) };
+            material.Roughness = Utils::RandomFloat(state);
+        }
+
+        {
+            Sphere sphere;
+            sphere.Position = { 0.0f, -1001.0f, 0.0f };
+            sphere.Radius = 1000.0f;
+            sphere.MaterialIndex = 0;
+            scene.Spheres.emplace_back(sphere);
+        }
+
+        // Keep the density roughly constant so the spheres don't overlap into one blob as the count grows
+        float extent = glm::max(2.0f, glm::sqrt((float)count) * 0.6f);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Sphere sphere;
+            sphere.Radius = 0.1f + Utils::RandomFloat(state) * 0.2f;
+            sphere.Position.x = (Utils::RandomFloat(state) * 2.0f - 1.0f) * extent;
+            sphere.Position.y = -1.0f + sphere.Radius + Utils::RandomFloat(state) * 0.5f;
+            sphere.Position.z = (Utils::RandomFloat(state) * 2.0f - 1.0f) * extent;
+            sphere.MaterialIndex = Utils::RandomFloat(state) < 0.02f ? 1 : 2 + (int)(Utils::RandomFloat(state) * 5.999f);
+            scene.Spheres.emplace_back(sphere);
+        }
+
+        return scene;
+    }
+
+    Scene CreateInstancedSpheres(uint32_t instanceCount, uint32_t prototypeSphereCount, uint32_t seed)
+    {
+        Scene scene;
+
+        Material& ground = scene.Materials.emplace_back();
+        ground.Albedo = { 0.8f, 0.8f, 0.8f };
+        ground.Roughness = 1.0f;
+
+        Material& light = scene.Materials.emplace_back();
+        light.EmissionColor = { 1.0f, 0.9f, 0.7f };
+        light.EmissionStrength = 4.0f;
+
+        uint32_t state = seed * 9781u + 1u;
+        for (int i = 0; i < 6; i++)
+        {
+            Material& material = scene.Materials.emplace_back();
+            material.Albedo = { Utils::RandomFloat(state), Utils::RandomFloat(state), Utils::RandomFloat(state) };
+            material.Roughness = Utils::RandomFloat(state);
+        }
+
+        {
+            Sphere sphere;
+            sphere.Position = { 0.0f, -1001.0f, 0.0f };
+            sphere.Radius = 1000.0f;
+            sphere.MaterialIndex = 0;
+            scene.Spheres.emplace_back(sphere);
+        }
+
+        // Clouds of small spheres in a unit ball resting on y = 0
+        const int prototypeCount = 4;
+        for (int i = 0; i < prototypeCount; i++)
+        {
+            Prototype& prototype = scene.Prototypes.emplace_back();
+            float radius = 0.3f / glm::max(glm::pow((float)prototypeSphereCount, 1.0f / 3.0f), 1.0f);
+            for (uint32_t j = 0; j < prototypeSphereCount; j++)
+            {
+                glm::vec3 position;
+                do
+                    position = { Utils::RandomFloat(state) * 2.0f - 1.0f, Utils::RandomFloat(state) * 2.0f - 1.0f, Utils::RandomFloat(state) * 2.0f - 1.0f };
+                while (glm::dot(position, position) > 1.0f);
+
+                Sphere sphere;
+                sphere.Radius = radius * (0.5f + Utils::RandomFloat(state));
+                sphere.Position = position * (1.0f - sphere.Radius) + glm::vec3(0.0f, 1.0f, 0.0f);
+                sphere.MaterialIndex = Utils::RandomFloat(state) < 0.02f ? 1 : 2 + (int)(Utils::RandomFloat(state) * 5.999f);
+                prototype.Spheres.emplace_back(sphere);
+            }
+        }
+
+        const uint32_t side = (uint32_t)glm::ceil(glm::sqrt((float)instanceCount));
+        const float spacing = 2.0f;
+        for (uint32_t i = 0; i < instanceCount; i++)
+        {
+            glm::vec3 position;
+            position.x = ((float)(i % side) - (float)side * 0.5f + Utils::RandomFloat(state) * 0.5f) * spacing;
+            position.y = -1.0f;
+            position.z = ((float)(i / side) - (float)side * 0.5f + Utils::RandomFloat(state) * 0.5f) * spacing;
+
+            float angle = Utils::RandomFloat(state) * glm::pi<float>() * 2.0f;
+            float scale = 0.4f + Utils::RandomFloat(state) * 0.4f;
+
+            Instance& instance = scene.Instances.emplace_back();
+            instance.Transform = glm::translate(glm::mat4(1.0f), position);
+            instance.Transform = glm::rotate(instance.Transform, angle, glm::vec3(0.0f, 1.0f, 0.0f));
+            instance.Transform = glm::scale(instance.Transform, glm::vec3(scale));
+            instance.PrototypeIndex = i % prototypeCount;
+            instance.MaterialIndex = Utils::RandomFloat(state) < 0.5f ? -1 : 2 + (int)(Utils::RandomFloat(state) * 5.999f);
+        }
+
+        return scene;
+    }
+
+    void AddMesh(Scene& scene, Mesh mesh)
+    {
+        glm::vec3 boundsMin(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+        for (const glm::vec3& position : mesh.Positions)
+        {
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+        }
+
+        if (!mesh.Positions.empty())
+        {
+            glm::vec3 extent = boundsMax - boundsMin;
+            float scale = 2.0f / glm::max(glm::max(extent.x, extent.y), glm::max(extent.z, 1e-6f));
+            glm::vec3 anchor = { (boundsMin.x + boundsMax.x) * 0.5f, boundsMin.y, (boundsMin.z + boundsMax.z) * 0.5f };
+            for (glm::vec3& position : mesh.Positions)
+                position = (position - anchor) * scale + glm::vec3(0.0f, -1.0f, 0.0f);
+        }
+
+        Material& material = scene.Materials.emplace_back();
+        material.Albedo = { 0.8f, 0.8f, 0.8f };
+        material.Roughness = 0.5f;
+
+        mesh.MaterialIndex = (int)scene.Materials.size() - 1;
+        scene.Meshes.emplace_back(std::move(mesh));
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Scene.h"
+
+#include <cstdint>
+
+namespace RayTracing::Scenes {
+
+    // The scene the editor starts up with
+    Scene CreateDefault();
+
+    // Ground plane plus `count` small spheres scattered around the origin, deterministic for a given seed
+    Scene CreateRandomSpheres(uint32_t count, uint32_t seed = 1);
+
+    // Ground plane plus `instanceCount` instances of a few prototype clusters of `prototypeSphereCount` spheres
+    // each, on a jittered grid with random rotation, scale and material overrides
+    Scene CreateInstancedSpheres(uint32_t instanceCount, uint32_t prototypeSphereCount, uint32_t seed = 1);
+
+    // Adds a loaded mesh with a material of its own, scaled to two units and standing on the ground of the scenes above
+    void AddMesh(Scene& scene, Mesh mesh);
+
+}
\ No newline at end of file
@@ -0,0 +1,358 @@
+#include "Socket.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <afunix.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace RayTracing {
+
+    namespace Utils {
+
+#ifdef _WIN32
+        using SocketHandle = SOCKET;
+        static constexpr SocketHandle InvalidSocket = INVALID_SOCKET;
+
+        static void CloseSocket(SocketHandle handle) { closesocket(handle); }
+        static int PollSockets(pollfd* sockets, size_t count, int timeoutMs) { return WSAPoll(sockets, (ULONG)count, timeoutMs); }
+
+        static bool StartSockets()
+        {
+            static const bool started = []
+            {
+                WSADATA data;
+                return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+            }();
+            return started;
+        }
+#else
+        using SocketHandle = int;
+        static constexpr SocketHandle InvalidSocket = -1;
+
+        static void CloseSocket(SocketHandle handle) { close(handle); }
+        static int PollSockets(pollfd* sockets, size_t count, int timeoutMs) { return poll(sockets, (nfds_t)count, timeoutMs); }
+        static bool StartSockets() { return true; }
+#endif
+
+#ifdef MSG_NOSIGNAL
+        static constexpr int SendFlags = MSG_NOSIGNAL; // A closed peer is an error, not a SIGPIPE
+#else
+        static constexpr int SendFlags = 0;
+#endif
+
+        static constexpr const char* UnixPrefix = "unix:";
+
+        static bool Fail(std::string* error, const std::string& message)
+        {
+            if (error)
+                *error = message;
+            return false;
+        }
+
+        static SocketHandle OpenSocket(int family)
+        {
+            SocketHandle handle = socket(family, SOCK_STREAM, 0);
+#ifdef SO_NOSIGPIPE
+            if (handle != InvalidSocket)
+            {
+                int enable = 1;
+                setsockopt(handle, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+            }
+#endif
+            return handle;
+        }
+
+        // Small messages (tile assignments) must not wait for more data to fill a packet
+        static void DisableNagle(SocketHandle handle)
+        {
+            int enable = 1;
+            setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&enable, sizeof(enable));
+        }
+
+        static bool ParseUnixAddress(const std::string& address, sockaddr_un& unixAddress, std::string* error)
+        {
+            const std::string path = address.substr(strlen(UnixPrefix));
+            if (path.empty() || path.size() >= sizeof(unixAddress.sun_path))
+                return Fail(error, "Invalid socket path '" + path + "'");
+
+            unixAddress = {};
+            unixAddress.sun_family = AF_UNIX;
+            memcpy(unixAddress.sun_path, path.c_str(), path.size() + 1);
+            return true;
+        }
+
+        // "<host>:<port>", an empty host listens on every interface
+        static addrinfo* ResolveAddress(const std::string& address, bool passive, std::string* error)
+        {
+            const size_t colon = address.rfind(':');
+            if (colon == std::string::npos)
+            {
+                Fail(error, "Expected <host>:<port> or unix:<path>, got '" + address + "'");
+                return nullptr;
+            }
+
+            const std::string host = address.substr(0, colon);
+            const std::string port = address.substr(colon + 1);
+
+            addrinfo hints = {};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+            addrinfo* addresses = nullptr;
+            if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses) != 0)
+            {
+                Fail(error, "Can't resolve '" + address + "'");
+                return nullptr;
+            }
+            return addresses;
+        }
+
+    }
+
+    Socket::~Socket()
+    {
+        Close();
+    }
+
+    Socket::Socket(Socket&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    Socket& Socket::operator=(Socket&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            std::swap(m_Handle, other.m_Handle);
+            std::swap(m_UnixPath, other.m_UnixPath);
+        }
+        return *this;
+    }
+
+    Socket Socket::Listen(const std::string& address, std::string* error)
+    {
+        Socket result;
+        if (!Utils::StartSockets())
+        {
+            Utils::Fail(error, "Can't initialize sockets");
+            return result;
+        }
+
+        if (address.rfind(Utils::UnixPrefix, 0) == 0)
+        {
+            sockaddr_un unixAddress;
+            if (!Utils::ParseUnixAddress(address, unixAddress, error))
+                return result;
+
+            Utils::SocketHandle handle = Utils::OpenSocket(AF_UNIX);
+            if (handle == Utils::InvalidSocket)
+            {
+                Utils::Fail(error, "Can't create a socket");
+                return result;
+            }
+            result.m_Handle = handle;
+
+            // A socket file left behind by an earlier run would make the bind fail
+            std::remove(unixAddress.sun_path);
+            if (bind(handle, (const sockaddr*)&unixAddress, sizeof(unixAddress)) != 0 || listen(handle, SOMAXCONN) != 0)
+            {
+                Utils::Fail(error, "Can't listen on '" + address + "'");
+                result.Close();
+                return result;
+            }
+            result.m_UnixPath = unixAddress.sun_path;
+            return result;
+        }
+
+        addrinfo* addresses = Utils::ResolveAddress(address, true, error);
+        if (!addresses)
+            return result;
+
+        for (addrinfo* candidate = addresses; candidate; candidate = candidate->ai_next)
+        {
+            Utils::SocketHandle handle = Utils::OpenSocket(candidate->ai_family);
+            if (handle == Utils::InvalidSocket)
+                continue;
+
+            int enable = 1;
+            setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&enable, sizeof(enable));
+            if (bind(handle, candidate->ai_addr, (int)candidate->ai_addrlen) == 0 && listen(handle, SOMAXCONN) == 0)
+            {
+                result.m_Handle = handle;
+                break;
+            }
+            Utils::CloseSocket(handle);
+        }
+        freeaddrinfo(addresses);
+
+        if (!result.IsValid())
+            Utils::Fail(error, "Can't listen on '" + address + "'");
+        return result;
+    }
+
+    Socket Socket::Connect(const std::string& address, std::string* error)
+    {
+        Socket result;
+        if (!Utils::StartSockets())
+        {
+            Utils::Fail(error, "Can't initialize sockets");
+            return result;
+        }
+
+        if (address.rfind(Utils::UnixPrefix, 0) == 0)
+        {
+            sockaddr_un unixAddress;
+            if (!Utils::ParseUnixAddress(address, unixAddress, error))
+                return result;
+
+            Utils::SocketHandle handle = Utils::OpenSocket(AF_UNIX);
+            if (handle == Utils::InvalidSocket)
+            {
+                Utils::Fail(error, "Can't create a socket");
+                return result;
+            }
+            result.m_Handle = handle;
+
+            if (connect(handle, (const sockaddr*)&unixAddress, sizeof(unixAddress)) != 0)
+            {
+                Utils::Fail(error, "Can't connect to '" + address + "'");
+                result.Close();
+            }
+            return result;
+        }
+
+        addrinfo* addresses = Utils::ResolveAddress(address, false, error);
+        if (!addresses)
+            return result;
+
+        for (addrinfo* candidate = addresses; candidate; candidate = candidate->ai_next)
+        {
+            Utils::SocketHandle handle = Utils::OpenSocket(candidate->ai_family);
+            if (handle == Utils::InvalidSocket)
+                continue;
+
+            if (connect(handle, candidate->ai_addr, (int)candidate->ai_addrlen) == 0)
+            {
+                Utils::DisableNagle(handle);
+                result.m_Handle = handle;
+                break;
+            }
+            Utils::CloseSocket(handle);
+        }
+        freeaddrinfo(addresses);
+
+        if (!result.IsValid())
+            Utils::Fail(error, "Can't connect to '" + address + "'");
+        return result;
+    }
+
+    Socket Socket::Accept()
+    {
+        Socket result;
+        Utils::SocketHandle handle = accept((Utils::SocketHandle)m_Handle, nullptr, nullptr);
+        if (handle == Utils::InvalidSocket)
+            return result;
+
+        // Fails harmlessly on local sockets
+        if (m_UnixPath.empty())
+            Utils::DisableNagle(handle);
+        result.m_Handle = handle;
+        return result;
+    }
+
+    bool Socket::IsValid() const
+    {
+        return (Utils::SocketHandle)m_Handle != Utils::InvalidSocket;
+    }
+
+    void Socket::Close()
+    {
+        if (IsValid())
+            Utils::CloseSocket((Utils::SocketHandle)m_Handle);
+        if (!m_UnixPath.empty())
+            std::remove(m_UnixPath.c_str());
+
+        m_Handle = Utils::InvalidSocket;
+        m_UnixPath.clear();
+    }
+
+    bool Socket::Send(const void* data, size_t size)
+    {
+        const char* bytes = (const char*)data;
+        while (size > 0)
+        {
+            const int chunk = (int)std::min<size_t>(size, 1 << 30);
+            const auto sent = send((Utils::SocketHandle)m_Handle, bytes, chunk, Utils::SendFlags);
+            if (sent <= 0)
+                return false;
+
+            bytes += sent;
+            size -= (size_t)sent;
+        }
+        return true;
+    }
+
+    bool Socket::Receive(void* data, size_t size, int timeoutMs)
+    {
+        char* bytes = (char*)data;
+        while (size > 0)
+        {
+            if (timeoutMs >= 0)
+            {
+                pollfd socket = { (Utils::SocketHandle)m_Handle, POLLIN, 0 };
+                if (Utils::PollSockets(&socket, 1, timeoutMs) <= 0)
+                    return false;
+            }
+
+            const int chunk = (int)std::min<size_t>(size, 1 << 30);
+            const auto received = recv((Utils::SocketHandle)m_Handle, bytes, chunk, 0);
+            if (received <= 0)
+                return false;
+
+            bytes += received;
+            size -= (size_t)received;
+        }
+        return true;
+    }
+
+    size_t Socket::ReceiveAvailable(void* data, size_t size)
+    {
+        const int chunk = (int)std::min<size_t>(size, 1 << 30);
+        const auto received = recv((Utils::SocketHandle)m_Handle, (char*)data, chunk, 0);
+        return received > 0 ? (size_t)received : 0;
+    }
+
+    bool Socket::WaitReadable(const std::vector<const Socket*>& sockets, std::vector<uint8_t>& readable, int timeoutMs)
+    {
+        std::vector<pollfd> pollSockets(sockets.size());
+        for (size_t i = 0; i < sockets.size(); i++)
+            pollSockets[i] = { (Utils::SocketHandle)sockets[i]->m_Handle, POLLIN, 0 };
+
+        readable.assign(sockets.size(), 0);
+        if (Utils::PollSockets(pollSockets.data(), pollSockets.size(), timeoutMs) <= 0)
+            return false;
+
+        for (size_t i = 0; i < sockets.size(); i++)
+            readable[i] = (pollSockets[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+        return true;
+    }
+
+}
\ No newline at end of file
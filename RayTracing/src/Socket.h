@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace RayTracing {
+
+    // Blocking stream socket, closed on destruction. Addresses are "unix:<path>" for a local socket or
+    // "<host>:<port>" for TCP
+    class Socket
+    {
+    public:
+        Socket() = default;
+        ~Socket();
+
+        Socket(Socket&& other) noexcept;
+        Socket& operator=(Socket&& other) noexcept;
+        Socket(const Socket&) = delete;
+        Socket& operator=(const Socket&) = delete;
+
+        static Socket Listen(const std::string& address, std::string* error = nullptr);
+        static Socket Connect(const std::string& address, std::string* error = nullptr);
+        // Invalid when the connection failed
+        Socket Accept();
+
+        bool IsValid() const;
+        void Close();
+
+        bool Send(const void* data, size_t size);
+        // Fails if the peer closes the connection or no data arrives for timeoutMs, < 0 waits forever
+        bool Receive(void* data, size_t size, int timeoutMs = -1);
+        // Up to size bytes of what already arrived, for a socket WaitReadable reported. 0 when the peer closed the
+        // connection or it failed
+        size_t ReceiveAvailable(void* data, size_t size);
+
+        // Waits until one of the sockets has data or was closed, readable[i] is set for those. Returns false
+        // when the timeout passed first
+        static bool WaitReadable(const std::vector<const Socket*>& sockets, std::vector<uint8_t>& readable, int timeoutMs);
+    private:
+#ifdef _WIN32
+        uintptr_t m_Handle = ~(uintptr_t)0;
+#else
+        int m_Handle = -1;
+#endif
+        std::string m_UnixPath; // Removed when a listening socket closes
+    };
+
+}
\ No newline at end of file
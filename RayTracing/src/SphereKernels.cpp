@@ -0,0 +1,257 @@
+#include "SphereKernels.h"
+
+#include "SIMD.h"
+
+#include <limits>
+
+#if RT_SIMD_X86 && defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace RayTracing {
+
+    void SphereSoA::Build(const std::vector<Sphere>& spheres)
+    {
+        std::vector<uint32_t> order(spheres.size());
+        for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+            order[i] = i;
+
+        Build(spheres, order);
+    }
+
+    void SphereSoA::Build(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& order)
+    {
+        Count = (uint32_t)order.size();
+
+        // NaN padding never passes the hit comparisons
+        const float padding = std::numeric_limits<float>::quiet_NaN();
+        CenterX.assign(Count + Padding, padding);
+        CenterY.assign(Count + Padding, padding);
+        CenterZ.assign(Count + Padding, padding);
+        RadiusSquared.assign(Count + Padding, padding);
+        SphereIndices = order;
+
+        for (uint32_t slot = 0; slot < Count; slot++)
+            Update(slot, spheres[order[slot]]);
+    }
+
+    void SphereSoA::Update(uint32_t slot, const Sphere& sphere)
+    {
+        CenterX[slot] = sphere.Position.x;
+        CenterY[slot] = sphere.Position.y;
+        CenterZ[slot] = sphere.Position.z;
+        RadiusSquared[slot] = sphere.Radius * sphere.Radius;
+    }
+
+    namespace SphereKernels {
+
+        // Ray/sphere with the half-b form of the quadratic, o = origin - center:
+        // a * t^2 + 2b * t + c = 0, a = dot(d, d), b = dot(o, d), c = dot(o, o) - r^2
+        // t = (-b - sqrt(b^2 - a * c)) / a, only the near root in front of the ray counts as a hit.
+        // The wide kernels evaluate exactly the same operations in the same order.
+
+        int IntersectScalar(const SphereSoA& spheres, const Ray& ray, uint32_t first, uint32_t count, float& hitDistance)
+        {
+            const float a = ray.Direction.x * ray.Direction.x + ray.Direction.y * ray.Direction.y + ray.Direction.z * ray.Direction.z;
+            const float inverseA = 1.0f / a;
+
+            int closestSlot = -1;
+            for (uint32_t slot = first; slot < first + count; slot++)
+            {
+                float ox = ray.Origin.x - spheres.CenterX[slot];
+                float oy = ray.Origin.y - spheres.CenterY[slot];
+                float oz = ray.Origin.z - spheres.CenterZ[slot];
+
+                float b = ox * ray.Direction.x + oy * ray.Direction.y + oz * ray.Direction.z;
+                float c = ox * ox + oy * oy + oz * oz - spheres.RadiusSquared[slot];
+
+                float discriminant = b * b - a * c;
+                if (!(discriminant >= 0.0f))
+                    continue;
+
+                float t = (-b - std::sqrt(discriminant)) * inverseA;
+                if (t > 0.0f && t < hitDistance)
+                {
+                    hitDistance = t;
+                    closestSlot = (int)slot;
+                }
+            }
+
+            return closestSlot;
+        }
+
+#if RT_SIMD_X86
+        // Per-lane minimum to the overall minimum. Ties go to the lowest slot, like the scalar loop
+        template<int Width>
+        static int ReduceClosest(const float* laneDistance, const int* laneSlot, float& hitDistance)
+        {
+            int closestSlot = -1;
+            for (int lane = 0; lane < Width; lane++)
+            {
+                if (laneSlot[lane] < 0)
+                    continue;
+
+                if (laneDistance[lane] < hitDistance || (laneDistance[lane] == hitDistance && laneSlot[lane] < closestSlot))
+                {
+                    hitDistance = laneDistance[lane];
+                    closestSlot = laneSlot[lane];
+                }
+            }
+            return closestSlot;
+        }
+
+        RT_TARGET("sse4.1")
+        int IntersectSSE41(const SphereSoA& spheres, const Ray& ray, uint32_t first, uint32_t count, float& hitDistance)
+        {
+            const float a = ray.Direction.x * ray.Direction.x + ray.Direction.y * ray.Direction.y + ray.Direction.z * ray.Direction.z;
+            const __m128 va = _mm_set1_ps(a);
+            const __m128 inverseA = _mm_set1_ps(1.0f / a);
+
+            const __m128 originX = _mm_set1_ps(ray.Origin.x), originY = _mm_set1_ps(ray.Origin.y), originZ = _mm_set1_ps(ray.Origin.z);
+            const __m128 directionX = _mm_set1_ps(ray.Direction.x), directionY = _mm_set1_ps(ray.Direction.y), directionZ = _mm_set1_ps(ray.Direction.z);
+            const __m128 zero = _mm_setzero_ps();
+            const __m128i laneOffset = _mm_setr_epi32(0, 1, 2, 3);
+
+            __m128 closestDistance = _mm_set1_ps(hitDistance);
+            __m128i closestSlot = _mm_set1_epi32(-1);
+
+            const uint32_t end = first + count;
+            for (uint32_t slot = first; slot < end; slot += 4)
+            {
+                __m128 ox = _mm_sub_ps(originX, _mm_loadu_ps(&spheres.CenterX[slot]));
+                __m128 oy = _mm_sub_ps(originY, _mm_loadu_ps(&spheres.CenterY[slot]));
+                __m128 oz = _mm_sub_ps(originZ, _mm_loadu_ps(&spheres.CenterZ[slot]));
+
+                __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, directionX), _mm_mul_ps(oy, directionY)), _mm_mul_ps(oz, directionZ));
+                __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)), _mm_loadu_ps(&spheres.RadiusSquared[slot]));
+                __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(va, c));
+
+                __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(zero, b), _mm_sqrt_ps(discriminant)), inverseA);
+
+                __m128i slots = _mm_add_epi32(_mm_set1_epi32((int)slot), laneOffset);
+                __m128 inRange = _mm_castsi128_ps(_mm_cmplt_epi32(slots, _mm_set1_epi32((int)end)));
+                __m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(discriminant, zero), _mm_cmpgt_ps(t, zero)), _mm_cmplt_ps(t, closestDistance));
+                hit = _mm_and_ps(hit, inRange);
+
+                closestDistance = _mm_blendv_ps(closestDistance, t, hit);
+                closestSlot = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(closestSlot), _mm_castsi128_ps(slots), hit));
+            }
+
+            alignas(16) float laneDistance[4];
+            alignas(16) int laneSlot[4];
+            _mm_store_ps(laneDistance, closestDistance);
+            _mm_store_si128((__m128i*)laneSlot, closestSlot);
+            return ReduceClosest<4>(laneDistance, laneSlot, hitDistance);
+        }
+
+        RT_TARGET("avx2")
+        int IntersectAVX2(const SphereSoA& spheres, const Ray& ray, uint32_t first, uint32_t count, float& hitDistance)
+        {
+            const float a = ray.Direction.x * ray.Direction.x + ray.Direction.y * ray.Direction.y + ray.Direction.z * ray.Direction.z;
+            const __m256 va = _mm256_set1_ps(a);
+            const __m256 inverseA = _mm256_set1_ps(1.0f / a);
+
+            const __m256 originX = _mm256_set1_ps(ray.Origin.x), originY = _mm256_set1_ps(ray.Origin.y), originZ = _mm256_set1_ps(ray.Origin.z);
+            const __m256 directionX = _mm256_set1_ps(ray.Direction.x), directionY = _mm256_set1_ps(ray.Direction.y), directionZ = _mm256_set1_ps(ray.Direction.z);
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256i laneOffset = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+            __m256 closestDistance = _mm256_set1_ps(hitDistance);
+            __m256i closestSlot = _mm256_set1_epi32(-1);
+
+            const uint32_t end = first + count;
+            for (uint32_t slot = first; slot < end; slot += 8)
+            {
+                // No FMA on purpose, it would round differently from the scalar kernel
+                __m256 ox = _mm256_sub_ps(originX, _mm256_loadu_ps(&spheres.CenterX[slot]));
+                __m256 oy = _mm256_sub_ps(originY, _mm256_loadu_ps(&spheres.CenterY[slot]));
+                __m256 oz = _mm256_sub_ps(originZ, _mm256_loadu_ps(&spheres.CenterZ[slot]));
+
+                __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, directionX), _mm256_mul_ps(oy, directionY)), _mm256_mul_ps(oz, directionZ));
+                __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy)), _mm256_mul_ps(oz, oz)), _mm256_loadu_ps(&spheres.RadiusSquared[slot]));
+                __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(va, c));
+
+                __m256 t = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(zero, b), _mm256_sqrt_ps(discriminant)), inverseA);
+
+                __m256i slots = _mm256_add_epi32(_mm256_set1_epi32((int)slot), laneOffset);
+                __m256 inRange = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32((int)end), slots));
+                __m256 hit = _mm256_and_ps(_mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+                hit = _mm256_and_ps(_mm256_and_ps(hit, _mm256_cmp_ps(t, closestDistance, _CMP_LT_OQ)), inRange);
+
+                closestDistance = _mm256_blendv_ps(closestDistance, t, hit);
+                closestSlot = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(closestSlot), _mm256_castsi256_ps(slots), hit));
+            }
+
+            alignas(32) float laneDistance[8];
+            alignas(32) int laneSlot[8];
+            _mm256_store_ps(laneDistance, closestDistance);
+            _mm256_store_si256((__m256i*)laneSlot, closestSlot);
+            return ReduceClosest<8>(laneDistance, laneSlot, hitDistance);
+        }
+
+        static bool SupportsSSE41()
+        {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 19)) != 0;
+#else
+            return __builtin_cpu_supports("sse4.1");
+#endif
+        }
+
+        static bool SupportsAVX2()
+        {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+            if (!osSavesYmm)
+                return false;
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+#else
+        int IntersectSSE41(const SphereSoA& spheres, const Ray& ray, uint32_t first, uint32_t count, float& hitDistance)
+        {
+            return IntersectScalar(spheres, ray, first, count, hitDistance);
+        }
+
+        int IntersectAVX2(const SphereSoA& spheres, const Ray& ray, uint32_t first, uint32_t count, float& hitDistance)
+        {
+            return IntersectScalar(spheres, ray, first, count, hitDistance);
+        }
+
+        static bool SupportsSSE41() { return false; }
+        static bool SupportsAVX2() { return false; }
+#endif
+
+        IntersectFunc GetBest()
+        {
+            static const IntersectFunc s_Best = []() -> IntersectFunc
+            {
+                if (SupportsAVX2())
+                    return IntersectAVX2;
+                if (SupportsSSE41())
+                    return IntersectSSE41;
+                return IntersectScalar;
+            }();
+            return s_Best;
+        }
+
+        const char* GetName(IntersectFunc kernel)
+        {
+            if (kernel == IntersectAVX2)
+                return "AVX2";
+            if (kernel == IntersectSSE41)
+                return "SSE4.1";
+            return "Scalar";
+        }
+
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Ray.h"
+#include "Scene.h"
+
+#include <vector>
+
+namespace RayTracing {
+
+    // Structure of arrays copy of Scene::Spheres for the SIMD intersection kernels. Slots are stored in
+    // BVH primitive order so every leaf is one contiguous range; SphereIndices maps a slot back to Scene::Spheres.
+    struct SphereSoA
+    {
+        // Every array is padded so the wide kernels may load a full vector past the last slot
+        static constexpr uint32_t Padding = 8;
+
+        std::vector<float> CenterX, CenterY, CenterZ;
+        std::vector<float> RadiusSquared;
+        std::vector<uint32_t> SphereIndices;
+        uint32_t Count = 0;
+
+        void Build(const std::vector<Sphere>& spheres);
+        void Build(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& order);
+        void Update(uint32_t slot, const Sphere& sphere);
+    };
+
+    namespace SphereKernels {
+
+        // Closest hit among slots [first, first + count) that is closer than hitDistance.
+        // Returns the slot and shrinks hitDistance, or -1 on miss. All kernels return bit-identical results.
+        using IntersectFunc = int(*)(const SphereSoA& spheres, const Ray& ray, uint32_t first, uint32_t count, float& hitDistance);
+
+        int IntersectScalar(const SphereSoA& spheres, const Ray& ray, uint32_t first, uint32_t count, float& hitDistance);
+        int IntersectSSE41(const SphereSoA& spheres, const Ray& ray, uint32_t first, uint32_t count, float& hitDistance);
+        int IntersectAVX2(const SphereSoA& spheres, const Ray& ray, uint32_t first, uint32_t count, float& hitDistance);
+
+        // Widest kernel this CPU supports, detected on first use
+        IntersectFunc GetBest();
+        const char* GetName(IntersectFunc kernel);
+
+    }
+
+}
\ No newline at end of file
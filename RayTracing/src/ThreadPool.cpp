@@ -0,0 +1,150 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+    #define NOMINMAX
+    #include <Windows.h>
+#elif defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+namespace RayTracing {
+
+    ThreadPool::ThreadPool(uint32_t workerCount, bool pinThreads)
+        : m_Pinned(pinThreads)
+    {
+        if (workerCount == 0)
+            workerCount = std::max(1u, std::thread::hardware_concurrency());
+
+        m_Queues.reserve(workerCount);
+        for (uint32_t i = 0; i < workerCount; i++)
+            m_Queues.emplace_back(std::make_unique<WorkQueue>());
+
+        m_Workers.reserve(workerCount);
+        for (uint32_t i = 0; i < workerCount; i++)
+        {
+            m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+            if (pinThreads)
+                PinToCore(m_Workers.back(), i % std::max(1u, std::thread::hardware_concurrency()));
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::scoped_lock lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_WakeCondition.notify_all();
+
+        for (std::thread& worker : m_Workers)
+            worker.join();
+    }
+
+    void ThreadPool::ParallelFor(uint32_t taskCount, const Task& task)
+    {
+        if (taskCount == 0)
+            return;
+
+        m_Task = &task;
+        m_Remaining = taskCount;
+
+        // Contiguous runs keep neighbouring tasks (Morton ordered tiles) on one worker until stealing kicks in
+        const uint32_t workerCount = GetWorkerCount();
+        for (uint32_t i = 0; i < workerCount; i++)
+        {
+            uint32_t begin = (uint32_t)((uint64_t)taskCount * i / workerCount);
+            uint32_t end = (uint32_t)((uint64_t)taskCount * (i + 1) / workerCount);
+
+            std::scoped_lock lock(m_Queues[i]->Mutex);
+            for (uint32_t taskIndex = begin; taskIndex < end; taskIndex++)
+                m_Queues[i]->Tasks.push_back(taskIndex);
+        }
+
+        {
+            std::scoped_lock lock(m_Mutex);
+            m_Generation++;
+        }
+        m_WakeCondition.notify_all();
+
+        std::unique_lock lock(m_Mutex);
+        m_DoneCondition.wait(lock, [this]() { return m_Remaining == 0; });
+        m_Task = nullptr;
+    }
+
+    void ThreadPool::WorkerLoop(uint32_t workerIndex)
+    {
+        uint64_t generation = 0;
+        while (true)
+        {
+            {
+                std::unique_lock lock(m_Mutex);
+                m_WakeCondition.wait(lock, [&]() { return m_Stop || m_Generation != generation; });
+                if (m_Stop)
+                    return;
+
+                generation = m_Generation;
+            }
+
+            uint32_t taskIndex;
+            while (PopOrSteal(workerIndex, taskIndex))
+            {
+                (*m_Task)(taskIndex, workerIndex);
+
+                if (--m_Remaining == 0)
+                {
+                    std::scoped_lock lock(m_Mutex);
+                    m_DoneCondition.notify_all();
+                }
+            }
+        }
+    }
+
+    bool ThreadPool::PopOrSteal(uint32_t workerIndex, uint32_t& taskIndex)
+    {
+        {
+            WorkQueue& queue = *m_Queues[workerIndex];
+            std::scoped_lock lock(queue.Mutex);
+            if (!queue.Tasks.empty())
+            {
+                taskIndex = queue.Tasks.front();
+                queue.Tasks.pop_front();
+                return true;
+            }
+        }
+
+        // Steal from the far end of the victim's run, away from what it is working on
+        const uint32_t workerCount = GetWorkerCount();
+        for (uint32_t i = 1; i < workerCount; i++)
+        {
+            WorkQueue& victim = *m_Queues[(workerIndex + i) % workerCount];
+            std::scoped_lock lock(victim.Mutex);
+            if (!victim.Tasks.empty())
+            {
+                taskIndex = victim.Tasks.back();
+                victim.Tasks.pop_back();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void ThreadPool::PinToCore(std::thread& thread, uint32_t core)
+    {
+#if defined(_WIN32)
+        SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(core, &cpuSet);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuSet);
+#else
+        (void)thread;
+        (void)core;
+#endif
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RayTracing {
+
+    // Persistent workers with one task deque each. A ParallelFor hands every worker a contiguous run of
+    // task indices; a worker drains its own deque from the front and, once empty, steals from the back
+    // of the others, so neighbouring tasks tend to stay on the same core.
+    class ThreadPool
+    {
+    public:
+        using Task = std::function<void(uint32_t taskIndex, uint32_t workerIndex)>;
+    public:
+        // workerCount 0 = one worker per hardware thread. pinThreads binds worker i to core i
+        ThreadPool(uint32_t workerCount = 0, bool pinThreads = false);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Runs task(i, worker) for every i in [0, taskCount) and blocks until all of them are done
+        void ParallelFor(uint32_t taskCount, const Task& task);
+
+        uint32_t GetWorkerCount() const { return (uint32_t)m_Workers.size(); }
+        bool IsPinned() const { return m_Pinned; }
+    private:
+        struct alignas(64) WorkQueue
+        {
+            std::mutex Mutex;
+            std::deque<uint32_t> Tasks;
+        };
+
+        void WorkerLoop(uint32_t workerIndex);
+        bool PopOrSteal(uint32_t workerIndex, uint32_t& taskIndex);
+        static void PinToCore(std::thread& thread, uint32_t core);
+    private:
+        std::vector<std::thread> m_Workers;
+        std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+        bool m_Pinned = false;
+
+        const Task* m_Task = nullptr;
+        std::atomic<uint32_t> m_Remaining = 0;
+
+        std::mutex m_Mutex;
+        std::condition_variable m_WakeCondition;
+        std::condition_variable m_DoneCondition;
+        uint64_t m_Generation = 0;
+        bool m_Stop = false;
+    };
+
+}
\ No newline at end of file
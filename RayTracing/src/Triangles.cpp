@@ -0,0 +1,75 @@
+#include "Triangles.h"
+
+namespace RayTracing {
+
+    void TriangleData::Build(const std::vector<Mesh>& meshes)
+    {
+        uint32_t triangleCount = 0;
+        for (const Mesh& mesh : meshes)
+            triangleCount += mesh.GetTriangleCount();
+
+        std::vector<uint32_t> order(triangleCount);
+        for (uint32_t i = 0; i < triangleCount; i++)
+            order[i] = i;
+
+        Build(meshes, order);
+    }
+
+    void TriangleData::Build(const std::vector<Mesh>& meshes, const std::vector<uint32_t>& order)
+    {
+        Count = (uint32_t)order.size();
+
+        // Where each triangle comes from, in scene numbering
+        std::vector<uint32_t> triangleMeshes;
+        std::vector<const uint32_t*> triangleIndices;
+        triangleMeshes.reserve(Count);
+        triangleIndices.reserve(Count);
+        for (uint32_t meshIndex = 0; meshIndex < (uint32_t)meshes.size(); meshIndex++)
+        {
+            const Mesh& mesh = meshes[meshIndex];
+            for (uint32_t i = 0; i < mesh.GetTriangleCount(); i++)
+            {
+                triangleMeshes.push_back(meshIndex);
+                triangleIndices.push_back(&mesh.Indices[i * 3]);
+            }
+        }
+
+        Vertex0.resize(Count);
+        Edge1.resize(Count);
+        Edge2.resize(Count);
+        MeshIndices.resize(Count);
+        for (uint32_t slot = 0; slot < Count; slot++)
+        {
+            const uint32_t triangle = order[slot];
+            const std::vector<glm::vec3>& positions = meshes[triangleMeshes[triangle]].Positions;
+            const uint32_t* indices = triangleIndices[triangle];
+
+            Vertex0[slot] = positions[indices[0]];
+            Edge1[slot] = positions[indices[1]] - positions[indices[0]];
+            Edge2[slot] = positions[indices[2]] - positions[indices[0]];
+            MeshIndices[slot] = triangleMeshes[triangle];
+        }
+    }
+
+    void TriangleData::GetBounds(const std::vector<Mesh>& meshes, std::vector<AABB>& bounds, std::vector<glm::vec3>& centroids)
+    {
+        bounds.clear();
+        centroids.clear();
+        for (const Mesh& mesh : meshes)
+        {
+            for (uint32_t i = 0; i < mesh.GetTriangleCount(); i++)
+            {
+                const glm::vec3& a = mesh.Positions[mesh.Indices[i * 3 + 0]];
+                const glm::vec3& b = mesh.Positions[mesh.Indices[i * 3 + 1]];
+                const glm::vec3& c = mesh.Positions[mesh.Indices[i * 3 + 2]];
+
+                AABB& triangleBounds = bounds.emplace_back();
+                triangleBounds.Grow(a);
+                triangleBounds.Grow(b);
+                triangleBounds.Grow(c);
+                centroids.push_back((a + b + c) / 3.0f);
+            }
+        }
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "BVH.h"
+#include "Intersection.h"
+#include "Ray.h"
+#include "RenderStats.h"
+#include "Scene.h"
+
+#include <vector>
+
+namespace RayTracing {
+
+    // Flat copy of the triangles of all Scene::Meshes, ready for intersection. Triangles are numbered mesh after
+    // mesh; slots are stored in BVH primitive order like SphereSoA, so every leaf is one contiguous range.
+    struct TriangleData
+    {
+        std::vector<glm::vec3> Vertex0, Edge1, Edge2;
+        std::vector<uint32_t> MeshIndices; // Per slot
+        uint32_t Count = 0;
+
+        void Build(const std::vector<Mesh>& meshes);
+        void Build(const std::vector<Mesh>& meshes, const std::vector<uint32_t>& order);
+
+        // Per triangle input for BVH::Build
+        static void GetBounds(const std::vector<Mesh>& meshes, std::vector<AABB>& bounds, std::vector<glm::vec3>& centroids);
+
+        // Closest hit among slots [first, first + count) that is closer than hitDistance.
+        // Returns the slot and shrinks hitDistance, or -1 on miss. Stats = count the tests into t_RenderStats
+        template<bool Stats>
+        int Intersect(const Ray& ray, uint32_t first, uint32_t count, float& hitDistance) const
+        {
+            int closestSlot = -1;
+            for (uint32_t slot = first; slot < first + count; slot++)
+            {
+                float distance = Intersection::RayTriangle(ray, Vertex0[slot], Edge1[slot], Edge2[slot], hitDistance);
+                if (distance < hitDistance)
+                {
+                    hitDistance = distance;
+                    closestSlot = (int)slot;
+                }
+            }
+            RT_STATS_ADD_IF(Stats, TriangleTests, count);
+            return closestSlot;
+        }
+
+        // Whether any of the slots [first, first + count) is hit closer than maxDistance
+        template<bool Stats>
+        bool Occluded(const Ray& ray, uint32_t first, uint32_t count, float maxDistance) const
+        {
+            for (uint32_t slot = first; slot < first + count; slot++)
+            {
+                if (Intersection::RayTriangle(ray, Vertex0[slot], Edge1[slot], Edge2[slot], maxDistance) < maxDistance)
+                {
+                    RT_STATS_ADD_IF(Stats, TriangleTests, slot - first + 1);
+                    return true;
+                }
+            }
+            RT_STATS_ADD_IF(Stats, TriangleTests, count);
+            return false;
+        }
+
+        // Geometric normal, not yet facing any particular side
+        glm::vec3 GetNormal(uint32_t slot) const { return glm::normalize(glm::cross(Edge1[slot], Edge2[slot])); }
+    };
+
+}
\ No newline at end of file
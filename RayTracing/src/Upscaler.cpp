@@ -0,0 +1,73 @@
+#include "Upscaler.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace RayTracing::Upscaler {
+
+    namespace Utils {
+
+        // Source pixel left of (or above) each destination pixel center and the weight of the next one, in 1/256
+        static void GetTaps(uint32_t sourceSize, uint32_t size, std::vector<uint32_t>& indices, std::vector<uint32_t>& weights)
+        {
+            indices.resize(size);
+            weights.resize(size);
+
+            const float scale = (float)sourceSize / (float)size;
+            for (uint32_t i = 0; i < size; i++)
+            {
+                float position = std::clamp(((float)i + 0.5f) * scale - 0.5f, 0.0f, (float)(sourceSize - 1));
+                uint32_t index = std::min((uint32_t)position, sourceSize - 1);
+                indices[i] = index;
+                weights[i] = index + 1 < sourceSize ? (uint32_t)((position - (float)index) * 256.0f + 0.5f) : 0;
+            }
+        }
+
+        // Both pixels' red and blue, then green and alpha, blended in one multiply each. 255 * 256 still
+        // fits the 16 bits every channel gets
+        static uint32_t Lerp(uint32_t a, uint32_t b, uint32_t weight)
+        {
+            const uint32_t inverse = 256 - weight;
+            uint32_t redBlue = (((a & 0x00ff00ff) * inverse + (b & 0x00ff00ff) * weight) >> 8) & 0x00ff00ff;
+            uint32_t greenAlpha = (((a >> 8) & 0x00ff00ff) * inverse + ((b >> 8) & 0x00ff00ff) * weight) & 0xff00ff00;
+            return redBlue | greenAlpha;
+        }
+
+    }
+
+    void Bilinear(const uint32_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint32_t* destination, uint32_t width, uint32_t height)
+    {
+        if (!sourceWidth || !sourceHeight || !width || !height)
+            return;
+
+        thread_local std::vector<uint32_t> t_Columns, t_ColumnWeights, t_Rows, t_RowWeights, t_BlendedRow;
+        Utils::GetTaps(sourceWidth, width, t_Columns, t_ColumnWeights);
+        Utils::GetTaps(sourceHeight, height, t_Rows, t_RowWeights);
+        t_BlendedRow.resize(sourceWidth);
+
+        // Plain pointers, so the loops don't look the thread locals up on every access
+        const uint32_t* columns = t_Columns.data();
+        const uint32_t* columnWeights = t_ColumnWeights.data();
+        const uint32_t* rows = t_Rows.data();
+        const uint32_t* rowWeights = t_RowWeights.data();
+        uint32_t* blendedRow = t_BlendedRow.data();
+
+        // Each destination row blends its two source rows once, then every pixel is a single blend within that row
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint32_t* top = source + (size_t)rows[y] * sourceWidth;
+            const uint32_t* bottom = rowWeights[y] ? top + sourceWidth : top;
+            for (uint32_t x = 0; x < sourceWidth; x++)
+                blendedRow[x] = Utils::Lerp(top[x], bottom[x], rowWeights[y]);
+
+            uint32_t* row = destination + (size_t)y * width;
+            for (uint32_t x = 0; x < width; x++)
+            {
+                const uint32_t column = columns[x];
+                const uint32_t next = columnWeights[x] ? column + 1 : column;
+                row[x] = Utils::Lerp(blendedRow[column], blendedRow[next], columnWeights[x]);
+            }
+        }
+    }
+
+}
\ No newline at end of file
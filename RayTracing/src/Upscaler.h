@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace RayTracing {
+
+    namespace Upscaler {
+
+        // Bilinear resampling of a row major RGBA8 image to width x height, the corners of both images line up.
+        // Meant for enlarging, shrinking skips pixels instead of averaging them
+        void Bilinear(const uint32_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint32_t* destination, uint32_t width, uint32_t height);
+
+    }
+
+}
\ No newline at end of file
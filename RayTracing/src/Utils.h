@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// Small per-sample helpers shared by the renderer and the benchmarks, inline since they sit in the innermost loops
+namespace RayTracing::Utils {
+
+    inline float FastRandom(uint32_t& state)
+    {
+        state = state * 747796405 + 2891336453;
+        uint32_t result = ((state >> ((state >> 28) + 4)) ^ state) * 277803737;
+        result = (result >> 22) ^ result;
+        return (float)result / 4294967295.0f;
+    }
+
+    // PCG output permutation of the state after one step, every input bit affects every output bit (Jarzynski and
+    // Olano 2020). Turns indices into well spread seeds
+    inline uint32_t Hash(uint32_t value)
+    {
+        uint32_t state = value * 747796405 + 2891336453;
+        uint32_t result = ((state >> ((state >> 28) + 4)) ^ state) * 277803737;
+        return (result >> 22) ^ result;
+    }
+
+    inline uint32_t HashCombine(uint32_t seed, uint32_t value)
+    {
+        return Hash(seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2)));
+    }
+
+    // The top 24 bits as a float in [0, 1)
+    inline float ToUnitFloat(uint32_t value)
+    {
+        return (float)(value >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // Two unit vectors perpendicular to a unit normal and to each other, without a branch (Duff et al. 2017)
+    inline void OrthonormalBasis(const glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent)
+    {
+        float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+        float a = -1.0f / (sign + normal.z);
+        float b = normal.x * normal.y * a;
+        tangent = glm::vec3(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+        bitangent = glm::vec3(b, sign + normal.y * normal.y * a, -normal.y);
+    }
+
+    // Direction around a unit axis at the given polar angle, the azimuth turns with u in [0, 1)
+    inline glm::vec3 DirectionAround(const glm::vec3& axis, float cosTheta, float sinTheta, float u)
+    {
+        glm::vec3 tangent, bitangent;
+        OrthonormalBasis(axis, tangent, bitangent);
+
+        // The sine follows from the cosine, it is positive for the first half turn
+        float cosPhi = glm::cos(2.0f * 3.1415926f * u);
+        float sinPhi = glm::sqrt(glm::max(1.0f - cosPhi * cosPhi, 0.0f));
+        sinPhi = u < 0.5f ? sinPhi : -sinPhi;
+        return tangent * (sinTheta * cosPhi) + bitangent * (sinTheta * sinPhi) + axis * cosTheta;
+    }
+
+    // Cosine weighted direction around a unit normal from two numbers in [0, 1): a cosine and three square roots,
+    // no rejection or normalization. Its density is dot(normal, direction) / pi
+    inline glm::vec3 CosineHemisphereDirection(const glm::vec3& normal, const glm::vec2& u)
+    {
+        return DirectionAround(normal, glm::sqrt(1.0f - u.x), glm::sqrt(u.x), u.y);
+    }
+
+    // Weight of a sample drawn with density pdf, when another strategy with density otherPdf could also have drawn it
+    inline float PowerHeuristic(float pdf, float otherPdf)
+    {
+        return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+    }
+
+    inline float Luminance(const glm::vec3& color)
+    {
+        return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+}
\ No newline at end of file
@@ -1,63 +1,35 @@
 #include "Walnut/Application.h"
 #include "Walnut/EntryPoint.h"
 
-#include "Walnut/Timer.h"
+#include "Walnut/Image.h"
 #include "Walnut/UI/UI.h"
 
 #include "Camera.h"
+#include "MeshLoader.h"
 #include "Renderer.h"
+#include "RenderThread.h"
+#include "SceneFile.h"
+#include "Scenes.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <numeric>
+#include <thread>
+
 namespace RayTracing {
 
     class RayTracingLayer : public Walnut::Layer
     {
     public:
-        RayTracingLayer()
-            : m_Camera(45.0f, 0.1f, 1000.0f) 
+        RayTracingLayer(const char* scenePath)
+            : m_Camera(45.0f, 0.1f, 1000.0f), m_Scene(Scenes::CreateDefault())
         {
-            Material& Material1 = m_Scene.Materials.emplace_back();
-            Material1.Albedo = { 1.0f, 1.0f, 1.0f };
-            Material1.Roughness = 0.3f;
-
-            Material& Material2 = m_Scene.Materials.emplace_back();
-            Material2.Albedo = { 0.95f, 0.89f, 0.89f };
-            Material2.Roughness = 1.0f;
-
-            Material& emissiveMaterial = m_Scene.Materials.emplace_back();
-            emissiveMaterial.EmissionStrength = 0.5f;
-
-            {
-                Sphere sphere;
-                sphere.Position = { 0.0f, 0.0f, 0.0f };
-                sphere.Radius = 1.0f;
-                sphere.MaterialIndex = 0;
-                m_Scene.Spheres.emplace_back(sphere);
-            }
-
-            {
-                Sphere sphere;
-                sphere.Position = { 2.5f, 0.0f, 0.0f };
-                sphere.Radius = 1.0f;
-                sphere.MaterialIndex = 1;
-                m_Scene.Spheres.emplace_back(sphere);
-            }
-
-            {
-                Sphere sphere;
-                sphere.Position = { 0.0f, -101.0f, 0.0f };
-                sphere.Radius = 100.0f;
-                sphere.MaterialIndex = 1;
-                m_Scene.Spheres.emplace_back(sphere);
-            }
-
+            m_RenderThread.SubmitScene(m_Scene);
+            if (scenePath)
             {
-                Sphere sphere;
-                sphere.Position = { 5.0f, 0.0f, 16.0f };
-                sphere.Radius = 11.0f;
-                sphere.MaterialIndex = 2;
-                m_Scene.Spheres.emplace_back(sphere);
+                snprintf(m_ScenePath, sizeof(m_ScenePath), "%s", scenePath);
+                LoadScene();
             }
         }
 
@@ -69,18 +41,157 @@ namespace RayTracing {
                 int treeNodeFlags = ImGuiTreeNodeFlags_Framed | ImGuiTreeNodeFlags_DefaultOpen;
                 if (ImGui::TreeNodeEx("Statistics", treeNodeFlags))
                 {
-                    ImGui::Text("Last render: %.3fms", m_LastRenderTime);
-                    ImGui::Text("FPS: %.1f", 1000.0f / m_LastRenderTime);
+                    ImGui::Text("UI: %.3fms, %.1f FPS", m_LastUpdateTime, 1000.0f / m_LastUpdateTime);
+                    ImGui::Text("Sphere kernel: %s", SphereKernels::GetName(SphereKernels::GetBest()));
+                    ImGui::Text("Resolve kernel: %s", ResolveKernels::GetName(ResolveKernels::GetBest()));
+                    ImGui::Text("Denoise kernel: %s", DenoiseKernels::GetName(DenoiseKernels::GetBest()));
+
+                    // Everything below describes the frame on screen, which can lag the inputs by a frame or two
+                    const RenderThread::Frame* frame = m_Frame;
+                    if (frame && frame->Width && frame->Height)
+                    {
+                        ImGui::Text("Last render: %.3fms, %.1f FPS", frame->RenderMs, 1000.0f / frame->RenderMs);
+                        ImGui::Text("Input version: %llu shown, %llu latest", (unsigned long long)frame->InputVersion, (unsigned long long)m_RenderThread.GetInputVersion());
+                        ImGui::Text("Active pixels: %.1f%%", 100.0f * frame->ActivePixelCount / (float)(frame->RenderWidth * frame->RenderHeight));
+                        if (frame->RenderWidth != frame->Width || frame->RenderHeight != frame->Height)
+                            ImGui::Text("Render resolution: %ux%u, upscaled to %ux%u", frame->RenderWidth, frame->RenderHeight, frame->Width, frame->Height);
+                    }
+
+                    if (frame && (m_Settings.FrameBudgetMs > 0.0f || m_FrameLimit > 0))
+                    {
+                        ImGui::Text("Frame %u", frame->FrameIndex);
+                        ImGui::SameLine();
+                        ImGui::ProgressBar(frame->PassProgress);
+                    }
+
+                    if (frame && !frame->TileTimes.empty())
+                    {
+                        const std::vector<float>& tileTimes = frame->TileTimes;
+                        auto [minTime, maxTime] = std::minmax_element(tileTimes.begin(), tileTimes.end());
+                        float averageTime = std::accumulate(tileTimes.begin(), tileTimes.end(), 0.0f) / (float)tileTimes.size();
+                        ImGui::Text("Tiles: %zu, min %.3fms avg %.3fms max %.3fms", tileTimes.size(), *minTime, averageTime, *maxTime);
+                    }
+
+#if RT_ENABLE_STATS
+                    if (frame && ImGui::TreeNodeEx("Counters"))
+                    {
+                        const RenderStats& stats = frame->Stats;
+                        uint64_t rayCount = stats.PrimaryRays + stats.SecondaryRays + stats.ShadowRays;
+                        ImGui::Text("Rays: %llu primary, %llu secondary, %llu shadow", (unsigned long long)stats.PrimaryRays, (unsigned long long)stats.SecondaryRays,
+                            (unsigned long long)stats.ShadowRays);
+                        ImGui::Text("Sphere tests: %llu, %.1f per ray", (unsigned long long)stats.SphereTests, rayCount ? (double)stats.SphereTests / (double)rayCount : 0.0);
+                        ImGui::Text("Triangle tests: %llu, %.1f per ray", (unsigned long long)stats.TriangleTests, rayCount ? (double)stats.TriangleTests / (double)rayCount : 0.0);
+                        ImGui::Text("Hits: %.1f%%", rayCount ? 100.0 * (double)stats.Hits / (double)(stats.Hits + stats.Misses) : 0.0);
+
+                        for (uint32_t stage = 0; stage < RenderStats::StageCount; stage++)
+                            ImGui::Text("%s: %.3fms", RenderStats::GetStageName(stage), stats.StageMs[stage]);
+
+                        float pathLengths[RenderStats::PathLengthBins];
+                        for (uint32_t i = 0; i < RenderStats::PathLengthBins; i++)
+                            pathLengths[i] = (float)stats.PathLengths[i];
+                        ImGui::PlotHistogram("Path lengths", pathLengths, (int)RenderStats::PathLengthBins, 0, nullptr, 0.0f, 3.4e38f, ImVec2(0.0f, 60.0f));
+
+                        ImGui::TreePop();
+                    }
+#endif
                     ImGui::TreePop();
                 }
 
                 if (ImGui::TreeNodeEx("Controls", treeNodeFlags))
                 {
+                    Renderer::Settings& settings = m_Settings;
                     if (ImGui::Button("Reset"))
-                        m_Renderer.ResetFrameIndex();
+                        m_RenderThread.ResetAccumulation();
+
+                    ImGui::SameLine();
+                    ImGui::Checkbox("Accumulate", &settings.Accumulate);
 
                     ImGui::SameLine();
-                    ImGui::Checkbox("Accumulate", &m_Renderer.GetSettings().Accumulate);
+                    ImGui::Checkbox("BVH", &settings.UseBVH);
+
+                    ImGui::SameLine();
+                    ImGui::Checkbox("SIMD", &settings.UseSIMD);
+
+                    ImGui::SameLine();
+                    ImGui::Checkbox("Packets", &settings.PrimaryRayPackets);
+
+                    // The render thread restarts accumulation when these change
+                    ImGui::Checkbox("Anti-aliasing", &settings.JitterPrimaryRays);
+
+                    const char* samplerNames[] = { "Independent", "Sobol" };
+                    int sampler = (int)settings.Sampler;
+                    if (ImGui::Combo("Sampler", &sampler, samplerNames, 2))
+                        settings.Sampler = (SamplerType)sampler;
+
+                    int maxDepth = (int)settings.MaxDepth;
+                    if (ImGui::SliderInt("Max depth", &maxDepth, 1, 32))
+                        settings.MaxDepth = (uint32_t)maxDepth;
+
+                    ImGui::Checkbox("Russian roulette", &settings.RussianRoulette);
+                    ImGui::Checkbox("Light sampling", &settings.NextEventEstimation);
+
+                    // Same image either way, only the order the work is done in changes
+                    ImGui::Checkbox("Wavefront", &settings.Wavefront);
+                    if (settings.Wavefront)
+                    {
+                        const char* sortingNames[] = { "None", "Material", "Direction" };
+                        int sorting = (int)settings.WavefrontSorting;
+                        if (ImGui::Combo("Path sorting", &sorting, sortingNames, 3))
+                            settings.WavefrontSorting = (PathSorting)sorting;
+                    }
+
+                    ImGui::Checkbox("Reprojection", &settings.Reprojection);
+                    if (settings.Reprojection)
+                    {
+                        int maxHistory = (int)settings.ReprojectionMaxHistory;
+                        if (ImGui::SliderInt("Max history", &maxHistory, 1, 256))
+                            settings.ReprojectionMaxHistory = (uint32_t)maxHistory;
+                    }
+
+                    ImGui::Checkbox("Adaptive sampling", &settings.AdaptiveSampling);
+                    if (settings.AdaptiveSampling)
+                        ImGui::DragFloat("Error threshold", &settings.AdaptiveThreshold, 0.001f, 0.001f, 1.0f);
+
+                    ImGui::DragFloat("Frame budget (ms, 0 = off)", &settings.FrameBudgetMs, 0.5f, 0.0f, 1000.0f);
+
+                    // Lower resolution while the camera or the scene is changing
+                    ImGui::Checkbox("Dynamic resolution", &m_DynamicResolution.Enabled);
+                    if (m_DynamicResolution.Enabled)
+                    {
+                        ImGui::DragFloat("Target FPS", &m_DynamicResolution.TargetFPS, 1.0f, 1.0f, 240.0f);
+                        ImGui::SliderFloat("Min scale", &m_DynamicResolution.MinScale, 0.0625f, 1.0f);
+                    }
+
+                    ImGui::DragInt("Frame limit (0 = off)", &m_FrameLimit, 1.0f, 0, 100000);
+
+                    // Display only, the accumulated radiance is kept
+                    const char* toneMapNames[] = { "Clamp", "Reinhard", "ACES" };
+                    int toneMap = (int)settings.ToneMap;
+                    if (ImGui::Combo("Tone mapping", &toneMap, toneMapNames, 3))
+                        settings.ToneMap = (ToneMapping)toneMap;
+
+                    ImGui::DragFloat("Exposure", &settings.Exposure, 0.01f, 0.0f, 16.0f);
+
+                    ImGui::SameLine();
+                    ImGui::Checkbox("sRGB", &settings.SRGB);
+
+                    // Turning it on restarts accumulation, the features that guide it are only gathered while it's on
+                    ImGui::Checkbox("Denoise", &settings.Denoise);
+                    if (settings.Denoise)
+                    {
+                        int iterations = (int)settings.DenoiseIterations;
+                        if (ImGui::SliderInt("Denoise iterations", &iterations, 0, (int)Denoiser::MaxIterations))
+                            settings.DenoiseIterations = (uint32_t)iterations;
+                    }
+
+                    int threadCount = (int)settings.ThreadCount;
+                    if (ImGui::SliderInt("Threads (0 = all)", &threadCount, 0, (int)std::thread::hardware_concurrency()))
+                        settings.ThreadCount = (uint32_t)threadCount;
+
+                    ImGui::SameLine();
+                    ImGui::Checkbox("Pin", &settings.PinThreads);
+                    ImGui::SameLine();
+                    ImGui::Checkbox("Serial", &settings.Serial);
 
                     float cameraSpeed = m_Camera.GetSpeed();
                     if (ImGui::DragFloat("Camera speed", &cameraSpeed, 0.1f, 0.1f, 10.0f)
@@ -96,6 +207,15 @@ namespace RayTracing {
             {
                 ImGui::Begin("Scene");
 
+                ImGui::InputText("Scene File", m_ScenePath, sizeof(m_ScenePath));
+                if (ImGui::Button("Load"))
+                    LoadScene();
+                ImGui::SameLine();
+                if (ImGui::Button("Save"))
+                    m_SceneError = SceneFile::Save(m_ScenePath, m_Scene) ? "" : "Can't write the scene file";
+                if (!m_SceneError.empty())
+                    ImGui::Text("%s", m_SceneError.c_str());
+
                 int treeNodeFlags = ImGuiTreeNodeFlags_Framed | ImGuiTreeNodeFlags_DefaultOpen;
                 if (ImGui::TreeNodeEx("Spheres", treeNodeFlags))
                 {
@@ -104,9 +224,62 @@ namespace RayTracing {
                         Sphere& sphere = m_Scene.Spheres[i];
 
                         ImGui::PushID((int)i);
-                        m_Modified |= ImGui::DragFloat3("Position", glm::value_ptr(sphere.Position), 0.1f);
-                        m_Modified |= ImGui::DragFloat("Radius", &sphere.Radius, 0.1f);
-                        m_Modified |= ImGui::DragInt("Material Index", &sphere.MaterialIndex, 1.0f, 0, (int)m_Scene.Materials.size() - 1);
+                        bool changed = ImGui::DragFloat3("Position", glm::value_ptr(sphere.Position), 0.1f);
+                        changed |= ImGui::DragFloat("Radius", &sphere.Radius, 0.1f);
+                        changed |= ImGui::DragInt("Material Index", &sphere.MaterialIndex, 1.0f, 0, (int)m_Scene.Materials.size() - 1);
+                        if (changed)
+                            m_Scene.MarkSphereDirty((uint32_t)i);
+
+                        ImGui::Separator();
+                        ImGui::Separator();
+                        ImGui::PopID();
+                    }
+
+                    ImGui::TreePop();
+                }
+
+                if (ImGui::TreeNodeEx("Instances", treeNodeFlags))
+                {
+                    for (size_t i = 0; i < m_Scene.Instances.size(); i++)
+                    {
+                        Instance& instance = m_Scene.Instances[i];
+
+                        ImGui::PushID((int)i);
+                        m_Modified |= ImGui::DragFloat3("Position", glm::value_ptr(instance.Transform[3]), 0.1f);
+                        m_Modified |= ImGui::DragInt("Prototype Index", (int*)&instance.PrototypeIndex, 1.0f, 0, (int)m_Scene.Prototypes.size() - 1);
+                        m_Modified |= ImGui::DragInt("Material Override", &instance.MaterialIndex, 1.0f, -1, (int)m_Scene.Materials.size() - 1);
+
+                        ImGui::Separator();
+                        ImGui::Separator();
+                        ImGui::PopID();
+                    }
+
+                    ImGui::TreePop();
+                }
+
+                if (ImGui::TreeNodeEx("Meshes", treeNodeFlags))
+                {
+                    ImGui::InputText("Path", m_MeshPath, sizeof(m_MeshPath));
+                    if (ImGui::Button("Load Mesh"))
+                    {
+                        Mesh mesh;
+                        if (MeshLoader::Load(m_MeshPath, mesh, &m_MeshError))
+                        {
+                            Scenes::AddMesh(m_Scene, std::move(mesh));
+                            m_MeshError.clear();
+                            m_Modified = true;
+                        }
+                    }
+                    if (!m_MeshError.empty())
+                        ImGui::Text("%s", m_MeshError.c_str());
+
+                    for (size_t i = 0; i < m_Scene.Meshes.size(); i++)
+                    {
+                        Mesh& mesh = m_Scene.Meshes[i];
+
+                        ImGui::PushID((int)i);
+                        ImGui::Text("Triangles: %u", mesh.GetTriangleCount());
+                        m_Modified |= ImGui::DragInt("Material Index", &mesh.MaterialIndex, 1.0f, 0, (int)m_Scene.Materials.size() - 1);
 
                         ImGui::Separator();
                         ImGui::Separator();
@@ -123,10 +296,12 @@ namespace RayTracing {
                         Material& material = m_Scene.Materials[i];
 
                         ImGui::PushID((int)i);
-                        m_Modified |= ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo));
-                        m_Modified |= ImGui::ColorEdit3("Emission Color", glm::value_ptr(material.EmissionColor));
-                        m_Modified |= ImGui::DragFloat("Emission Strength", &material.EmissionStrength);
-                        m_Modified |= ImGui::DragFloat("Roughness", &material.Roughness, 0.01f, 0.0f, 1.0f);
+                        bool changed = ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo));
+                        changed |= ImGui::ColorEdit3("Emission Color", glm::value_ptr(material.EmissionColor));
+                        changed |= ImGui::DragFloat("Emission Strength", &material.EmissionStrength);
+                        changed |= ImGui::DragFloat("Roughness", &material.Roughness, 0.01f, 0.0f, 1.0f);
+                        if (changed)
+                            m_Scene.MarkMaterialDirty((uint32_t)i);
 
                         ImGui::Separator();
                         ImGui::Separator();
@@ -146,7 +321,7 @@ namespace RayTracing {
                 m_ViewportWidth = (uint32_t)ImGui::GetContentRegionAvail().x;
                 m_ViewportHeight = (uint32_t)ImGui::GetContentRegionAvail().y;
 
-                auto image = m_Renderer.GetFinalImage();
+                auto image = m_FinalImage;
                 if (image)
                     ImGui::Image(image->GetDescriptorSet(), ImVec2((float)image->GetWidth(), (float)image->GetHeight()), ImVec2(0.0f, 1.0f), ImVec2(1.0f, 0.0f));
 
@@ -156,31 +331,82 @@ namespace RayTracing {
 
         virtual void OnUpdate(float ts)
         {
-            if (m_Camera.OnUpdate(ts) || m_Modified)
-                m_Renderer.ResetFrameIndex();
+            m_LastUpdateTime = ts * 1000.0f;
 
-            Render();
-            m_Modified = false;
+            // Sphere and material edits only send what changed, anything else sends a copy of the whole scene
+            if (m_Modified)
+            {
+                m_Scene.ClearChanges();
+                m_RenderThread.SubmitScene(m_Scene);
+                m_Modified = false;
+            }
+            m_RenderThread.SubmitSceneChanges(m_Scene);
+
+            const bool resized = m_ViewportWidth != m_RenderWidth || m_ViewportHeight != m_RenderHeight;
+            m_Camera.OnResize(m_ViewportWidth, m_ViewportHeight);
+            if (m_Camera.OnUpdate(ts) || resized)
+            {
+                m_RenderWidth = m_ViewportWidth;
+                m_RenderHeight = m_ViewportHeight;
+                m_RenderThread.SubmitCamera(m_Camera, m_RenderWidth, m_RenderHeight);
+            }
+
+            m_RenderThread.SubmitSettings(m_Settings);
+            m_RenderThread.SetFrameLimit((uint32_t)m_FrameLimit);
+            m_RenderThread.SetDynamicResolution(m_DynamicResolution);
+
+            UploadFinalImage();
         }
 
-        void Render()
+        void LoadScene()
         {
-            Walnut::Timer timer;
+            Scene scene;
+            BVH sphereBVH;
+            if (!SceneFile::Load(m_ScenePath, scene, &sphereBVH, &m_SceneError))
+                return;
+
+            // The render thread gets its own copy, later edits send the whole scene again without the BVH
+            m_Scene = std::move(scene);
+            m_RenderThread.SubmitScene(m_Scene, std::move(sphereBVH));
+            m_SceneError.clear();
+        }
 
-            m_Renderer.OnResize(m_ViewportWidth, m_ViewportHeight);
-            m_Camera.OnResize(m_ViewportWidth, m_ViewportHeight);
-            m_Renderer.Render(m_Scene, m_Camera);
+        // Only frames the render thread finished since the last call are uploaded, it keeps tracing meanwhile
+        void UploadFinalImage()
+        {
+            const RenderThread::Frame* frame = m_RenderThread.AcquireFrame();
+            if (!frame)
+                return;
 
-            m_LastRenderTime = timer.ElapsedMillis();
+            m_Frame = frame;
+            if (!frame->Width || !frame->Height)
+                return;
+
+            if (!m_FinalImage)
+                m_FinalImage = std::make_shared<Walnut::Image>(frame->Width, frame->Height, Walnut::ImageFormat::RGBA);
+            else if (m_FinalImage->GetWidth() != frame->Width || m_FinalImage->GetHeight() != frame->Height)
+                m_FinalImage->Resize(frame->Width, frame->Height);
+
+            m_FinalImage->SetData(frame->ImageData.data());
         }
     private:
         Camera m_Camera;
         Scene m_Scene;
-        Renderer m_Renderer;
-
-        float m_LastRenderTime = 0.0f;
+        Renderer::Settings m_Settings;
+        RenderThread m_RenderThread;
+        const RenderThread::Frame* m_Frame = nullptr; // Last acquired, valid until the next AcquireFrame
+        std::shared_ptr<Walnut::Image> m_FinalImage;
+
+        float m_LastUpdateTime = 0.0f;
+        int m_FrameLimit = 0;
+        RenderThread::DynamicResolution m_DynamicResolution;
         bool m_Modified = false;
+        char m_ScenePath[256] = {};
+        std::string m_SceneError;
+        char m_MeshPath[256] = {};
+        std::string m_MeshError;
         uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
+        uint32_t m_RenderWidth = 0, m_RenderHeight = 0; // Last sent to the render thread
     };
 
 }
@@ -193,7 +419,7 @@ Walnut::Application* Walnut::CreateApplication(int argc, char** argv)
     spec.CustomTitlebar = true;
 
     Walnut::Application* app = new Walnut::Application(spec);
-    std::shared_ptr<RayTracing::RayTracingLayer> exampleLayer = std::make_shared<RayTracing::RayTracingLayer>();
+    std::shared_ptr<RayTracing::RayTracingLayer> exampleLayer = std::make_shared<RayTracing::RayTracingLayer>(argc > 1 ? argv[1] : nullptr);
     app->PushLayer(exampleLayer);
     return app;
 }
\ No newline at end of file
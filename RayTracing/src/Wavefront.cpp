@@ -0,0 +1,125 @@
+#include "Wavefront.h"
+
+#include <algorithm>
+
+namespace RayTracing {
+
+    void PathQueue::Reserve(uint32_t capacity)
+    {
+        if (capacity <= Origins.size())
+            return;
+
+        Origins.resize(capacity);
+        Directions.resize(capacity);
+        Throughputs.resize(capacity);
+        Radiance.resize(capacity);
+        LightSampledPdfs.resize(capacity);
+        Samplers.resize(capacity);
+        SampleSlots.resize(capacity);
+        Alive.resize(capacity);
+    }
+
+    void PathQueue::Copy(uint32_t to, const PathQueue& source, uint32_t from)
+    {
+        Origins[to] = source.Origins[from];
+        Directions[to] = source.Directions[from];
+        Throughputs[to] = source.Throughputs[from];
+        Radiance[to] = source.Radiance[from];
+        LightSampledPdfs[to] = source.LightSampledPdfs[from];
+        Samplers[to] = source.Samplers[from];
+        SampleSlots[to] = source.SampleSlots[from];
+        Alive[to] = source.Alive[from];
+    }
+
+    void HitQueue::Reserve(uint32_t capacity)
+    {
+        if (capacity <= Distances.size())
+            return;
+
+        Distances.resize(capacity);
+        Positions.resize(capacity);
+        Normals.resize(capacity);
+        MaterialIndices.resize(capacity);
+        LightIndices.resize(capacity);
+    }
+
+    void HitQueue::Copy(uint32_t to, const HitQueue& source, uint32_t from)
+    {
+        Distances[to] = source.Distances[from];
+        Positions[to] = source.Positions[from];
+        Normals[to] = source.Normals[from];
+        MaterialIndices[to] = source.MaterialIndices[from];
+        LightIndices[to] = source.LightIndices[from];
+    }
+
+    void ShadowQueue::Reserve(uint32_t capacity)
+    {
+        if (capacity <= Origins.size())
+            return;
+
+        Origins.resize(capacity);
+        Directions.resize(capacity);
+        MaxDistances.resize(capacity);
+        Radiance.resize(capacity);
+        PathSlots.resize(capacity);
+    }
+
+    void WavefrontQueues::Reserve(uint32_t sampleCount)
+    {
+        Paths.Reserve(sampleCount);
+        SortedPaths.Reserve(sampleCount);
+        Hits.Reserve(sampleCount);
+        SortedHits.Reserve(sampleCount);
+        Shadows.Reserve(sampleCount);
+
+        if (sampleCount > SampleRadiance.size())
+        {
+            SampleRadiance.resize(sampleCount);
+            SampleAlbedo.resize(sampleCount);
+            SampleNormal.resize(sampleCount);
+            SampleDepth.resize(sampleCount);
+            SortKeys.resize(sampleCount);
+        }
+    }
+
+    void WavefrontQueues::CompactPaths()
+    {
+        uint32_t count = 0;
+        for (uint32_t slot = 0; slot < Paths.Count; slot++)
+        {
+            if (!Paths.Alive[slot])
+                continue;
+
+            if (slot != count)
+                Paths.Copy(count, Paths, slot);
+            count++;
+        }
+        Paths.Count = count;
+    }
+
+    void WavefrontQueues::SortPaths(bool withHits)
+    {
+        // The slot in the low bits keeps equal keys in queue order
+        SortOrder.clear();
+        for (uint32_t slot = 0; slot < Paths.Count; slot++)
+        {
+            if (SortKeys[slot] != DeadKey)
+                SortOrder.push_back((uint64_t)SortKeys[slot] << 32 | slot);
+        }
+        std::sort(SortOrder.begin(), SortOrder.end());
+
+        for (uint32_t i = 0; i < (uint32_t)SortOrder.size(); i++)
+        {
+            const uint32_t slot = (uint32_t)SortOrder[i];
+            SortedPaths.Copy(i, Paths, slot);
+            if (withHits)
+                SortedHits.Copy(i, Hits, slot);
+        }
+        SortedPaths.Count = (uint32_t)SortOrder.size();
+
+        std::swap(Paths, SortedPaths);
+        if (withHits)
+            std::swap(Hits, SortedHits);
+    }
+
+}
\ No newline at end of file
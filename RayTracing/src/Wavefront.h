@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Sampler.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace RayTracing {
+
+    // What the wavefront pipeline groups the paths by before the stage that benefits from it
+    enum class PathSorting
+    {
+        None,
+        Material, // Hits with the same material are shaded together
+        Direction // Rays heading into the same octant are traced together
+    };
+
+    // Paths in flight, a field per array so every stage only streams through what it reads. Slots move around
+    // when the queue is compacted and sorted, SampleSlots remembers which sample of the tile a path belongs to
+    struct PathQueue
+    {
+        std::vector<glm::vec3> Origins;
+        std::vector<glm::vec3> Directions;
+        std::vector<glm::vec3> Throughputs;
+        std::vector<glm::vec3> Radiance; // Gathered so far
+        std::vector<float> LightSampledPdfs; // Density of the last bounce when the lights were also sampled there, else 0
+        std::vector<Sampler> Samplers;
+        std::vector<uint32_t> SampleSlots;
+        std::vector<uint8_t> Alive; // Cleared by shading when the path ends
+        uint32_t Count = 0;
+
+        void Reserve(uint32_t capacity);
+        void Copy(uint32_t to, const PathQueue& source, uint32_t from);
+    };
+
+    // Closest hit of the path in the same slot, a negative distance is a miss
+    struct HitQueue
+    {
+        std::vector<float> Distances;
+        std::vector<glm::vec3> Positions;
+        std::vector<glm::vec3> Normals;
+        std::vector<int> MaterialIndices;
+        std::vector<int> LightIndices;
+
+        void Reserve(uint32_t capacity);
+        void Copy(uint32_t to, const HitQueue& source, uint32_t from);
+    };
+
+    // Shadow rays towards sampled lights, each adds its radiance to its path if nothing is in the way
+    struct ShadowQueue
+    {
+        std::vector<glm::vec3> Origins;
+        std::vector<glm::vec3> Directions;
+        std::vector<float> MaxDistances;
+        std::vector<glm::vec3> Radiance;
+        std::vector<uint32_t> PathSlots;
+        uint32_t Count = 0;
+
+        void Reserve(uint32_t capacity);
+    };
+
+    // Everything a worker needs to run a tile through the wavefront pipeline, kept from tile to tile so the
+    // queues only allocate while they grow
+    struct WavefrontQueues
+    {
+        PathQueue Paths, SortedPaths;
+        HitQueue Hits, SortedHits;
+        ShadowQueue Shadows;
+
+        // Per sample of the tile, written when its path ends (or is first hit, for the features)
+        std::vector<glm::vec3> SampleRadiance;
+        std::vector<glm::vec3> SampleAlbedo;
+        std::vector<glm::vec3> SampleNormal;
+        std::vector<float> SampleDepth;
+
+        std::vector<uint32_t> Pixels; // Not yet converged pixels of the tile, x | y << 16
+        std::vector<uint32_t> SortKeys; // Per path slot, DeadKey drops the path
+        std::vector<uint64_t> SortOrder;
+
+        static constexpr uint32_t DeadKey = ~0u;
+
+        void Reserve(uint32_t sampleCount);
+        // Drops the paths that are no longer alive, keeping the order of the rest
+        void CompactPaths();
+        // Stable sort of the paths (and their hits, if withHits) by SortKeys, also dropping the DeadKey ones
+        void SortPaths(bool withHits);
+    };
+
+}
\ No newline at end of file
@@ -11,4 +11,6 @@ workspace "RayTracing"
 outputdir = "%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
 
 include "Walnut/Build-Walnut-External.lua"
-include "RayTracing"
\ No newline at end of file
+include "RayTracing"
+include "RayTracing-Headless"
+include "RayTracing-Benchmark"
\ No newline at end of file